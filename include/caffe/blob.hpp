@@ -262,6 +262,25 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Exchange the SyncedMemory holding the data_ of this Blob with that
+   *        of Blob other -- useful for handing a filled buffer to a consumer
+   *        without a copy, e.g. from a prefetch batch to a data layer top.
+   *
+   * Both Blobs must have the same count. Unlike ShareData, neither Blob
+   * aliases the other afterwards, so writes to one are never seen by the
+   * other.
+   */
+  void SwapData(Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to the given SyncedMemory, which
+   *        may be larger than this Blob -- useful for letting Blob%s that are
+   *        never live at the same time share one allocation.
+   *
+   * A later Reshape past the count this Blob could already hold allocates
+   * memory of its own again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -163,6 +163,14 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Host memory of SyncedMemory, in bytes: held by blobs, cached for reuse,
+  // and the most ever held at once. See HostMemoryPool.
+  static size_t host_memory_in_use();
+  static size_t host_memory_cached();
+  static size_t host_memory_peak();
+  // Settings of the host memory cache, shared by all threads.
+  static void set_host_memory_cache_limit(size_t cache_limit);
+  static void set_host_huge_pages(bool huge_pages);
 
  protected:
 #ifndef CPU_ONLY
@@ -294,6 +294,23 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward changes the layer's own blobs, as layers
+   *        keeping running statistics do.
+   *
+   * When a net recomputes activations for Backward, it restores such blobs
+   * after running Forward a second time.
+   */
+  virtual inline bool ForwardUpdatesBlobs() const { return false; }
+
+  /**
+   * @brief Return the floating point operations of Forward at the current
+   *        shapes, for profiling, or 0 for layers that do not count them.
+   *
+   * Backward is taken to cost twice as much.
+   */
+  virtual inline double ForwardFlops() const { return 0; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
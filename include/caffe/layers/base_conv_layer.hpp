@@ -27,6 +27,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  virtual inline double ForwardFlops() const {
+    return 2.0 * this->layer_param_.bottom_size() * num_ * conv_out_channels_
+        * conv_out_spatial_dim_ * kernel_dim_;
+  }
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
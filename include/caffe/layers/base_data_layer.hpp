@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -9,6 +10,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/prefetch_monitor.hpp"
 
 namespace caffe {
 
@@ -51,6 +53,16 @@ class Batch {
   Blob<Dtype> data_, label_;
 };
 
+/**
+ * @brief A sample claimed for one batch slot by a list-based data layer: the
+ *        file to read, its label and the frame offsets to decode (if any).
+ */
+struct ListSample {
+  std::string filename;
+  int label;
+  vector<int> offsets;
+};
+
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
@@ -67,18 +79,57 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 6;
-
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Multi-worker loading (prefetch_param.workers > 1) is available to layers
+  // that split load_batch into plan_batch, which runs in batch order under a
+  // lock and advances all shared sampling state (list cursor, shuffling,
+  // sampling RNGs), and fill_batch, which reads and transforms the planned
+  // samples using only the state of its worker.
+  virtual inline bool SupportsLoaderWorkers() const { return false; }
+  virtual void plan_batch(int worker_id) {}
+  virtual void fill_batch(Batch<Dtype>* batch, int worker_id) {}
+  // Per-worker transformer and transformation target; worker 0 uses the
+  // layer's own data_transformer_ and transformed_data_.
+  DataTransformer<Dtype>* loader_transformer(int worker_id);
+  Blob<Dtype>* loader_transformed_data(int worker_id);
+  int loader_workers() const { return loader_workers_; }
+
+  // Pops the next loaded batch, recording whether Forward had to wait.
+  Batch<Dtype>* PopFullBatch();
+  // Returns a consumed batch to the loader, resizing the queue if needed.
+  void RecycleBatch(Batch<Dtype>* batch);
+
+  // Prefetches batches (asynchronously if to GPU memory). The number of
+  // batches is set by prefetch_param and may change in adaptive mode.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  PrefetchMonitor prefetch_monitor_;
+  bool prefetch_stalled_, prefetch_saturated_;
+  float prefetch_wait_ms_;
 
   Blob<Dtype> transformed_data_;
+
+ private:
+  void RunLoaderWorkers();
+  void LoaderWorkerEntry(int worker_id, int device, Caffe::Brew mode,
+      int rand_seed, int solver_count, bool root_solver);
+
+  /**
+   Keep the boost synchronization primitives out of this header, as in
+   BlockingQueue, to avoid boost/NVCC issues.
+   */
+  class LoaderSync;
+
+  int loader_workers_;
+  vector<shared_ptr<DataTransformer<Dtype> > > loader_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > loader_transformed_data_;
+  shared_ptr<LoaderSync> loader_sync_;
+  // Ticket of the next batch to plan and of the next batch to release.
+  int loader_next_plan_, loader_next_release_;
 };
 
 }  // namespace caffe
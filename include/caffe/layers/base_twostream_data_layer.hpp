@@ -9,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/prefetch_monitor.hpp"
 
 namespace caffe {
 
@@ -69,16 +70,22 @@ public:
     virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
                              const vector<Blob<Dtype>*>& top);
 
-    // Prefetches batches (asynchronously if to GPU memory)
-    static const int PREFETCH_COUNT = 6;
-
 protected:
     virtual void InternalThreadEntry();
     virtual void load_batch(TwostreamBatch<Dtype>* batch) = 0;
+    // Pops the next loaded batch, recording whether Forward had to wait.
+    TwostreamBatch<Dtype>* PopFullBatch();
+    // Returns a consumed batch to the loader, resizing the queue if needed.
+    void RecycleBatch(TwostreamBatch<Dtype>* batch);
 
-    TwostreamBatch<Dtype> prefetch_[PREFETCH_COUNT];
+    // Prefetches batches (asynchronously if to GPU memory). The number of
+    // batches is set by prefetch_param and may change in adaptive mode.
+    vector<shared_ptr<TwostreamBatch<Dtype> > > prefetch_;
     BlockingQueue<TwostreamBatch<Dtype>*> prefetch_free_;
     BlockingQueue<TwostreamBatch<Dtype>*> prefetch_full_;
+    PrefetchMonitor prefetch_monitor_;
+    bool prefetch_stalled_, prefetch_saturated_;
+    float prefetch_wait_ms_;
 
 };
 
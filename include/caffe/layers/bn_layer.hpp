@@ -27,6 +27,9 @@ public:
     virtual inline const char* type() const { return "BN"; }
     virtual inline int ExactNumBottomBlobs() const { return 1; }
     virtual inline int ExactNumTopBlobs() const { return 1; }
+    virtual inline bool ForwardUpdatesBlobs() const {
+      return !frozen_ && this->phase_ == TRAIN;
+    }
 
 protected:
     virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -42,19 +45,25 @@ protected:
     void BroadcastChannel(const Dtype* input, Dtype* output);
 
     bool frozen_;
+    bool invert_top_;
     Dtype bn_momentum_;
     Dtype bn_eps_;
 
     int num_;
     int channels_;
-    int height_;
-    int width_;
+    int spatial_dim_;
 
     Blob<Dtype> broadcast_buffer_;
     Blob<Dtype> spatial_statistic_;
     Blob<Dtype> batch_statistic_;
 
+    // The CPU passes recompute the normalized input from the bottom and the
+    // per-channel mean and inverse std of the forward pass, or with
+    // invert_top_ from the top, scale and shift. They only shape and fill
+    // x_norm_ when running in place with the batch statistics, and then with
+    // invert_top_ only for channels with a zero scale.
     Blob<Dtype> x_norm_;
+    Blob<Dtype> x_mean_;
     Blob<Dtype> x_inv_std_;
 
     Blob<Dtype> spatial_sum_multiplier_;
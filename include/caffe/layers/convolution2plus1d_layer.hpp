@@ -0,0 +1,84 @@
+#ifndef CAFFE_CONVOLUTION2PLUS1D_LAYER_HPP_
+#define CAFFE_CONVOLUTION2PLUS1D_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Factorized (2+1)D convolution of 5-D blobs (N x C x L x H x W): a
+ *        1 x k x k spatial convolution to mid_output channels followed by a
+ *        kd x 1 x 1 temporal convolution to num_output channels, at a
+ *        fraction of the cost of a full kd x k x k Convolution3D.
+ *
+ * The spatial factor unfolds every frame with vol2col (kernel depth 1) and
+ * runs one GEMM per sample. The temporal factor needs no unfolding: each
+ * output frame accumulates one GEMM per temporal tap directly on the
+ * strided frames of the intermediate volume. The intermediate volume of one
+ * sample lives in a single buffer, which the backward pass recomputes.
+ */
+template <typename Dtype>
+class Convolution2Plus1DLayer : public Layer<Dtype> {
+ public:
+  explicit Convolution2Plus1DLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Convolution2Plus1D"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline double ForwardFlops() const {
+    return 2.0 * num_ * spatial_dim_ * mid_output_
+        * (channels_ * kernel_size_ * kernel_size_ * length_
+           + num_output_ * kernel_depth_ * length_out_);
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // Unfolds one sample into spatial_col_ and convolves it into the data of
+  // mid_buffer_.
+  void SpatialForward(const Dtype* bottom_data);
+  // Gathers the temporal weights (num_output x mid_output x kd) into kd
+  // matrices of num_output x mid_output, one per temporal tap.
+  void GatherTemporalWeights();
+
+  int num_;
+  int channels_;
+  int length_;
+  int height_;
+  int width_;
+  int num_output_;
+  int mid_output_;
+  int kernel_size_;
+  int kernel_depth_;
+  int stride_;
+  int temporal_stride_;
+  int pad_;
+  int temporal_pad_;
+  bool bias_term_;
+  int length_out_;
+  int spatial_dim_;  // height_out * width_out
+
+  Blob<Dtype> spatial_col_;
+  // Intermediate volume (mid_output x length x spatial_dim) of one sample;
+  // the diff holds its gradient.
+  Blob<Dtype> mid_buffer_;
+  // Per-tap temporal weights (kd x num_output x mid_output) and their diff.
+  Blob<Dtype> temporal_weight_;
+  Blob<Dtype> bias_multiplier_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_CONVOLUTION2PLUS1D_LAYER_HPP_
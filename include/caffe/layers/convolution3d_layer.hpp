@@ -45,6 +45,9 @@ public:
     virtual inline const char* type() const { return "Convolution3D"; }
     virtual inline int ExactNumBottomBlobs() const { return 1; }
     virtual inline int ExactNumTopBlobs() const { return 1; }
+    virtual inline double ForwardFlops() const {
+        return 2.0 * num_ * num_output_ * K_ * N_;
+    }
 
 protected:
     virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -69,7 +72,29 @@ protected:
     int width_;
     int num_output_;
     int filter_group_;
+    // Input channel groups: group g of the outputs sees only input channels
+    // [g * channels_ / group_, (g + 1) * channels_ / group_).
+    int group_;
+    // One input channel per group goes through a dedicated CPU kernel.
+    bool depthwise_;
     Blob<Dtype> col_buffer_;
+    // Number of samples unfolded together by the CPU passes, and the output
+    // of their joint GEMM laid out num_output_ x (batch_samples_ * N_).
+    int batch_samples_;
+    Blob<Dtype> output_buffer_;
+    // 1x1x1 kernels with stride 1 and no padding GEMM on the bottom directly.
+    bool pointwise_;
+    // Winograd F(2x2x2, 3x3x3) CPU forward. The transformed filters are
+    // cached along with the weights they were computed from, and redone
+    // only once the weights change.
+    bool winograd_;
+    Blob<Dtype> winograd_workspace_;
+    Blob<Dtype> winograd_filter_;
+    Blob<Dtype> winograd_weight_;
+    // Channels-last (NDHWC) bottom and top, convolved on the CPU one kernel
+    // tap at a time with the weights gathered into tap_weight_.
+    bool ndhwc_;
+    Blob<Dtype> tap_weight_;
     shared_ptr<SyncedMemory> bias_multiplier_;
     bool bias_term_;
     int M_;
@@ -36,9 +36,14 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual inline bool SupportsLoaderWorkers() const { return true; }
+  virtual void plan_batch(int worker_id);
+  virtual void fill_batch(Batch<Dtype>* batch, int worker_id);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Samples planned for the batch each loader worker is filling.
+  vector<vector<ListSample> > worker_samples_;
 };
 
 
@@ -28,6 +28,7 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline double ForwardFlops() const { return 2.0 * M_ * K_ * N_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -0,0 +1,47 @@
+#ifndef CAFFE_LAYOUT3D_LAYER_HPP_
+#define CAFFE_LAYOUT3D_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Converts 5-D blobs between the channels-first NCDHW layout
+ *        (num, channels, length, height, width) and the channels-last NDHWC
+ *        layout (num, length, height, width, channels) of the 3D layers.
+ *
+ * layout3d_param.layout names the layout of the top; the bottom is in the
+ * other one. Every sample is a (channels x length * height * width) matrix
+ * in one layout and its transpose in the other. Net inserts these layers by
+ * itself when NetParameter.layout3d is NDHWC.
+ */
+template <typename Dtype>
+class Layout3DLayer : public Layer<Dtype> {
+ public:
+  explicit Layout3DLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Layout3D"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int num_;
+  int channels_;
+  int spatial_dim_;  // length * height * width
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_LAYOUT3D_LAYER_HPP_
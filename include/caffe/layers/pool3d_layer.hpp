@@ -47,8 +47,10 @@ class Pooling3DLayer : public Layer<Dtype> {
     virtual inline int MinTopBlobs() const { return 1; }
     // MAX POOL layers can output an extra top blob for the mask;
     // others can only output the pooled inputs.
-    // in Pooling3D, only output 1 blob
-    virtual inline int MaxTopBlobs() const { return 1; }
+    virtual inline int MaxTopBlobs() const {
+      return (this->layer_param_.pooling3d_param().pool() ==
+              Pooling3DParameter_PoolMethod_MAX) ? 2 : 1;
+    }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -65,6 +67,10 @@ class Pooling3DLayer : public Layer<Dtype> {
   int stride_;
   int temporal_stride_;
   int pad_;
+  int temporal_pad_;
+  bool global_pooling_;
+  // Channels-last (NDHWC) bottom and top, pooled on the CPU only.
+  bool ndhwc_;
   int channels_;
   int length_;
   int height_;
@@ -73,6 +79,10 @@ class Pooling3DLayer : public Layer<Dtype> {
   int pooled_height_;
   int pooled_width_;
   Blob<Dtype> rand_idx_;
+  // Offset of the winner of every MAX window within its (length x height x
+  // width) input volume -- or, with NDHWC, within its whole input sample --
+  // unless the mask goes to top[1].
+  Blob<int> max_idx_;
 };
 
 }
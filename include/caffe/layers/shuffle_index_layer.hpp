@@ -51,17 +51,34 @@ protected:
         const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
     /**
-     * @brief ConvertIndex2VectorIndex
-     *        Convert index to a vector of index according the shape of a blob.
+     * @brief CompilePermutation
+     *        Describe the copy out[i] = in[j] that applies a permutation of
+     *        axes as the out shape and the in stride along each out axis,
+     *        with unit axes dropped and axes that stay adjacent merged.
      *
-     * @param blob_shape input blob shape
-     * @param blob_count input blob count
-     * @param index int index
-     * @return an index in vector form
+     * @param out_shape shape of the output blob
+     * @param in_strides stride in the input blob of every output axis
+     * @param shape merged output shape
+     * @param strides input stride of every merged output axis
      */
-    vector<int> ConvertIndex2VectorIndex(const vector<int>& blob_shape, const int blob_count, const int index);
+    static void CompilePermutation(const vector<int>& out_shape,
+        const vector<int>& in_strides, vector<int>* shape,
+        vector<int>* strides);
+
+    /**
+     * @brief Permute
+     *        Run a compiled permutation: a copy if the input is read in
+     *        order, rows if the innermost axis stays innermost, and
+     *        otherwise tiles of the innermost axes of input and output.
+     */
+    static void Permute(const vector<int>& shape, const vector<int>& strides,
+        const Dtype* in, Dtype* out);
 
     vector<int> new_axes_;
+
+    /// the permutations from bottom to top and back
+    vector<int> forward_shape_, forward_strides_;
+    vector<int> backward_shape_, backward_strides_;
 };
 
 }  // namespace caffe
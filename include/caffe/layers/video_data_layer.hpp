@@ -30,20 +30,45 @@ public:
 
     virtual inline const char* type() const { return "VideoData"; }
     virtual inline int ExactNumBottomBlobs() const { return 0; }
-    virtual inline int ExactNumTopBlobs() const { return 2; }
+    // data, label and, with variable_length, sequence continuation indicators
+    virtual inline int MinTopBlobs() const { return 2; }
+    virtual inline int MaxTopBlobs() const { return 3; }
 
 protected:
+    virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+                             const vector<Blob<Dtype>*>& top);
+    virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+                             const vector<Blob<Dtype>*>& top);
+
     shared_ptr<Caffe::RNG> prefetch_rng_;
     shared_ptr<Caffe::RNG> prefetch_rng_2_;
     shared_ptr<Caffe::RNG> prefetch_rng_1_;
     shared_ptr<Caffe::RNG> frame_prefetch_rng_;
 
     virtual void ShuffleVideos();
+    void NextVideo();
+    int NumSteps(int duration) const;
+    void SampleOffsets(int duration, int num_steps, vector<int>* offsets);
+    // Sorts the videos of the next bucket_pool batches by length into batches.
+    void PlanBuckets();
+    void FillSequenceBatch(Batch<Dtype>* batch, int worker_id);
+    // Derives the continuation indicators from the labels of padded steps.
+    void FillContinuation(const vector<Blob<Dtype>*>& top);
     virtual void load_batch(Batch<Dtype>* batch);
+    virtual inline bool SupportsLoaderWorkers() const { return true; }
+    virtual void plan_batch(int worker_id);
+    virtual void fill_batch(Batch<Dtype>* batch, int worker_id);
 
     vector<std::pair<std::string, int> > lines_;
     vector<int> lines_duration_;
     int lines_id_;
+    // Samples planned for the batch each loader worker is filling.
+    vector<vector<ListSample> > worker_samples_;
+    // Length-bucketed batches waiting to be planned (variable_length only).
+    vector<vector<ListSample> > bucket_batches_;
+    int bucket_batch_id_;
+    // Shape of a single transformed snippet, i.e. one time step.
+    vector<int> step_shape_;
 };
 
 
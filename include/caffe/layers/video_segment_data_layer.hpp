@@ -41,10 +41,15 @@ protected:
 
     virtual void ShuffleVideos();
     virtual void load_batch(Batch<Dtype>* batch);
+    virtual inline bool SupportsLoaderWorkers() const { return true; }
+    virtual void plan_batch(int worker_id);
+    virtual void fill_batch(Batch<Dtype>* batch, int worker_id);
 
     vector<std::pair<std::string, int> > lines_;
     vector<int> lines_start_fr_;
     int lines_id_;
+    // Samples planned for the batch each loader worker is filling.
+    vector<vector<ListSample> > worker_samples_;
 };
 
 
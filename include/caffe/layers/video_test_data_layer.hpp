@@ -39,8 +39,13 @@ class VideoTestDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual inline bool SupportsLoaderWorkers() const { return true; }
+  virtual void plan_batch(int worker_id);
+  virtual void fill_batch(Batch<Dtype>* batch, int worker_id);
 
   FlowDataReader reader_;
+  // Datums taken from the reader for the batch each loader worker is filling.
+  vector<vector<Datum*> > worker_datums_;
 };
 
 }  // namespace caffe
@@ -36,6 +36,9 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual inline bool SupportsLoaderWorkers() const { return true; }
+  virtual void plan_batch(int worker_id);
+  virtual void fill_batch(Batch<Dtype>* batch, int worker_id);
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
@@ -48,6 +51,9 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+  // Windows (and whether to mirror them) planned for the batch each loader
+  // worker is filling: background windows first, then foreground ones.
+  vector<vector<std::pair<vector<float>, bool> > > worker_windows_;
 };
 
 }  // namespace caffe
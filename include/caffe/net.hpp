@@ -11,6 +11,8 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/graph_scheduler.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
@@ -224,6 +226,11 @@ class Net {
    */
   static void FilterNet(const NetParameter& param,
       NetParameter* param_filtered);
+  /**
+   * @brief Turn off invert_top of the in-place BN layers whose top a later
+   *        layer changes in place before their Backward reads it.
+   */
+  static void DisableUnsafeInvertTop(NetParameter* param);
   /// @brief return whether NetState state meets NetStateRule rule
   static bool StateMeetsRule(const NetState& state, const NetStateRule& rule,
       const string& layer_name);
@@ -242,6 +249,37 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Put the blobs that share memory already in the same group.
+  int GroupBlobsByMemory();
+  /// @brief Mark the groups of the net inputs and outputs and of keep_blob.
+  void KeepNetBlobs(const NetParameter& param, vector<bool>* kept);
+  /// @brief Work out which blobs can share memory, for share_memory.
+  void PlanSharedMemory(const NetParameter& param);
+  /// @brief Work out which blobs to recompute in Backward, for checkpoints.
+  void PlanCheckpoints(const NetParameter& param);
+  /// @brief Give the blobs that share memory allocations fitting their
+  ///        current sizes.
+  void AssignSharedMemory();
+  /// @brief Save, or restore to replay it, the random state a recomputed
+  ///        layer runs Forward with.
+  void SetLayerRng(const int layer_id, const bool replay);
+  /// @brief Run Forward again for the recomputed layers of a segment.
+  void RecomputeSegment(const int segment);
+  /// @brief Work out which layers every layer waits for, for branch_threads.
+  void PlanBranches(const NetParameter& param);
+  /// @brief Run the layers from first on, step apart, on the scheduler.
+  void RunBranches(const vector<vector<int> >& layer_deps, const int first,
+      const int step, const int num_layers, bool forward);
+  /// @brief Run the layer first + step * k of RunBranches.
+  void RunBranchLayer(const int first, const int step, bool forward,
+      const int k);
+  /// @brief Run Forward of a layer, recording it to the Profiler.
+  Dtype ForwardLayer(const int layer_id, const char* category = "forward");
+  /// @brief Run Backward of a layer, recording it to the Profiler.
+  void BackwardLayer(const int layer_id);
+  /// @brief The bytes of the bottoms, tops and params of a layer.
+  double LayerBytes(const int layer_id) const;
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -280,6 +318,29 @@ class Net {
   vector<string> param_display_names_;
   vector<pair<int, int> > param_layer_indices_;
   map<string, int> param_names_index_;
+  /// The group of blobs, which already share memory, that each blob belongs
+  /// to, or -1 for blobs with memory of their own; and the first and last
+  /// layer every group is live in.
+  vector<int> blob_memory_group_;
+  vector<pair<int, int> > memory_group_live_;
+  /// The blobs sharing memory that blob_by_name already warned about.
+  mutable set<int> shared_blobs_warned_;
+  /// With checkpoints, the segment of every layer, the first layer of every
+  /// segment, whether a layer is run again in Backward to recompute its
+  /// tops, the random state it first ran with, and the segment whose
+  /// recomputed tops are current.
+  vector<int> layer_segment_;
+  vector<int> segment_start_;
+  vector<bool> layer_recompute_;
+  vector<rng_t> layer_rng_;
+  int live_segment_;
+  /// With branch_threads, the scheduler running layers at once, the layers
+  /// every layer waits for in Forward and in Backward, and the losses of
+  /// the layers, summed up in order.
+  shared_ptr<GraphScheduler> scheduler_;
+  vector<vector<int> > layer_forward_deps_;
+  vector<vector<int> > layer_backward_deps_;
+  vector<Dtype> layer_loss_;
   /// blob indices for the input and the output of the net
   vector<int> net_input_blob_indices_;
   vector<int> net_output_blob_indices_;
@@ -4,6 +4,7 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 
 namespace caffe {
 
@@ -12,27 +13,19 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Either way the allocations go through HostMemoryPool, which caches freed
+// blocks for reuse.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
-  if (Caffe::mode() == Caffe::GPU) {
-    CUDA_CHECK(cudaMallocHost(ptr, size));
-    *use_cuda = true;
-    return;
-  }
-#endif
-  *ptr = malloc(size);
+  *use_cuda = Caffe::mode() == Caffe::GPU;
+#else
   *use_cuda = false;
-  CHECK(*ptr) << "host allocation of size " << size << " failed";
+#endif
+  *ptr = HostMemoryPool::Get().Allocate(size, *use_cuda);
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
-#ifndef CPU_ONLY
-  if (use_cuda) {
-    CUDA_CHECK(cudaFreeHost(ptr));
-    return;
-  }
-#endif
-  free(ptr);
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda) {
+  HostMemoryPool::Get().Free(ptr, size, use_cuda);
 }
 
 
@@ -0,0 +1,33 @@
+#ifndef CAFFE_UTIL_CONV3D_DEPTHWISE_HPP_
+#define CAFFE_UTIL_CONV3D_DEPTHWISE_HPP_
+
+namespace caffe {
+
+// Depthwise 3D convolution of one volume: output channel
+// c * multiplier + m sees input channel c only, through its own
+// kdepth x ksize x ksize filter. Such a filter has far too few taps for
+// vol2col + GEMM to pay off, so the kernels loop over the valid taps of
+// every output directly.
+
+// data_out (channels * multiplier x length_out x height_out x width_out) =
+//   weight (channels * multiplier x 1 x kdepth x ksize x ksize) * data_im
+//   + bias. bias may be NULL.
+template <typename Dtype>
+void conv3d_depthwise_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width, const Dtype* weight,
+    const int multiplier, const int ksize, const int kdepth, const int pad,
+    const int temporal_pad, const int stride, const int temporal_stride,
+    const Dtype* bias, Dtype* data_out);
+
+// Accumulates the gradient w.r.t. the weights into weight_diff and, unless
+// bottom_diff is NULL, writes the gradient w.r.t. the input to bottom_diff.
+template <typename Dtype>
+void conv3d_depthwise_backward_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width, const Dtype* top_diff,
+    const Dtype* weight, const int multiplier, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, Dtype* weight_diff, Dtype* bottom_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONV3D_DEPTHWISE_HPP_
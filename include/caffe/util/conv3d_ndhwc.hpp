@@ -0,0 +1,48 @@
+#ifndef CAFFE_UTIL_CONV3D_NDHWC_HPP_
+#define CAFFE_UTIL_CONV3D_NDHWC_HPP_
+
+namespace caffe {
+
+// 3D convolution of one channels-last volume (length x height x width x
+// channels) as an implicit GEMM: for every output row and kernel tap, the
+// channel vectors the tap reads form a row-major matrix whose rows are
+// stride * channels apart, so they are multiplied with the tap's
+// channels x num_output weight matrix in place, without any unfolding.
+
+// Gathers weight (num_output x channels x kdepth x ksize x ksize) into
+// tap_weight (kdepth * ksize * ksize x channels x num_output).
+template <typename Dtype>
+void conv3d_ndhwc_gather_weight_cpu(const Dtype* weight, const int num_output,
+    const int channels, const int ksize, const int kdepth,
+    Dtype* tap_weight);
+
+// Adds tap_weight_diff, laid out as by conv3d_ndhwc_gather_weight_cpu, to
+// weight_diff (num_output x channels x kdepth x ksize x ksize).
+template <typename Dtype>
+void conv3d_ndhwc_scatter_weight_cpu(const Dtype* tap_weight_diff,
+    const int num_output, const int channels, const int ksize,
+    const int kdepth, Dtype* weight_diff);
+
+// data_out (length_out x height_out x width_out x num_output) =
+//   data_im convolved with tap_weight, plus bias. bias may be NULL.
+template <typename Dtype>
+void conv3d_ndhwc_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* tap_weight, const int num_output, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const Dtype* bias, Dtype* data_out);
+
+// Accumulates the gradient w.r.t. tap_weight into tap_weight_diff and,
+// unless bottom_diff is NULL, writes the gradient w.r.t. data_im to
+// bottom_diff.
+template <typename Dtype>
+void conv3d_ndhwc_backward_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* top_diff, const Dtype* tap_weight, const int num_output,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, Dtype* tap_weight_diff,
+    Dtype* bottom_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONV3D_NDHWC_HPP_
@@ -0,0 +1,38 @@
+#ifndef CAFFE_UTIL_CONV3D_WINOGRAD_HPP_
+#define CAFFE_UTIL_CONV3D_WINOGRAD_HPP_
+
+namespace caffe {
+
+// Winograd F(2x2x2, 3x3x3) stride-1 3D convolution of one volume. Every
+// 2x2x2 block of outputs is computed from a 4x4x4 input tile with 64
+// element-wise products per (input, output) channel pair instead of 216,
+// the products of all tiles being batched into 64 GEMMs of
+// (num_output x channels) * (channels x tiles).
+
+// Number of Dtype elements of the transformed filters.
+int conv3d_winograd_filter_size(const int num_output, const int channels);
+
+// Number of Dtype elements of workspace needed by conv3d_winograd_cpu.
+int conv3d_winograd_workspace_size(const int channels, const int length,
+    const int height, const int width, const int num_output, const int pad,
+    const int temporal_pad);
+
+// Transforms weight (num_output x channels x 3 x 3 x 3) into 64 matrices of
+// num_output x channels.
+template <typename Dtype>
+void conv3d_winograd_transform_filter_cpu(const Dtype* weight,
+    const int num_output, const int channels, Dtype* filter_transformed);
+
+// data_out (num_output x length_out x height_out x width_out) =
+//   weight * data_im + bias, with the weights given by
+// conv3d_winograd_transform_filter_cpu. bias may be NULL.
+template <typename Dtype>
+void conv3d_winograd_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* filter_transformed, const int num_output, const int pad,
+    const int temporal_pad, const Dtype* bias, Dtype* data_out,
+    Dtype* workspace);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONV3D_WINOGRAD_HPP_
@@ -0,0 +1,17 @@
+#ifndef _CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+#define _CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters, folding the BN, BatchNorm, Scale and Bias layers that
+// compute a fixed per-channel affine in param.state().phase() into the
+// weights and bias of the Convolution, Convolution3D or InnerProduct layer
+// whose top they alone consume, and dropping them. The layers of param
+// have to carry their trained blobs.
+void FoldBatchNorm(const NetParameter& param, NetParameter* param_folded);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
@@ -0,0 +1,70 @@
+#ifndef CAFFE_UTIL_GRAPH_SCHEDULER_HPP_
+#define CAFFE_UTIL_GRAPH_SCHEDULER_HPP_
+
+#include <boost/function.hpp>
+
+#include <deque>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread and friends instead of including
+ boost/thread.hpp to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost {
+class thread;
+class mutex;
+class condition_variable;
+}
+
+namespace caffe {
+
+/**
+ * @brief Runs the tasks of a dependency graph on a pool of threads, every
+ *        task once all the tasks it depends on are done, so that independent
+ *        tasks, as the layers of the towers of a two-stream net, run at once.
+ *
+ * The threads persist between runs, the calling thread being one of them.
+ * Each thread gets an equal share of the OpenMP threads of the caller, which
+ * the OpenMP loops of the layers, and BLAS libraries threaded with OpenMP,
+ * split their work among.
+ */
+class GraphScheduler {
+ public:
+  explicit GraphScheduler(int num_threads);
+  ~GraphScheduler();
+
+  /**
+   * @brief Run task(i) for all tasks i, after task(j) for every j with i in
+   *        successors[j]. Returns when all tasks are done.
+   */
+  void Run(const vector<vector<int> >& successors,
+      const boost::function<void(int)>& task);
+
+  int num_threads() const { return threads_.size() + 1; }
+
+ private:
+  void WorkerEntry(int omp_threads, bool root_solver);
+  // Run the first ready task, called and returning with the lock held.
+  template <typename Lock>
+  void RunReady(Lock* lock);
+
+  shared_ptr<boost::mutex> mutex_;
+  shared_ptr<boost::condition_variable> ready_, done_;
+  vector<shared_ptr<boost::thread> > threads_;
+  int omp_threads_;
+  bool stop_;
+  // the state of the current run
+  const vector<vector<int> >* successors_;
+  const boost::function<void(int)>* task_;
+  vector<int> num_waiting_;
+  std::deque<int> ready_tasks_;
+  int num_remaining_;
+
+  DISABLE_COPY_AND_ASSIGN(GraphScheduler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRAPH_SCHEDULER_HPP_
@@ -0,0 +1,89 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A cache of the host memory of SyncedMemory, so that blobs freed and
+ *        allocated again, as when reshaping to batches of varying shape,
+ *        reuse blocks instead of getting fresh pages from the system.
+ *
+ * Sizes are rounded up to one of four classes per power of two, which wastes
+ * less than a quarter of a block. Blocks are aligned to 64 bytes, and blocks
+ * of 2 MB and more to 2 MB when huge pages are enabled, which advises the
+ * kernel to back them with transparent huge pages. Freed blocks are cached
+ * by class, pinned ones apart. The cache holds at most the cache limit, 1 GB
+ * by default, and never more than the peak in use, so that the pool holds at
+ * most twice what was ever needed at once; past that, the blocks of the
+ * classes used longest ago go back to the system first. The pool is shared
+ * by all threads.
+ */
+class HostMemoryPool {
+ public:
+  static HostMemoryPool& Get();
+
+  /// @brief The size of the blocks a request of the given size is served by.
+  static size_t ClassSize(size_t size);
+
+  /// @brief Get a block of at least size bytes, pinned for use_cuda.
+  void* Allocate(size_t size, bool use_cuda);
+  /// @brief Give back a block allocated with the same size and use_cuda.
+  void Free(void* ptr, size_t size, bool use_cuda);
+  /// @brief Return all cached blocks to the system.
+  void Trim();
+
+  void set_cache_limit(size_t cache_limit);
+  void set_huge_pages(bool huge_pages);
+  /// @brief Bytes in the blocks handed out.
+  size_t in_use();
+  /// @brief Bytes in the blocks kept for reuse.
+  size_t cached();
+  /// @brief The most bytes ever handed out at once.
+  size_t peak();
+
+ private:
+  HostMemoryPool();
+  struct FreeClass {
+    std::vector<void*> blocks;
+    // the clock_ when a block of the class was last cached or reused
+    uint64_t last_used;
+  };
+
+  // huge_pages is the huge_pages_ read with the lock held.
+  static void* SystemAllocate(size_t size, bool use_cuda, bool huge_pages);
+  static void SystemFree(void* ptr, bool use_cuda);
+  // The bytes the cache may hold, called with the lock held.
+  size_t limit() const;
+  // Take blocks of the classes used longest ago out of the cache until it
+  // is within its limit, for the caller to free once the lock is released.
+  void Evict(std::vector<std::pair<void*, bool> >* evicted);
+
+  shared_ptr<boost::mutex> mutex_;
+  // the cached classes by class size, without and with use_cuda; a class is
+  // dropped once it has no blocks left
+  std::map<size_t, FreeClass> free_blocks_[2];
+  size_t in_use_, cached_, peak_, cache_limit_;
+  bool huge_pages_;
+  uint64_t clock_;
+
+  DISABLE_COPY_AND_ASSIGN(HostMemoryPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
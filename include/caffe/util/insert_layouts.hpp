@@ -0,0 +1,25 @@
+#ifndef _CAFFE_UTIL_INSERT_LAYOUTS_HPP_
+#define _CAFFE_UTIL_INSERT_LAYOUTS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters, and if param.layout3d() is NDHWC, switch the
+// Convolution3D, Pooling3D and BN layers to channels-last blobs and add
+// Layout3D layers wherever a blob crosses from those layers to any other.
+// Elementwise layers, and MVN_ND over axes from 1 on, run in the layout
+// of their bottoms. The net outputs and the blobs named in keep_blob are
+// converted back to NCDHW under their own names, the channels-last blobs
+// they are converted from being renamed with LayoutBlobName.
+void InsertLayoutConversions(const NetParameter& param,
+    NetParameter* param_layout);
+
+string LayoutBlobName(const string& blob_name, const Layout3D layout,
+    const int conversion_idx);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INSERT_LAYOUTS_HPP_
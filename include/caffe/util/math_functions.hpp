@@ -20,6 +20,14 @@ void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
     Dtype* C);
 
+// The same product on row-major sub-matrices: lda, ldb and ldc are the
+// row strides of A, B and C within the matrices they are cut from.
+template <typename Dtype>
+void caffe_cpu_strided_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc);
+
 template <typename Dtype>
 void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
@@ -36,6 +44,11 @@ void caffe_cpu_axpby(const int N, const Dtype alpha, const Dtype* X,
 template <typename Dtype>
 void caffe_copy(const int N, const Dtype *X, Dtype *Y);
 
+// Y (N x M) = X^T for a row-major M x N matrix X, copied in cache-sized
+// tiles. X and Y must not overlap.
+template <typename Dtype>
+void caffe_cpu_transpose(const int M, const int N, const Dtype* X, Dtype* Y);
+
 template <typename Dtype>
 void caffe_set(const int N, const Dtype alpha, Dtype *X);
 
@@ -0,0 +1,45 @@
+#ifndef CAFFE_UTIL_PREFETCH_MONITOR_HPP_
+#define CAFFE_UTIL_PREFETCH_MONITOR_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Tracks how often a prefetching data layer waits for its loader and,
+ *        in adaptive mode, decides when the prefetch queue should grow or
+ *        shrink (see PrefetchParameter).
+ */
+class PrefetchMonitor {
+ public:
+  PrefetchMonitor(const PrefetchParameter& param, const string& name);
+
+  /**
+   * @brief Records one Forward call and returns the change to apply to the
+   *        queue depth: +1 to add a batch, -1 to retire one, 0 to keep it.
+   *
+   * @param stalled whether the full queue was empty when Forward popped
+   * @param wait_ms time spent waiting for the batch
+   * @param saturated whether every other batch was already loaded, i.e. the
+   *        loader was idle waiting for a free batch
+   * @param depth the current number of batches
+   * @param batch_bytes the host memory held by one batch
+   */
+  int Update(bool stalled, float wait_ms, bool saturated, int depth,
+      size_t batch_bytes);
+
+ protected:
+  int MaxDepth(size_t batch_bytes) const;
+
+  const PrefetchParameter param_;
+  const string name_;
+  int window_forwards_, window_stalls_, window_saturated_;
+  int log_forwards_, log_stalls_;
+  float log_wait_ms_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PREFETCH_MONITOR_HPP_
@@ -0,0 +1,103 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A record of what training and inference spend their time on, kept
+ *        in a ring buffer of the latest events so that a running job can be
+ *        looked into without rerunning it.
+ *
+ * Nets record the Forward and Backward of every layer, with its FLOPs and
+ * the bytes of its blobs, prefetching data layers the load, read and
+ * transform time of every batch, BlockingQueue the time pop waits, and the
+ * solver its updates. Events are wall-clock spans of the thread running
+ * them; in GPU mode they mostly time kernel launches. The profiler is shared
+ * by all threads and is on by default, at the cost of a lock per event.
+ */
+class Profiler {
+ public:
+  static Profiler& Get();
+  /// @brief Microseconds since the profiler was created.
+  static int64_t Now();
+
+  /// @brief Record a span of the calling thread.
+  void Record(const string& name, const char* category, int64_t start_us,
+      int64_t duration_us, double flops = 0, double bytes = 0);
+  /**
+   * @brief Record a batch of a data layer just loaded, and the time spent
+   *        reading and transforming its items, if measured, drawn one after
+   *        the other from the start of the batch.
+   */
+  void RecordBatch(const string& name, double batch_us, double read_us,
+      double transform_us);
+
+  /// @brief Write the events as Chrome trace_event JSON, for about:tracing.
+  void WriteTrace(const string& filename);
+  /**
+   * @brief The count, time, FLOPs and bytes of the events by category and
+   *        name, one line each, most time first.
+   */
+  string Summary();
+  void Clear();
+
+  void set_enabled(bool enabled);
+  bool enabled() const { return enabled_; }
+  /// @brief The number of latest events kept, 65536 by default.
+  void set_capacity(size_t capacity);
+
+ private:
+  struct Event {
+    string name;
+    const char* category;
+    int64_t start, duration;
+    int thread;
+    double flops, bytes;
+  };
+
+  Profiler();
+  // The events kept, oldest first, called with the lock held.
+  vector<const Event*> Events() const;
+
+  shared_ptr<boost::mutex> mutex_;
+  bool enabled_;
+  vector<Event> events_;
+  size_t capacity_, num_recorded_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+/// @brief Records the span of its scope.
+class ProfileScope {
+ public:
+  ProfileScope(const string& name, const char* category)
+      : name_(name), category_(category), start_(Profiler::Now()) {}
+  ~ProfileScope() {
+    Profiler::Get().Record(name_, category_, start_,
+        Profiler::Now() - start_);
+  }
+
+ private:
+  const string name_;
+  const char* category_;
+  int64_t start_;
+
+  DISABLE_COPY_AND_ASSIGN(ProfileScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
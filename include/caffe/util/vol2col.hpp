@@ -31,6 +31,21 @@ void col2vol_cpu(const Dtype* data_col, const int channels, const int length,
     const int height, const int width, const int ksize, const int kdepth, const int pad,
     const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_im);
 
+// Unfold / fold num consecutive volumes at once. The column matrix has
+// num * length_col * height_col * width_col columns; volume n owns the
+// n-th block of length_col * height_col * width_col columns of every row.
+template <typename Dtype>
+void vol2col_batch_cpu(const Dtype* data_im, const int num, const int channels,
+    const int length, const int height, const int width, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, Dtype* data_col);
+
+template <typename Dtype>
+void col2vol_batch_cpu(const Dtype* data_col, const int num, const int channels,
+    const int length, const int height, const int width, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, Dtype* data_im);
+
 template <typename Dtype>
 void vol2col_gpu(const Dtype* data_im, const int channels, const int length,
 	    const int height, const int width, const int ksize, const int kdepth, const int pad,
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -146,6 +147,26 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::SwapData(Blob& other) {
+  CHECK_EQ(count_, other.count());
+  data_.swap(other.data_);
+  // capacity_ also bounds diff_, so it may only shrink to what the data_
+  // received in the exchange can hold; a later Reshape past it reallocates.
+  capacity_ = data_ ? std::min(capacity_,
+      static_cast<int>(data_->size() / sizeof(Dtype))) : 0;
+  other.capacity_ = other.data_ ? std::min(other.capacity_,
+      static_cast<int>(other.data_->size() / sizeof(Dtype))) : 0;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  data_ = memory;
+  capacity_ = std::min(capacity_,
+      static_cast<int>(data_->size() / sizeof(Dtype)));
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
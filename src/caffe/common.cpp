@@ -5,6 +5,7 @@
 #include <ctime>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -49,6 +50,26 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+size_t Caffe::host_memory_in_use() {
+  return HostMemoryPool::Get().in_use();
+}
+
+size_t Caffe::host_memory_cached() {
+  return HostMemoryPool::Get().cached();
+}
+
+size_t Caffe::host_memory_peak() {
+  return HostMemoryPool::Get().peak();
+}
+
+void Caffe::set_host_memory_cache_limit(size_t cache_limit) {
+  HostMemoryPool::Get().set_cache_limit(cache_limit);
+}
+
+void Caffe::set_host_huge_pages(bool huge_pages) {
+  HostMemoryPool::Get().set_huge_pages(huge_pages);
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
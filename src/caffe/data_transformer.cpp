@@ -782,6 +782,84 @@ void DataTransformer<Dtype>::TransformVariedSizeTwostreamDatum(const Datum& rgb_
     TransformVariedSizeTwostreamDatum(rgb_datum, flow_datum, transformed_rgb_data, transformed_flow_data);
 }
 
+/**
+ * @transform the channel planes of one two-stream sample. Rgb and flow planes
+ * share a single geometry (resize, crop, multi-scale rescale and mirror), so
+ * they are handled as one range of planes that OpenCV may split across cores.
+ */
+template<typename Dtype>
+class TwostreamPlaneTransform : public cv::ParallelLoopBody {
+public:
+    struct Plane {
+        const char* uint8_data;   // set for uint8 datums
+        const float* float_data;  // set for float datums
+        int height, width;
+        Dtype* top_data;
+        bool invert;              // x flow planes change sign when mirrored
+    };
+
+    TwostreamPlaneTransform(const vector<Plane>& planes, const vector<int>& top_cols,
+                            int new_height, int new_width, int height, int width,
+                            int h_off, int w_off, int crop_height, int crop_width,
+                            bool need_imgproc, Dtype mean_value, Dtype scale)
+        : planes_(planes), top_cols_(top_cols),
+          new_height_(new_height), new_width_(new_width), height_(height), width_(width),
+          h_off_(h_off), w_off_(w_off), crop_height_(crop_height), crop_width_(crop_width),
+          need_imgproc_(need_imgproc), mean_value_(mean_value), scale_(scale) {}
+
+    virtual void operator()(const cv::Range& range) const {
+        cv::Mat newM, multi_scale_bufferM;
+        for (int i = range.start; i < range.end; ++i) {
+            const Plane& plane = planes_[i];
+            // wrap the datum plane in place instead of copying it pixel by pixel
+            cv::Mat M = plane.uint8_data ?
+                cv::Mat(plane.height, plane.width, CV_8UC1, const_cast<char*>(plane.uint8_data)) :
+                cv::Mat(plane.height, plane.width, CV_32FC1, const_cast<float*>(plane.float_data));
+
+            // resize image to new_height and new_width
+            cv::resize(M, newM, cv::Size(new_width_, new_height_));
+
+            cv::Mat srcM;
+            if (need_imgproc_) {
+                // resize the cropped patch to network input size
+                cv::Mat cropM(newM, cv::Rect(w_off_, h_off_, crop_width_, crop_height_));
+                cv::resize(cropM, multi_scale_bufferM, cv::Size(width_, height_));
+                srcM = multi_scale_bufferM;
+            } else {
+                srcM = newM(cv::Rect(w_off_, h_off_, width_, height_));
+            }
+
+            if (plane.uint8_data) {
+                WritePlane<uint8_t>(srcM, plane);
+            } else {
+                WritePlane<float>(srcM, plane);
+            }
+        }
+    }
+
+private:
+    template<typename T>
+    void WritePlane(const cv::Mat& srcM, const Plane& plane) const {
+        // (255 - x - mean) * scale == (x - (255 - mean)) * -scale
+        const Dtype offset = plane.invert ? Dtype(255) - mean_value_ : mean_value_;
+        const Dtype scale = plane.invert ? -scale_ : scale_;
+        for (int h = 0; h < height_; ++h) {
+            const T* src_row = srcM.ptr<T>(h);
+            Dtype* top_row = plane.top_data + h * width_;
+            for (int w = 0; w < width_; ++w) {
+                top_row[top_cols_[w]] = (static_cast<Dtype>(src_row[w]) - offset) * scale;
+            }
+        }
+    }
+
+    const vector<Plane>& planes_;
+    const vector<int>& top_cols_;
+    const int new_height_, new_width_, height_, width_;
+    const int h_off_, w_off_, crop_height_, crop_width_;
+    const bool need_imgproc_;
+    const Dtype mean_value_, scale_;
+};
+
 template<typename Dtype>
 void DataTransformer<Dtype>::TransformVariedSizeTwostreamDatum(const Datum& rgb_datum, const Datum& flow_datum,
                                                                Dtype* transformed_rgb_data, Dtype* transformed_flow_data) {
@@ -797,13 +875,11 @@ void DataTransformer<Dtype>::TransformVariedSizeTwostreamDatum(const Datum& rgb_
     const bool has_uint8 = rgb_data.size() > 0;
     CHECK((rgb_data.size() > 0) == (flow_data.size() > 0))
             << "both rgb & flow database must have same type.";
-    const bool has_mean_values = mean_values_.size() > 0;
     const bool do_multi_scale = param_.multi_scale();
     const int new_height = param_.new_height();
     const int new_width = param_.new_width();
     vector<pair<int, int> > offset_pairs;
     vector<pair<int, int> > crop_size_pairs;
-    cv::Mat newM, multi_scale_bufferM;
 
     // mean values
     CHECK_EQ(mean_values_.size(), 1) << "twostream data processing"
@@ -859,158 +935,47 @@ void DataTransformer<Dtype>::TransformVariedSizeTwostreamDatum(const Datum& rgb_
     }
     need_imgproc = do_multi_scale && crop_size && ((crop_height != crop_size) || (crop_width != crop_size));
 
-    ///////////////////////////////////////////RGB_DATA///////////////////////////////////////////////////////////////
-
-    // rgb datum parameters
-    int datum_channels = rgb_datum.channels();
-    int datum_height = rgb_datum.height();
-    int datum_width = rgb_datum.width();
-
-    CHECK_GT(datum_channels, 0);
+    CHECK_GT(rgb_datum.channels(), 0);
+    CHECK_GT(flow_datum.channels(), 0);
     CHECK_GE(new_height, crop_size);
     CHECK_GE(new_width, crop_size);
 
-    // rgb processing
-    Dtype datum_element;
-    int top_index, data_index;
-    for (int c = 0; c < datum_channels; ++c) {
-
-        cv::Mat M(datum_height, datum_width, has_uint8?CV_8UC1:CV_32FC1);
-
-        // put the datum content to a cvMat
-        for (int h = 0; h < datum_height; ++h) {
-            for (int w = 0; w < datum_width; ++w) {
-                data_index = (c * datum_height + h) * datum_width + w;
-                if (has_uint8) {
-                    M.at<uchar>(h, w) = static_cast<uint8_t>(rgb_data[data_index]);
-                } else {
-                    M.at<float>(h, w) = rgb_datum.float_data(data_index);
-                }
-            }
-        }
-
-        // resize image to new_height and new_width
-        cv::resize(M, newM, cv::Size(new_width, new_height));
-
-        // crop resize etc needed
-        if (need_imgproc) {
-            // resize the cropped patch to network input size
-            cv::Mat cropM(newM, cv::Rect(w_off, h_off, crop_width, crop_height));
-            cv::resize(cropM, multi_scale_bufferM, cv::Size(crop_size, crop_size));
-        }
-
-        for (int h = 0; h < height; ++h) {
-            for (int w = 0; w < width; ++w) {
-                if (do_mirror) {
-                    top_index = (c * height + h) * width + (width - 1 - w);
-                } else {
-                    top_index = (c * height + h) * width + w;
-                }
-                if (need_imgproc) {
-                    if (has_uint8) {
-                        datum_element = static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-                    } else {
-                        datum_element = static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-                    }
-                } else {
-                    if (has_uint8) {
-                        datum_element = static_cast<Dtype>(newM.at<uint8_t>(h + h_off, w + w_off));
-                    } else {
-                        datum_element = static_cast<Dtype>(newM.at<float>(h + h_off, w + w_off));
-                    }
-                }
-
-                if (has_mean_values) {
-                    transformed_rgb_data[top_index] =
-                            (datum_element - mean_value) * scale;
-                } else {
-                    transformed_rgb_data[top_index] = datum_element * scale;
-                }
-
-            }
-        }
+    // output column of every cropped column, shared by all planes
+    vector<int> top_cols(width);
+    for (int w = 0; w < width; ++w) {
+        top_cols[w] = do_mirror ? (width - 1 - w) : w;
     }
 
-    ///////////////////////////////////////////FLOW_DATA///////////////////////////////////////////////////////////////
+    ///////////////////////////////////////////RGB + FLOW PLANES//////////////////////////////////////////////////////
 
-    // flow datum parameters
-    datum_channels = flow_datum.channels();
-    datum_height = flow_datum.height();
-    datum_width = flow_datum.width();
+    // the first half of the flow channels holds x displacements, which are
+    // inverted when the sample is mirrored
     const int temporal_length = flow_datum.channels() / 2;
-
-    CHECK_GT(datum_channels, 0);
-
-    // flow processing
-    for (int c = 0; c < datum_channels; ++c) {
-
-        cv::Mat M(datum_height, datum_width, has_uint8?CV_8UC1:CV_32FC1);
-
-        //put the datum content to a cvMat
-        for (int h = 0; h < datum_height; ++h) {
-            for (int w = 0; w < datum_width; ++w) {
-                data_index = (c * datum_height + h) * datum_width + w;
-                if (has_uint8) {
-                    M.at<uchar>(h, w) = static_cast<uint8_t>(flow_data[data_index]);
-                }else{
-                    M.at<float>(h, w) = flow_datum.float_data(data_index);
-                }
-            }
-        }
-
-        // resize image to new_height and new_width
-        cv::resize(M, newM, cv::Size(new_width, new_height));
-
-        // crop resize etc needed
-        if (need_imgproc){
-            //resize the cropped patch to network input size
-            cv::Mat cropM(newM, cv::Rect(w_off, h_off, crop_width, crop_height));
-            cv::resize(cropM, multi_scale_bufferM, cv::Size(crop_size, crop_size));
-        }
-
-        for (int h = 0; h < height; ++h) {
-            for (int w = 0; w < width; ++w) {
-                if (do_mirror) {
-                    top_index = (c * height + h) * width + (width - 1 - w);
-                } else {
-                    top_index = (c * height + h) * width + w;
-                }
-                if (need_imgproc) {
-                    if (has_uint8) {
-                        if (do_mirror && c < temporal_length)
-                            datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-                        else
-                            datum_element = static_cast<Dtype>(multi_scale_bufferM.at<uint8_t>(h, w));
-                    }else {
-                        if (do_mirror && c < temporal_length)
-                            datum_element = 255 - static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-                        else
-                            datum_element = static_cast<Dtype>(multi_scale_bufferM.at<float>(h, w));
-                    }
-                } else {
-                    if (has_uint8) {
-                        if (do_mirror && c < temporal_length)
-                            datum_element = 255 - static_cast<Dtype>(newM.at<uint8_t>(h + h_off, w + w_off));
-                        else
-                            datum_element = static_cast<Dtype>(newM.at<uint8_t>(h + h_off, w + w_off));
-                    } else {
-                        if (do_mirror && c < temporal_length)
-                            datum_element = 255 - static_cast<Dtype>(newM.at<float>(h + h_off, w + w_off));
-                        else
-                            datum_element = static_cast<Dtype>(newM.at<float>(h + h_off, w + w_off));
-                    }
-                }
-
-                if (has_mean_values) {
-                    transformed_flow_data[top_index] =
-                            (datum_element - mean_value) * scale;
-                } else {
-                    transformed_flow_data[top_index] = datum_element * scale;
-                }
-
-            }
+    typedef typename TwostreamPlaneTransform<Dtype>::Plane Plane;
+    vector<Plane> planes;
+    planes.reserve(rgb_datum.channels() + flow_datum.channels());
+    for (int s = 0; s < 2; ++s) {
+        const Datum& datum = s ? flow_datum : rgb_datum;
+        const string& data = s ? flow_data : rgb_data;
+        Dtype* transformed_data = s ? transformed_flow_data : transformed_rgb_data;
+        const int datum_size = datum.height() * datum.width();
+        for (int c = 0; c < datum.channels(); ++c) {
+            Plane plane;
+            plane.uint8_data = has_uint8 ? data.data() + c * datum_size : NULL;
+            plane.float_data = has_uint8 ? NULL : datum.float_data().data() + c * datum_size;
+            plane.height = datum.height();
+            plane.width = datum.width();
+            plane.top_data = transformed_data + c * height * width;
+            plane.invert = s && do_mirror && c < temporal_length;
+            planes.push_back(plane);
         }
     }
+
+    cv::parallel_for_(cv::Range(0, planes.size()),
+                      TwostreamPlaneTransform<Dtype>(planes, top_cols, new_height, new_width,
+                                                     height, width, h_off, w_off,
+                                                     crop_height, crop_width, need_imgproc,
+                                                     mean_value, scale));
 }
 
 template<typename Dtype>
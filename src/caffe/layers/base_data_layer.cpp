@@ -7,7 +7,9 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -32,36 +34,70 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   DataLayerSetUp(bottom, top);
 }
 
+template <typename Dtype>
+class BasePrefetchingDataLayer<Dtype>::LoaderSync {
+ public:
+  boost::mutex plan_mutex_;
+  boost::mutex release_mutex_;
+  boost::condition_variable release_condition_;
+};
+
 template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.prefetch_param().count()),
+      prefetch_free_(), prefetch_full_(),
+      prefetch_monitor_(param.prefetch_param(), param.name()),
+      prefetch_stalled_(false), prefetch_saturated_(false),
+      prefetch_wait_ms_(0), loader_workers_(1),
+      loader_sync_(new LoaderSync()),
+      loader_next_plan_(0), loader_next_release_(0) {
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Worker state must exist before DataLayerSetUp, which sizes the per-worker
+  // plans of layers that support multiple loaders.
+  loader_workers_ = this->layer_param_.prefetch_param().workers();
+  CHECK_GT(loader_workers_, 0) << "prefetch workers must be positive";
+  if (loader_workers_ > 1 && !SupportsLoaderWorkers()) {
+    LOG(WARNING) << this->type() << " layer " << this->layer_param_.name()
+        << " does not support multiple loader workers; using one.";
+    loader_workers_ = 1;
+  }
+  for (int w = 1; w < loader_workers_; ++w) {
+    loader_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+    loader_transformers_.back()->InitRand();
+    loader_transformed_data_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
+  for (int w = 0; w < loader_transformed_data_.size(); ++w) {
+    loader_transformed_data_[w]->ReshapeLike(transformed_data_);
+  }
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -72,8 +108,26 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   DLOG(INFO) << "Prefetch initialized.";
 }
 
+template <typename Dtype>
+DataTransformer<Dtype>* BasePrefetchingDataLayer<Dtype>::loader_transformer(
+    int worker_id) {
+  return worker_id == 0 ? this->data_transformer_.get() :
+      loader_transformers_[worker_id - 1].get();
+}
+
+template <typename Dtype>
+Blob<Dtype>* BasePrefetchingDataLayer<Dtype>::loader_transformed_data(
+    int worker_id) {
+  return worker_id == 0 ? &transformed_data_ :
+      loader_transformed_data_[worker_id - 1].get();
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
+  if (loader_workers_ > 1) {
+    RunLoaderWorkers();
+    return;
+  }
 #ifndef CPU_ONLY
   cudaStream_t stream;
   if (Caffe::mode() == Caffe::GPU) {
@@ -103,25 +157,157 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::RunLoaderWorkers() {
+  int device = 0;
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaGetDevice(&device));
+#endif
+  boost::thread_group workers;
+  for (int w = 0; w < loader_workers_; ++w) {
+    workers.add_thread(new boost::thread(
+        &BasePrefetchingDataLayer<Dtype>::LoaderWorkerEntry, this, w, device,
+        Caffe::mode(), caffe_rng_rand(), Caffe::solver_count(),
+        Caffe::root_solver()));
+  }
+  try {
+    workers.join_all();
+  } catch (boost::thread_interrupted&) {
+    // Shutdown was requested on this thread; pass it on to the workers.
+    workers.interrupt_all();
+    workers.join_all();
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::LoaderWorkerEntry(int worker_id,
+    int device, Caffe::Brew mode, int rand_seed, int solver_count,
+    bool root_solver) {
+  // Caffe's state is thread local; set it up as InternalThread does.
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  Caffe::set_mode(mode);
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_solver_count(solver_count);
+  Caffe::set_root_solver(root_solver);
+#ifndef CPU_ONLY
+  cudaStream_t stream;
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+  }
+#endif
+
+  try {
+    while (!boost::this_thread::interruption_requested()) {
+      Batch<Dtype>* batch;
+      int ticket;
+      {
+        // Claim batches and their samples in the order one loader would.
+        boost::mutex::scoped_lock lock(loader_sync_->plan_mutex_);
+        batch = prefetch_free_.pop("Waiting for free prefetch batch");
+        ticket = loader_next_plan_++;
+        plan_batch(worker_id);
+      }
+      fill_batch(batch, worker_id);
+#ifndef CPU_ONLY
+      if (Caffe::mode() == Caffe::GPU) {
+        batch->data_.data().get()->async_gpu_push(stream);
+        CUDA_CHECK(cudaStreamSynchronize(stream));
+      }
+#endif
+      {
+        // Release batches to the net in the order they were claimed.
+        boost::mutex::scoped_lock lock(loader_sync_->release_mutex_);
+        while (loader_next_release_ != ticket) {
+          loader_sync_->release_condition_.wait(lock);
+        }
+        prefetch_full_.push(batch);
+        ++loader_next_release_;
+      }
+      loader_sync_->release_condition_.notify_all();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaStreamDestroy(stream));
+  }
+#endif
+}
+
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopFullBatch() {
+  CPUTimer timer;
+  prefetch_stalled_ = prefetch_full_.size() == 0;
+  timer.Start();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  prefetch_wait_ms_ = prefetch_stalled_ ? timer.MilliSeconds() : 0;
+  // The loader is idle if every other batch is already waiting to be used.
+  prefetch_saturated_ = prefetch_full_.size() + 1 == prefetch_.size();
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::RecycleBatch(Batch<Dtype>* batch) {
+  size_t batch_bytes = batch->data_.count() * sizeof(Dtype);
+  if (this->output_labels_) {
+    batch_bytes += batch->label_.count() * sizeof(Dtype);
+  }
+  const int delta = prefetch_monitor_.Update(prefetch_stalled_,
+      prefetch_wait_ms_, prefetch_saturated_, prefetch_.size(), batch_bytes);
+  if (delta < 0) {
+    // Retire the batch; it is owned by this thread until pushed back.
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      if (prefetch_[i].get() == batch) {
+        prefetch_.erase(prefetch_.begin() + i);
+        return;
+      }
+    }
+    LOG(FATAL) << "Recycled batch does not belong to this layer";
+  }
+  if (delta > 0) {
+    shared_ptr<Batch<Dtype> > extra(new Batch<Dtype>());
+    extra->data_.ReshapeLike(batch->data_);
+    extra->data_.mutable_cpu_data();
+    if (this->output_labels_) {
+      extra->label_.ReshapeLike(batch->label_);
+      extra->label_.mutable_cpu_data();
+    }
+#ifndef CPU_ONLY
+    if (Caffe::mode() == Caffe::GPU) {
+      extra->data_.mutable_gpu_data();
+      if (this->output_labels_) {
+        extra->label_.mutable_gpu_data();
+      }
+    }
+#endif
+    prefetch_.push_back(extra);
+    prefetch_free_.push(extra.get());
+  }
+  prefetch_free_.push(batch);
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
-             top[0]->mutable_cpu_data());
-  DLOG(INFO) << "Prefetch copied";
+  // Hand the loaded data to the top without a copy. The top's previous
+  // buffer goes back to the free queue with the batch and is overwritten by
+  // the next load_batch, so in-place layers writing to the top are safe.
+  top[0]->SwapData(batch->data_);
+  DLOG(INFO) << "Prefetch swapped";
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-        top[1]->mutable_cpu_data());
+    // Swap the labels.
+    top[1]->SwapData(batch->label_);
   }
 
-  prefetch_free_.push(batch);
+  RecycleBatch(batch);
 }
 
 #ifdef CPU_ONLY
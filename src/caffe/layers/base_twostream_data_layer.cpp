@@ -7,6 +7,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_twostream_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -36,9 +37,14 @@ template <typename Dtype>
 BasePrefetchingTwostreamDataLayer<Dtype>::BasePrefetchingTwostreamDataLayer(
         const LayerParameter& param)
     : BaseTwostreamDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-        prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.prefetch_param().count()),
+      prefetch_free_(), prefetch_full_(),
+      prefetch_monitor_(param.prefetch_param(), param.name()),
+      prefetch_stalled_(false), prefetch_saturated_(false),
+      prefetch_wait_ms_(0) {
+    for (int i = 0; i < prefetch_.size(); ++i) {
+        prefetch_[i].reset(new TwostreamBatch<Dtype>());
+        prefetch_free_.push(prefetch_[i].get());
     }
 }
 
@@ -50,20 +56,20 @@ void BasePrefetchingTwostreamDataLayer<Dtype>::LayerSetUp(
     // calls so that the prefetch thread does not accidentally make simultaneous
     // cudaMalloc calls when the main thread is running. In some GPUs this
     // seems to cause failures if we do not so.
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-        prefetch_[i].rgb_data_.mutable_cpu_data();
-        prefetch_[i].flow_data_.mutable_cpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+        prefetch_[i]->rgb_data_.mutable_cpu_data();
+        prefetch_[i]->flow_data_.mutable_cpu_data();
         if (this->output_labels_) {
-            prefetch_[i].label_.mutable_cpu_data();
+            prefetch_[i]->label_.mutable_cpu_data();
         }
     }
 #ifndef CPU_ONLY
     if (Caffe::mode() == Caffe::GPU) {
-        for (int i = 0; i < PREFETCH_COUNT; ++i) {
-            prefetch_[i].rgb_data_.mutable_gpu_data();
-            prefetch_[i].flow_data_.mutable_gpu_data();
+        for (int i = 0; i < prefetch_.size(); ++i) {
+            prefetch_[i]->rgb_data_.mutable_gpu_data();
+            prefetch_[i]->flow_data_.mutable_gpu_data();
             if (this->output_labels_) {
-                prefetch_[i].label_.mutable_gpu_data();
+                prefetch_[i]->label_.mutable_gpu_data();
             }
         }
     }
@@ -106,28 +112,83 @@ void BasePrefetchingTwostreamDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+TwostreamBatch<Dtype>* BasePrefetchingTwostreamDataLayer<Dtype>::PopFullBatch() {
+    CPUTimer timer;
+    prefetch_stalled_ = prefetch_full_.size() == 0;
+    timer.Start();
+    TwostreamBatch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+    prefetch_wait_ms_ = prefetch_stalled_ ? timer.MilliSeconds() : 0;
+    // The loader is idle if every other batch is already waiting to be used.
+    prefetch_saturated_ = prefetch_full_.size() + 1 == prefetch_.size();
+    return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingTwostreamDataLayer<Dtype>::RecycleBatch(
+        TwostreamBatch<Dtype>* batch) {
+    size_t batch_bytes = (batch->rgb_data_.count() + batch->flow_data_.count())
+            * sizeof(Dtype);
+    if (this->output_labels_) {
+        batch_bytes += batch->label_.count() * sizeof(Dtype);
+    }
+    const int delta = prefetch_monitor_.Update(prefetch_stalled_,
+            prefetch_wait_ms_, prefetch_saturated_, prefetch_.size(), batch_bytes);
+    if (delta < 0) {
+        // Retire the batch; it is owned by this thread until pushed back.
+        for (int i = 0; i < prefetch_.size(); ++i) {
+            if (prefetch_[i].get() == batch) {
+                prefetch_.erase(prefetch_.begin() + i);
+                return;
+            }
+        }
+        LOG(FATAL) << "Recycled batch does not belong to this layer";
+    }
+    if (delta > 0) {
+        shared_ptr<TwostreamBatch<Dtype> > extra(new TwostreamBatch<Dtype>());
+        extra->rgb_data_.ReshapeLike(batch->rgb_data_);
+        extra->flow_data_.ReshapeLike(batch->flow_data_);
+        extra->rgb_data_.mutable_cpu_data();
+        extra->flow_data_.mutable_cpu_data();
+        if (this->output_labels_) {
+            extra->label_.ReshapeLike(batch->label_);
+            extra->label_.mutable_cpu_data();
+        }
+#ifndef CPU_ONLY
+        if (Caffe::mode() == Caffe::GPU) {
+            extra->rgb_data_.mutable_gpu_data();
+            extra->flow_data_.mutable_gpu_data();
+            if (this->output_labels_) {
+                extra->label_.mutable_gpu_data();
+            }
+        }
+#endif
+        prefetch_.push_back(extra);
+        prefetch_free_.push(extra.get());
+    }
+    prefetch_free_.push(batch);
+}
+
 template <typename Dtype>
 void BasePrefetchingTwostreamDataLayer<Dtype>::Forward_cpu(
         const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    TwostreamBatch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+    TwostreamBatch<Dtype>* batch = PopFullBatch();
     // Reshape to loaded data.
     top[0]->ReshapeLike(batch->rgb_data_);
     top[1]->ReshapeLike(batch->flow_data_);
-    // Copy the data
-    caffe_copy(batch->rgb_data_.count(), batch->rgb_data_.cpu_data(),
-               top[0]->mutable_cpu_data());
-    caffe_copy(batch->flow_data_.count(), batch->flow_data_.cpu_data(),
-               top[1]->mutable_cpu_data());
-    DLOG(INFO) << "Prefetch copied";
+    // Hand the loaded data to the tops without a copy; the tops' previous
+    // buffers are recycled with the batch and refilled by load_batch.
+    top[0]->SwapData(batch->rgb_data_);
+    top[1]->SwapData(batch->flow_data_);
+    DLOG(INFO) << "Prefetch swapped";
     if (this->output_labels_) {
         // Reshape to loaded labels.
         top[2]->ReshapeLike(batch->label_);
-        // Copy the labels.
-        caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-                   top[2]->mutable_cpu_data());
+        // Swap the labels.
+        top[2]->SwapData(batch->label_);
     }
 
-    prefetch_free_.push(batch);
+    RecycleBatch(batch);
 }
 
 #ifdef CPU_ONLY
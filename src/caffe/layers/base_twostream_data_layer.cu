@@ -7,7 +7,7 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingTwostreamDataLayer<Dtype>::Forward_gpu(
         const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-    TwostreamBatch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+    TwostreamBatch<Dtype>* batch = PopFullBatch();
     // Reshape to loaded data.
     top[0]->ReshapeLike(batch->rgb_data_);
     top[1]->ReshapeLike(batch->flow_data_);
@@ -26,7 +26,7 @@ void BasePrefetchingTwostreamDataLayer<Dtype>::Forward_gpu(
     // Ensure the copy is synchronous wrt the host, so that the next batch isn't
     // copied in meanwhile.
     CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
-    prefetch_free_.push(batch);
+    RecycleBatch(batch);
 }
 
 INSTANTIATE_LAYER_GPU_FORWARD(BasePrefetchingTwostreamDataLayer);
@@ -1,8 +1,10 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/bn_layer.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -10,6 +12,7 @@ template <typename Dtype>
 void BNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   frozen_ = this->layer_param_.bn_param().frozen();
+  invert_top_ = this->layer_param_.bn_param().invert_top();
   bn_momentum_ = this->layer_param_.bn_param().momentum();
   bn_eps_ = this->layer_param_.bn_param().eps();
   // Initialize parameters
@@ -19,7 +22,8 @@ void BNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     this->blobs_.resize(4);
     vector<int> shape;
     shape.push_back(1);
-    shape.push_back(bottom[0]->channels());
+    shape.push_back(bottom[0]->shape(
+        this->layer_param_.bn_param().layout() == NDHWC ? -1 : 1));
     // slope
     this->blobs_[0].reset(new Blob<Dtype>(shape));
     shared_ptr<Filler<Dtype> > slope_filler(GetFiller<Dtype>(
@@ -66,271 +70,401 @@ void BNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  num_ = bottom[0]->num();
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  if (this->layer_param_.bn_param().layout() == NDHWC) {
+    // Every position of a channels-last blob is one row of channels_
+    // values, so the rows play the part of the samples.
+    CHECK_EQ(5, bottom[0]->num_axes()) << "NDHWC input must have 5 axes.";
+    channels_ = bottom[0]->shape(-1);
+    num_ = bottom[0]->count() / channels_;
+    spatial_dim_ = 1;
+  } else {
+    // Any number of spatial axes; Blob::num() and friends take at most 4.
+    num_ = bottom[0]->shape(0);
+    channels_ = bottom[0]->shape(1);
+    spatial_dim_ = bottom[0]->count(2);
+  }
 
   top[0]->ReshapeLike(*(bottom[0]));
 
-  broadcast_buffer_.ReshapeLike(*(bottom[0]));
-  spatial_statistic_.Reshape(num_, channels_, 1, 1);
+  // The CPU passes only keep per-channel statistics. The buffers as large
+  // as the bottom, and those of the GPU passes, are shaped by the passes
+  // that need them, so that they stay unallocated otherwise.
   batch_statistic_.Reshape(1, channels_, 1, 1);
-
-  x_norm_.ReshapeLike(*(bottom[0]));
+  x_mean_.ReshapeLike(batch_statistic_);
   x_inv_std_.ReshapeLike(batch_statistic_);
+}
+
+// The CPU passes view the bottom as num_ x channels_ x spatial_dim_ and
+// run over every channel independently: one pass gathers the statistics of
+// a channel, a second one normalizes, scales and shifts it in a single
+// sweep. Channels-last blobs, where spatial_dim_ is 1, are instead swept
+// row by row, every row updating all channels from per-channel arrays, so
+// that they are read contiguously. Backward recomputes the normalized input
+// instead of keeping it around: from the bottom and the saved mean and
+// inverse std, or, when the layer runs in place with invert_top, from the
+// top as (y - shift) / scale. Otherwise, in place, and for channels with a
+// zero scale, which cannot be inverted, the normalized input is saved in
+// x_norm_, but only when Forward uses the batch statistics.
+
+// Mean and variance of a channel in a single pass: Welford's algorithm
+// reduces the contiguous spatial row of every sample, and Chan et al.'s
+// parallel update merges the rows in order.
+template <typename Dtype>
+static void bn_channel_statistics(const Dtype* data, const int num,
+    const int channels, const int spatial_dim, Dtype* mean, Dtype* variance) {
+  Dtype running_mean = 0, running_m2 = 0;
+  for (int n = 0; n < num; ++n) {
+    const Dtype* row = data + n * channels * spatial_dim;
+    Dtype row_mean = 0, row_m2 = 0;
+    for (int i = 0; i < spatial_dim; ++i) {
+      const Dtype delta = row[i] - row_mean;
+      row_mean += delta / (i + 1);
+      row_m2 += delta * (row[i] - row_mean);
+    }
+    // merge n rows so far with one more
+    const Dtype delta = row_mean - running_mean;
+    running_mean += delta / (n + 1);
+    running_m2 += row_m2 + delta * delta * spatial_dim * n / (n + 1);
+  }
+  *mean = running_mean;
+  *variance = running_m2 / (num * spatial_dim);
+}
 
-  spatial_sum_multiplier_.Reshape(1, 1, height_, width_);
-  caffe_set(spatial_sum_multiplier_.count(), Dtype(1),
-      spatial_sum_multiplier_.mutable_cpu_data());
-  batch_sum_multiplier_.Reshape(num_, 1, 1, 1);
-  caffe_set(batch_sum_multiplier_.count(), Dtype(1),
-      batch_sum_multiplier_.mutable_cpu_data());
+// The number of chunks the rows of a channels-last blob are split into
+// for their statistics, independent of the number of threads.
+static const int kRowStatisticsChunks = 64;
+
+// Mean and variance of all the channels of num rows of channels values at
+// once, as channels-last blobs hold them, in a single pass: every chunk of
+// rows is reduced by Welford's algorithm into per-channel statistics, then
+// the chunks are merged in order, so that the result does not depend on
+// which thread reduced which chunk.
+template <typename Dtype>
+static void bn_row_statistics(const Dtype* data, const int num,
+    const int channels, Dtype* mean, Dtype* variance) {
+  const int num_chunks = std::min(num, kRowStatisticsChunks);
+  vector<int> chunk_begin(num_chunks + 1);
+  for (int k = 0; k <= num_chunks; ++k) {
+    chunk_begin[k] = static_cast<int64_t>(num) * k / num_chunks;
+  }
+  vector<Dtype> chunk_mean(num_chunks * channels, Dtype(0));
+  vector<Dtype> chunk_m2(num_chunks * channels, Dtype(0));
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int k = 0; k < num_chunks; ++k) {
+    Dtype* m = &chunk_mean[k * channels];
+    Dtype* m2 = &chunk_m2[k * channels];
+    for (int n = chunk_begin[k]; n < chunk_begin[k + 1]; ++n) {
+      const Dtype* row = data + n * channels;
+      const Dtype inv_count = Dtype(1) / (n - chunk_begin[k] + 1);
+      for (int c = 0; c < channels; ++c) {
+        const Dtype delta = row[c] - m[c];
+        m[c] += delta * inv_count;
+        m2[c] += delta * (row[c] - m[c]);
+      }
+    }
+  }
+  // merge the chunks by Chan et al.'s parallel update
+  caffe_copy(channels, &chunk_mean[0], mean);
+  caffe_copy(channels, &chunk_m2[0], variance);
+  for (int k = 1; k < num_chunks; ++k) {
+    const Dtype count = chunk_begin[k];
+    const Dtype chunk_count = chunk_begin[k + 1] - chunk_begin[k];
+    const Dtype weight = chunk_count / (count + chunk_count);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype delta = chunk_mean[k * channels + c] - mean[c];
+      mean[c] += delta * weight;
+      variance[c] += chunk_m2[k * channels + c]
+          + delta * delta * count * weight;
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    variance[c] /= num;
+  }
 }
 
 template <typename Dtype>
 void BNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const vector<Blob<Dtype>*>& top) {
-  const Dtype* const_bottom_data = bottom[0]->cpu_data();
-  const Dtype* const_top_data = top[0]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-
   const Dtype* scale_data = this->blobs_[0]->cpu_data();
   const Dtype* shift_data = this->blobs_[1]->cpu_data();
-
-  // Mean normalization
-  if (frozen_ || this->phase_ == TEST) {
-    // Use the moving average mean
-    caffe_copy(batch_statistic_.count(), this->blobs_[2]->cpu_data(),
-        batch_statistic_.mutable_cpu_data());
-  } else {
-    // Compute the mean by averaging over spatial and batch dimensions.
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1) / (height_ * width_), const_bottom_data,
-        spatial_sum_multiplier_.cpu_data(), Dtype(0),
-        spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_,
-        Dtype(1) / num_, spatial_statistic_.cpu_data(),
-        batch_sum_multiplier_.cpu_data(), Dtype(0),
-        batch_statistic_.mutable_cpu_data());
-    // Add to the moving average
-    if (!frozen_) {
-      caffe_cpu_axpby(batch_statistic_.count(),
-          Dtype(1) - bn_momentum_, batch_statistic_.cpu_data(),
-          bn_momentum_, this->blobs_[2]->mutable_cpu_data());
+  const bool use_global_stats = frozen_ || this->phase_ == TEST;
+  const bool channels_last =
+      this->layer_param_.bn_param().layout() == NDHWC;
+  Dtype* moving_mean = this->blobs_[2]->mutable_cpu_data();
+  Dtype* moving_variance = this->blobs_[3]->mutable_cpu_data();
+  Dtype* x_mean = x_mean_.mutable_cpu_data();
+  Dtype* x_inv_std = x_inv_std_.mutable_cpu_data();
+  const bool in_place = bottom[0] == top[0];
+  const int dim = channels_ * spatial_dim_;
+  // x_norm_ is only allocated if some channel needs it for Backward, which
+  // with the global statistics does not look at the input
+  Dtype* x_norm = NULL;
+  if (in_place && !use_global_stats) {
+    for (int c = 0; c < channels_ && !x_norm; ++c) {
+      if (!invert_top_ || scale_data[c] == 0) {
+        x_norm_.ReshapeLike(*bottom[0]);
+        x_norm = x_norm_.mutable_cpu_data();
+      }
     }
   }
-  // Broadcast the mean vector
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-      Dtype(1), batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(),
-      Dtype(0), spatial_statistic_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(-1),
-      spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-      Dtype(0), broadcast_buffer_.mutable_cpu_data());
-  // Subtract
-  caffe_add(broadcast_buffer_.count(), const_bottom_data,
-      broadcast_buffer_.cpu_data(), top_data);
-
-  // Variance normalization
-  if (frozen_ || this->phase_ == TEST) {
-    // Use the moving average variance
-    caffe_copy(batch_statistic_.count(), this->blobs_[3]->cpu_data(),
-        batch_statistic_.mutable_cpu_data());
-  } else {
-    // calculate batch variance
-    caffe_powx(broadcast_buffer_.count(), const_top_data, Dtype(2),
-        broadcast_buffer_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1) / (height_ * width_), broadcast_buffer_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), Dtype(0),
-        spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1) / num_,
-        spatial_statistic_.cpu_data(), batch_sum_multiplier_.cpu_data(),
-        Dtype(0), batch_statistic_.mutable_cpu_data());
-
-    // Add to the moving average
-    caffe_cpu_axpby(batch_statistic_.count(),
-        Dtype(1) - bn_momentum_, batch_statistic_.cpu_data(),
-        bn_momentum_, this->blobs_[3]->mutable_cpu_data());
+  // the mean and variance of the rows, held in the buffers of the saved
+  // statistics until they are read
+  if (channels_last && !use_global_stats) {
+    bn_row_statistics(bottom_data, num_, channels_, x_mean, x_inv_std);
   }
+  // y = (x - mean) * inv_std * scale + shift = x * a + b
+  vector<Dtype> a(channels_), b(channels_);
 
-  // Add eps
-  caffe_add_scalar(batch_statistic_.count(), bn_eps_,
-                   batch_statistic_.mutable_cpu_data());
-  // Inverse standard deviation
-  caffe_powx(batch_statistic_.count(), batch_statistic_.cpu_data(),
-             Dtype(-0.5), batch_statistic_.mutable_cpu_data());
-
-  // Broadcast the inverse std
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-        Dtype(1), batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
-      spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-      Dtype(0), broadcast_buffer_.mutable_cpu_data());
-  // Multiply with the inverse std
-  caffe_mul(broadcast_buffer_.count(), const_top_data,
-      broadcast_buffer_.cpu_data(), top_data);
-
-  // Save the normalized inputs and std for backprop
-  if (!frozen_) {
-    caffe_copy(broadcast_buffer_.count(), const_top_data,
-        x_norm_.mutable_cpu_data());
-    caffe_copy(batch_statistic_.count(), batch_statistic_.cpu_data(),
-        x_inv_std_.mutable_cpu_data());
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    Dtype mean, variance;
+    if (use_global_stats) {
+      mean = moving_mean[c];
+      variance = moving_variance[c];
+    } else {
+      if (channels_last) {
+        mean = x_mean[c];
+        variance = x_inv_std[c];
+      } else {
+        bn_channel_statistics(bottom_data + c * spatial_dim_, num_,
+            channels_, spatial_dim_, &mean, &variance);
+      }
+      // Add to the moving averages
+      moving_mean[c] = (Dtype(1) - bn_momentum_) * mean
+          + bn_momentum_ * moving_mean[c];
+      moving_variance[c] = (Dtype(1) - bn_momentum_) * variance
+          + bn_momentum_ * moving_variance[c];
+    }
+    const Dtype inv_std = Dtype(1) / std::sqrt(variance + bn_eps_);
+    // Save the statistics for backprop
+    x_mean[c] = mean;
+    x_inv_std[c] = inv_std;
+    const Dtype channel_a = inv_std * scale_data[c];
+    const Dtype channel_b = shift_data[c] - mean * channel_a;
+    if (channels_last) {
+      a[c] = channel_a;
+      b[c] = channel_b;
+      continue;
+    }
+    for (int n = 0; n < num_; ++n) {
+      const int offset = n * dim + c * spatial_dim_;
+      const Dtype* x = bottom_data + offset;
+      Dtype* y = top_data + offset;
+      if (x_norm && (!invert_top_ || scale_data[c] == 0)) {
+        for (int i = 0; i < spatial_dim_; ++i) {
+          x_norm[offset + i] = (x[i] - mean) * inv_std;
+        }
+      }
+      for (int i = 0; i < spatial_dim_; ++i) {
+        y[i] = x[i] * channel_a + channel_b;
+      }
+    }
   }
 
-  // Scale
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-      Dtype(1), batch_sum_multiplier_.cpu_data(), scale_data,
-      Dtype(0), spatial_statistic_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
-      spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-      Dtype(0), broadcast_buffer_.mutable_cpu_data());
-  caffe_mul(broadcast_buffer_.count(), const_top_data,
-      broadcast_buffer_.cpu_data(), top_data);
-
-  // Shift
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-      Dtype(1), batch_sum_multiplier_.cpu_data(), shift_data,
-      Dtype(0), spatial_statistic_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
-      spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-      Dtype(0), broadcast_buffer_.mutable_cpu_data());
-  caffe_add(broadcast_buffer_.count(), const_top_data,
-      broadcast_buffer_.cpu_data(), top_data);
+  if (channels_last) {
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int n = 0; n < num_; ++n) {
+      const Dtype* x = bottom_data + n * channels_;
+      Dtype* y = top_data + n * channels_;
+      // x_norm_ is filled for all channels; Backward only reads the ones
+      // it needs
+      if (x_norm) {
+        for (int c = 0; c < channels_; ++c) {
+          x_norm[n * channels_ + c] = (x[c] - x_mean[c]) * x_inv_std[c];
+        }
+      }
+      for (int c = 0; c < channels_; ++c) {
+        y[c] = x[c] * a[c] + b[c];
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void BNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (frozen_) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* scale_data = this->blobs_[0]->cpu_data();
+  const bool channels_last =
+      this->layer_param_.bn_param().layout() == NDHWC;
+  const int dim = channels_ * spatial_dim_;
+
+  // With the global statistics of frozen layers and of TEST, the output is
+  // an affine function of the input, whose gradient is the scale over the
+  // moving std.
+  if (frozen_ || this->phase_ == TEST) {
     if (propagate_down[0]) {
-      const Dtype* const_top_diff = top[0]->cpu_diff();
       Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-      // Use the moving average variance
-      caffe_copy(batch_statistic_.count(), this->blobs_[3]->cpu_data(),
-          batch_statistic_.mutable_cpu_data());
-      caffe_add_scalar(batch_statistic_.count(), bn_eps_,
-          batch_statistic_.mutable_cpu_data());
-      caffe_powx(batch_statistic_.count(), batch_statistic_.cpu_data(),
-          Dtype(-0.5), batch_statistic_.mutable_cpu_data());
-      // Divide slope with std
-      caffe_mul(batch_statistic_.count(), this->blobs_[0]->cpu_data(),
-          batch_statistic_.cpu_data(), batch_statistic_.mutable_cpu_data());
-      // Broadcast
-      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-          Dtype(1), batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(),
-          Dtype(0), spatial_statistic_.mutable_cpu_data());
-      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-          height_ * width_, 1, Dtype(1),
-          spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-          Dtype(0), broadcast_buffer_.mutable_cpu_data());
+      const Dtype* moving_variance = this->blobs_[3]->cpu_data();
       // Elementwise multiply top grad with (slope / std)
-      caffe_mul(broadcast_buffer_.count(), const_top_diff,
-          broadcast_buffer_.cpu_data(), bottom_diff);
+      vector<Dtype> a(channels_);
+      for (int c = 0; c < channels_; ++c) {
+        a[c] = scale_data[c] / std::sqrt(moving_variance[c] + bn_eps_);
+      }
+      if (channels_last) {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int n = 0; n < num_; ++n) {
+          const Dtype* dy = top_diff + n * channels_;
+          Dtype* dx = bottom_diff + n * channels_;
+          for (int c = 0; c < channels_; ++c) {
+            dx[c] = dy[c] * a[c];
+          }
+        }
+        return;
+      }
+#ifdef _OPENMP
+      #pragma omp parallel for
+#endif
+      for (int c = 0; c < channels_; ++c) {
+        for (int n = 0; n < num_; ++n) {
+          const Dtype* dy = top_diff + n * dim + c * spatial_dim_;
+          Dtype* dx = bottom_diff + n * dim + c * spatial_dim_;
+          const Dtype channel_a = a[c];
+          for (int i = 0; i < spatial_dim_; ++i) {
+            dx[i] = dy[i] * channel_a;
+          }
+        }
+      }
     }
     return;
   }
 
-  // gradient w.r.t. slope
-  if (this->param_propagate_down_[0]) {
-    const Dtype* const_top_diff = top[0]->cpu_diff();
-    Dtype* scale_diff = this->blobs_[0]->mutable_cpu_diff();
-    caffe_mul(broadcast_buffer_.count(), x_norm_.cpu_data(), const_top_diff,
-        broadcast_buffer_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1), broadcast_buffer_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), Dtype(0),
-        spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
-        spatial_statistic_.cpu_data(), batch_sum_multiplier_.cpu_data(),
-        Dtype(1), scale_diff);
+  // x_hat = (x - x_offset) * x_scale, from the bottom or, in place, from
+  // x_norm_ or with invert_top_ from the top
+  const bool in_place = bottom[0] == top[0];
+  const Dtype* shift_data = this->blobs_[1]->cpu_data();
+  const Dtype* x_mean = x_mean_.cpu_data();
+  const Dtype* x_inv_std = x_inv_std_.cpu_data();
+  Dtype* scale_diff = this->param_propagate_down_[0] ?
+      this->blobs_[0]->mutable_cpu_diff() : NULL;
+  Dtype* shift_diff = this->param_propagate_down_[1] ?
+      this->blobs_[1]->mutable_cpu_diff() : NULL;
+  Dtype* bottom_diff = propagate_down[0] ?
+      bottom[0]->mutable_cpu_diff() : NULL;
+  const Dtype m = num_ * spatial_dim_;
+  vector<const Dtype*> x_data(channels_, bottom_data);
+  vector<Dtype> x_offset(x_mean, x_mean + channels_);
+  vector<Dtype> x_scale(x_inv_std, x_inv_std + channels_);
+  for (int c = 0; c < channels_; ++c) {
+    if (in_place && (!invert_top_ || scale_data[c] == 0)) {
+      x_data[c] = x_norm_.cpu_data();
+      x_offset[c] = 0;
+      x_scale[c] = 1;
+    } else if (in_place) {
+      x_offset[c] = shift_data[c];
+      x_scale[c] = Dtype(1) / scale_data[c];
+    }
   }
-
-  // gradient w.r.t. bias
-  if (this->param_propagate_down_[1]) {
-    const Dtype* const_top_diff = top[0]->cpu_diff();
-    Dtype* shift_diff = this->blobs_[1]->mutable_cpu_diff();
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1), const_top_diff, spatial_sum_multiplier_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
-        spatial_statistic_.cpu_data(), batch_sum_multiplier_.cpu_data(),
-        Dtype(1), shift_diff);
+  // sums of dl/dy and of x_hat * dl/dy over every channel, and from them
+  // dx = slope * inv_std * (dy - mean(dy) - x_hat * mean(dy * x_hat))
+  //    = a * (dy - mean_dy - (x - x_offset) * k)
+  vector<Dtype> sum_dy(channels_, Dtype(0));
+  vector<Dtype> sum_dy_x_hat(channels_, Dtype(0));
+  vector<Dtype> a(channels_), mean_dy(channels_), k(channels_);
+
+  if (channels_last) {
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+      vector<Dtype> thread_dy(channels_, Dtype(0));
+      vector<Dtype> thread_dy_x(channels_, Dtype(0));
+#ifdef _OPENMP
+      #pragma omp for
+#endif
+      for (int n = 0; n < num_; ++n) {
+        const Dtype* dy = top_diff + n * channels_;
+        for (int c = 0; c < channels_; ++c) {
+          thread_dy[c] += dy[c];
+          thread_dy_x[c] += dy[c]
+              * (x_data[c][n * channels_ + c] - x_offset[c]);
+        }
+      }
+#ifdef _OPENMP
+      #pragma omp critical
+#endif
+      for (int c = 0; c < channels_; ++c) {
+        sum_dy[c] += thread_dy[c];
+        sum_dy_x_hat[c] += thread_dy_x[c];
+      }
+    }
+  } else {
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int c = 0; c < channels_; ++c) {
+      const Dtype offset = x_offset[c];
+      Dtype channel_dy = 0, channel_dy_x = 0;
+      for (int n = 0; n < num_; ++n) {
+        const Dtype* x = x_data[c] + n * dim + c * spatial_dim_;
+        const Dtype* dy = top_diff + n * dim + c * spatial_dim_;
+        for (int i = 0; i < spatial_dim_; ++i) {
+          channel_dy += dy[i];
+          channel_dy_x += dy[i] * (x[i] - offset);
+        }
+      }
+      sum_dy[c] = channel_dy;
+      sum_dy_x_hat[c] = channel_dy_x;
+    }
+  }
+  for (int c = 0; c < channels_; ++c) {
+    sum_dy_x_hat[c] *= x_scale[c];
+    // gradient w.r.t. slope and bias
+    if (scale_diff) {
+      scale_diff[c] += sum_dy_x_hat[c];
+    }
+    if (shift_diff) {
+      shift_diff[c] += sum_dy[c];
+    }
+    a[c] = scale_data[c] * x_inv_std[c];
+    mean_dy[c] = sum_dy[c] / m;
+    k[c] = sum_dy_x_hat[c] / m * x_scale[c];
+  }
+  if (!bottom_diff) {
+    return;
   }
 
-  // gradient w.r.t. normalized inputs
-  if (propagate_down[0]) {
-    const Dtype* const_top_diff = top[0]->cpu_diff();
-    const Dtype* const_bottom_diff = bottom[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const Dtype* scale_data = this->blobs_[0]->cpu_data();
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-        Dtype(1), batch_sum_multiplier_.cpu_data(), scale_data,
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1), spatial_statistic_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), Dtype(0),
-        broadcast_buffer_.mutable_cpu_data());
-    caffe_mul(broadcast_buffer_.count(), const_top_diff,
-        broadcast_buffer_.cpu_data(), broadcast_buffer_.mutable_cpu_data());
-
-    // sum of x_hat * (dl / dx_hat)
-    caffe_mul(broadcast_buffer_.count(), x_norm_.cpu_data(),
-        broadcast_buffer_.cpu_data(), bottom_diff);
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1), const_bottom_diff, spatial_sum_multiplier_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
-        spatial_statistic_.cpu_data(), batch_sum_multiplier_.cpu_data(),
-        Dtype(0), batch_statistic_.mutable_cpu_data());
-
-    // x_hat times the sum
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-        Dtype(1), batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
-        spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-        Dtype(0), bottom_diff);
-    caffe_mul(broadcast_buffer_.count(), x_norm_.cpu_data(),
-        const_bottom_diff, bottom_diff);
-
-    // Subtract the average of x_hat times the sum
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1), broadcast_buffer_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), Dtype(0),
-        spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
-        spatial_statistic_.cpu_data(), batch_sum_multiplier_.cpu_data(),
-        Dtype(0), batch_statistic_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-        Dtype(1), batch_sum_multiplier_.cpu_data(), batch_statistic_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
-        spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-        Dtype(1), bottom_diff);
-    caffe_cpu_axpby(broadcast_buffer_.count(), Dtype(1),
-        broadcast_buffer_.cpu_data(), Dtype(-1) / (num_ * height_ * width_),
-        bottom_diff);
-
-    // Multiply with the inverse std
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, channels_, 1,
-        Dtype(1), batch_sum_multiplier_.cpu_data(), x_inv_std_.cpu_data(),
-        Dtype(0), spatial_statistic_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
-        spatial_statistic_.cpu_data(), spatial_sum_multiplier_.cpu_data(),
-        Dtype(0), broadcast_buffer_.mutable_cpu_data());
-    caffe_mul(broadcast_buffer_.count(), const_bottom_diff,
-        broadcast_buffer_.cpu_data(), bottom_diff);
+  // gradient w.r.t. the inputs
+  if (channels_last) {
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int n = 0; n < num_; ++n) {
+      const Dtype* dy = top_diff + n * channels_;
+      Dtype* dx = bottom_diff + n * channels_;
+      for (int c = 0; c < channels_; ++c) {
+        dx[c] = a[c] * (dy[c] - mean_dy[c]
+            - (x_data[c][n * channels_ + c] - x_offset[c]) * k[c]);
+      }
+    }
+    return;
+  }
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    for (int n = 0; n < num_; ++n) {
+      const Dtype* x = x_data[c] + n * dim + c * spatial_dim_;
+      const Dtype* dy = top_diff + n * dim + c * spatial_dim_;
+      Dtype* dx = bottom_diff + n * dim + c * spatial_dim_;
+      const Dtype channel_a = a[c], channel_mean_dy = mean_dy[c];
+      const Dtype offset = x_offset[c], channel_k = k[c];
+      for (int i = 0; i < spatial_dim_; ++i) {
+        dx[i] = channel_a * (dy[i] - channel_mean_dy - (x[i] - offset)
+            * channel_k);
+      }
+    }
   }
 }
 
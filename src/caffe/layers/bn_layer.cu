@@ -11,6 +11,7 @@ namespace caffe {
 template <typename Dtype>
 void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   const vector<Blob<Dtype>*>& top) {
+  CHECK(!invert_top_) << "BN invert_top is only implemented on the CPU.";
   const Dtype* const_bottom_data = bottom[0]->gpu_data();
   const Dtype* const_top_data = top[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
@@ -18,6 +19,16 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* scale_data = this->blobs_[0]->gpu_data();
   const Dtype* shift_data = this->blobs_[1]->gpu_data();
 
+  // Reshape leaves the buffers of the GPU passes to them.
+  broadcast_buffer_.ReshapeLike(*bottom[0]);
+  spatial_statistic_.Reshape(num_, channels_, 1, 1);
+  spatial_sum_multiplier_.Reshape(1, 1, 1, spatial_dim_);
+  batch_sum_multiplier_.Reshape(num_, 1, 1, 1);
+  caffe_gpu_set(spatial_sum_multiplier_.count(), Dtype(1),
+      spatial_sum_multiplier_.mutable_gpu_data());
+  caffe_gpu_set(batch_sum_multiplier_.count(), Dtype(1),
+      batch_sum_multiplier_.mutable_gpu_data());
+
   // Mean normalization
   if (frozen_ || this->phase_ == TEST) {
     // Use the moving average mean
@@ -25,8 +36,8 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         batch_statistic_.mutable_gpu_data());
   } else {
     // Compute the mean by averaging over spatial and batch dimensions.
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1) / (height_ * width_), const_bottom_data,
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
+        Dtype(1) / spatial_dim_, const_bottom_data,
         spatial_sum_multiplier_.gpu_data(), Dtype(0),
         spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemv<Dtype>(CblasTrans, num_, channels_,
@@ -45,7 +56,7 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       Dtype(1), batch_sum_multiplier_.gpu_data(), batch_statistic_.gpu_data(),
       Dtype(0), spatial_statistic_.mutable_gpu_data());
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(-1),
+      spatial_dim_, 1, Dtype(-1),
       spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
       Dtype(0), broadcast_buffer_.mutable_gpu_data());
   // Subtract
@@ -60,8 +71,8 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   } else {
     caffe_gpu_powx(broadcast_buffer_.count(), const_top_data, Dtype(2),
         broadcast_buffer_.mutable_gpu_data());
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
-        Dtype(1) / (height_ * width_), broadcast_buffer_.gpu_data(),
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
+        Dtype(1) / spatial_dim_, broadcast_buffer_.gpu_data(),
         spatial_sum_multiplier_.gpu_data(), Dtype(0),
         spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1) / num_,
@@ -85,7 +96,7 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       Dtype(1), batch_sum_multiplier_.gpu_data(), batch_statistic_.gpu_data(),
       Dtype(0), spatial_statistic_.mutable_gpu_data());
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
+      spatial_dim_, 1, Dtype(1),
       spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
       Dtype(0), broadcast_buffer_.mutable_gpu_data());
   // Multiply with the inverse std
@@ -93,7 +104,8 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       broadcast_buffer_.gpu_data(), top_data);
 
   // Save the normalized inputs and std for backprop
-  if (!frozen_) {
+  if (!frozen_ && this->phase_ == TRAIN) {
+    x_norm_.ReshapeLike(*bottom[0]);
     caffe_copy(broadcast_buffer_.count(), const_top_data,
         x_norm_.mutable_gpu_data());
     caffe_copy(batch_statistic_.count(), batch_statistic_.gpu_data(),
@@ -105,7 +117,7 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       Dtype(1), batch_sum_multiplier_.gpu_data(), scale_data,
       Dtype(0), spatial_statistic_.mutable_gpu_data());
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
+      spatial_dim_, 1, Dtype(1),
       spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
       Dtype(0), broadcast_buffer_.mutable_gpu_data());
   caffe_gpu_mul(broadcast_buffer_.count(), const_top_data,
@@ -116,7 +128,7 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       Dtype(1), batch_sum_multiplier_.gpu_data(), shift_data,
       Dtype(0), spatial_statistic_.mutable_gpu_data());
   caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-      height_ * width_, 1, Dtype(1),
+      spatial_dim_, 1, Dtype(1),
       spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
       Dtype(0), broadcast_buffer_.mutable_gpu_data());
   caffe_gpu_add(broadcast_buffer_.count(), const_top_data,
@@ -126,7 +138,7 @@ void BNLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (frozen_) {
+  if (frozen_ || this->phase_ == TEST) {
     if (propagate_down[0]) {
       const Dtype* const_top_diff = top[0]->gpu_diff();
       Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
@@ -145,7 +157,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
           Dtype(1), batch_sum_multiplier_.gpu_data(), batch_statistic_.gpu_data(),
           Dtype(0), spatial_statistic_.mutable_gpu_data());
       caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-          height_ * width_, 1, Dtype(1),
+          spatial_dim_, 1, Dtype(1),
           spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
           Dtype(0), broadcast_buffer_.mutable_gpu_data());
       // Elementwise multiply top grad with (slope / std)
@@ -161,7 +173,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     Dtype* scale_diff = this->blobs_[0]->mutable_gpu_diff();
     caffe_gpu_mul(broadcast_buffer_.count(), x_norm_.gpu_data(), const_top_diff,
         broadcast_buffer_.mutable_gpu_data());
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
         Dtype(1), broadcast_buffer_.gpu_data(),
         spatial_sum_multiplier_.gpu_data(), Dtype(0),
         spatial_statistic_.mutable_gpu_data());
@@ -174,7 +186,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   if (this->param_propagate_down_[1]) {
     const Dtype* const_top_diff = top[0]->gpu_diff();
     Dtype* shift_diff = this->blobs_[1]->mutable_gpu_diff();
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
         Dtype(1), const_top_diff, spatial_sum_multiplier_.gpu_data(),
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
@@ -192,7 +204,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
         Dtype(1), batch_sum_multiplier_.gpu_data(), scale_data,
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1), spatial_statistic_.gpu_data(),
+        spatial_dim_, 1, Dtype(1), spatial_statistic_.gpu_data(),
         spatial_sum_multiplier_.gpu_data(), Dtype(0),
         broadcast_buffer_.mutable_gpu_data());
     caffe_gpu_mul(broadcast_buffer_.count(), const_top_diff,
@@ -201,7 +213,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     // sum of x_hat * (dl / dx_hat)
     caffe_gpu_mul(broadcast_buffer_.count(), x_norm_.gpu_data(),
         broadcast_buffer_.gpu_data(), bottom_diff);
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
         Dtype(1), const_bottom_diff, spatial_sum_multiplier_.gpu_data(),
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemv<Dtype>(CblasTrans, num_, channels_, Dtype(1),
@@ -213,14 +225,14 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
         Dtype(1), batch_sum_multiplier_.gpu_data(), batch_statistic_.gpu_data(),
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
+        spatial_dim_, 1, Dtype(1),
         spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
         Dtype(0), bottom_diff);
     caffe_gpu_mul(broadcast_buffer_.count(), x_norm_.gpu_data(),
         const_bottom_diff, bottom_diff);
 
     // Subtract the average of x_hat times the sum
-    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, height_ * width_,
+    caffe_gpu_gemv<Dtype>(CblasNoTrans, num_ * channels_, spatial_dim_,
         Dtype(1), broadcast_buffer_.gpu_data(),
         spatial_sum_multiplier_.gpu_data(), Dtype(0),
         spatial_statistic_.mutable_gpu_data());
@@ -231,11 +243,11 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
         Dtype(1), batch_sum_multiplier_.gpu_data(), batch_statistic_.gpu_data(),
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
+        spatial_dim_, 1, Dtype(1),
         spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
         Dtype(1), bottom_diff);
     caffe_gpu_axpby(broadcast_buffer_.count(), Dtype(1),
-        broadcast_buffer_.gpu_data(), Dtype(-1) / (num_ * height_ * width_),
+        broadcast_buffer_.gpu_data(), Dtype(-1) / (num_ * spatial_dim_),
         bottom_diff);
 
     // Multiply with the inverse std
@@ -243,7 +255,7 @@ void BNLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
         Dtype(1), batch_sum_multiplier_.gpu_data(), x_inv_std_.gpu_data(),
         Dtype(0), spatial_statistic_.mutable_gpu_data());
     caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * channels_,
-        height_ * width_, 1, Dtype(1),
+        spatial_dim_, 1, Dtype(1),
         spatial_statistic_.gpu_data(), spatial_sum_multiplier_.gpu_data(),
         Dtype(0), broadcast_buffer_.mutable_gpu_data());
     caffe_gpu_mul(broadcast_buffer_.count(), const_bottom_diff,
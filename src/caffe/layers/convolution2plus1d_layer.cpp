@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/convolution2plus1d_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/vol2col.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Convolution2Plus1DParameter& param =
+      this->layer_param_.convolution2plus1d_param();
+  CHECK_EQ(bottom[0]->num_axes(), 5)
+      << "Convolution2Plus1D takes N x C x L x H x W blobs.";
+  kernel_size_ = param.kernel_size();
+  kernel_depth_ = param.kernel_depth();
+  stride_ = param.stride();
+  temporal_stride_ = param.temporal_stride();
+  pad_ = param.pad();
+  temporal_pad_ = param.temporal_pad();
+  channels_ = bottom[0]->shape(1);
+  num_output_ = param.num_output();
+  bias_term_ = param.bias_term();
+  CHECK_GT(kernel_size_, 0);
+  CHECK_GT(kernel_depth_, 0);
+  CHECK_GT(num_output_, 0);
+  mid_output_ = param.mid_output();
+  if (mid_output_ == 0) {
+    // Match the parameter count of a full kd x k x k kernel.
+    const int spatial = kernel_size_ * kernel_size_ * channels_;
+    mid_output_ = std::max(1, kernel_depth_ * spatial * num_output_
+        / (spatial + kernel_depth_ * num_output_));
+  }
+
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 3 : 2);
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(param.weight_filler()));
+    // spatial weights: mid_output x channels x 1 x k x k
+    vector<int> shape(5);
+    shape[0] = mid_output_;
+    shape[1] = channels_;
+    shape[2] = 1;
+    shape[3] = kernel_size_;
+    shape[4] = kernel_size_;
+    this->blobs_[0].reset(new Blob<Dtype>(shape));
+    weight_filler->Fill(this->blobs_[0].get());
+    // temporal weights: num_output x mid_output x kd x 1 x 1
+    shape[0] = num_output_;
+    shape[1] = mid_output_;
+    shape[2] = kernel_depth_;
+    shape[3] = 1;
+    shape[4] = 1;
+    this->blobs_[1].reset(new Blob<Dtype>(shape));
+    weight_filler->Fill(this->blobs_[1].get());
+    if (bias_term_) {
+      this->blobs_[2].reset(new Blob<Dtype>(vector<int>(1, num_output_)));
+      shared_ptr<Filler<Dtype> > bias_filler(
+          GetFiller<Dtype>(param.bias_filler()));
+      bias_filler->Fill(this->blobs_[2].get());
+    }
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+
+  vector<int> temporal_shape(3);
+  temporal_shape[0] = kernel_depth_;
+  temporal_shape[1] = num_output_;
+  temporal_shape[2] = mid_output_;
+  temporal_weight_.Reshape(temporal_shape);
+}
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(bottom[0]->shape(1), channels_)
+      << "Input size incompatible with convolution kernel.";
+  num_ = bottom[0]->shape(0);
+  length_ = bottom[0]->shape(2);
+  height_ = bottom[0]->shape(3);
+  width_ = bottom[0]->shape(4);
+  const int height_out = (height_ + 2 * pad_ - kernel_size_) / stride_ + 1;
+  const int width_out = (width_ + 2 * pad_ - kernel_size_) / stride_ + 1;
+  length_out_ = (length_ + 2 * temporal_pad_ - kernel_depth_)
+      / temporal_stride_ + 1;
+  CHECK_GT(height_out, 0);
+  CHECK_GT(width_out, 0);
+  CHECK_GT(length_out_, 0);
+  spatial_dim_ = height_out * width_out;
+
+  vector<int> shape(5);
+  shape[0] = num_;
+  shape[1] = num_output_;
+  shape[2] = length_out_;
+  shape[3] = height_out;
+  shape[4] = width_out;
+  top[0]->Reshape(shape);
+
+  // buffers for one sample at a time
+  vector<int> col_shape(2);
+  col_shape[0] = channels_ * kernel_size_ * kernel_size_;
+  col_shape[1] = length_ * spatial_dim_;
+  spatial_col_.Reshape(col_shape);
+  vector<int> mid_shape(2);
+  mid_shape[0] = mid_output_;
+  mid_shape[1] = length_ * spatial_dim_;
+  mid_buffer_.Reshape(mid_shape);
+
+  if (bias_term_) {
+    bias_multiplier_.Reshape(vector<int>(1, length_out_ * spatial_dim_));
+    caffe_set(bias_multiplier_.count(), Dtype(1),
+        bias_multiplier_.mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::SpatialForward(const Dtype* bottom_data) {
+  Dtype* col_data = spatial_col_.mutable_cpu_data();
+  vol2col_cpu(bottom_data, channels_, length_, height_, width_, kernel_size_,
+      1, pad_, 0, stride_, 1, col_data);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, mid_output_,
+      length_ * spatial_dim_, channels_ * kernel_size_ * kernel_size_,
+      (Dtype)1., this->blobs_[0]->cpu_data(), col_data,
+      (Dtype)0., mid_buffer_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::GatherTemporalWeights() {
+  const Dtype* weight = this->blobs_[1]->cpu_data();
+  Dtype* tap_weight = temporal_weight_.mutable_cpu_data();
+  for (int o = 0; o < num_output_; ++o) {
+    for (int m = 0; m < mid_output_; ++m) {
+      for (int r = 0; r < kernel_depth_; ++r) {
+        tap_weight[(r * num_output_ + o) * mid_output_ + m] =
+            weight[(o * mid_output_ + m) * kernel_depth_ + r];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int bottom_dim = bottom[0]->count(1);
+  const int top_dim = top[0]->count(1);
+  const int mid_ld = length_ * spatial_dim_;
+  const int top_ld = length_out_ * spatial_dim_;
+  GatherTemporalWeights();
+  const Dtype* tap_weight = temporal_weight_.cpu_data();
+  for (int n = 0; n < num_; ++n) {
+    SpatialForward(bottom_data + n * bottom_dim);
+    const Dtype* mid_data = mid_buffer_.cpu_data();
+    Dtype* top_n = top_data + n * top_dim;
+    if (bias_term_) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_, top_ld, 1,
+          (Dtype)1., this->blobs_[2]->cpu_data(), bias_multiplier_.cpu_data(),
+          (Dtype)0., top_n);
+    } else {
+      caffe_set(top_dim, Dtype(0), top_n);
+    }
+    // output frame t += W_r * intermediate frame t * stride - pad + r
+    for (int t = 0; t < length_out_; ++t) {
+      for (int r = 0; r < kernel_depth_; ++r) {
+        const int l = t * temporal_stride_ - temporal_pad_ + r;
+        if (l < 0 || l >= length_) {
+          continue;
+        }
+        caffe_cpu_strided_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
+            spatial_dim_, mid_output_, (Dtype)1.,
+            tap_weight + r * num_output_ * mid_output_, mid_output_,
+            mid_data + l * spatial_dim_, mid_ld, (Dtype)1.,
+            top_n + t * spatial_dim_, top_ld);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Convolution2Plus1DLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const int bottom_dim = bottom[0]->count(1);
+  const int top_dim = top[0]->count(1);
+  const int mid_ld = length_ * spatial_dim_;
+  const int top_ld = length_out_ * spatial_dim_;
+  const int col_rows = channels_ * kernel_size_ * kernel_size_;
+
+  if (bias_term_ && this->param_propagate_down_[2]) {
+    Dtype* bias_diff = this->blobs_[2]->mutable_cpu_diff();
+    for (int n = 0; n < num_; ++n) {
+      caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, top_ld, (Dtype)1.,
+          top_diff + n * top_dim, bias_multiplier_.cpu_data(), (Dtype)1.,
+          bias_diff);
+    }
+  }
+  if (!this->param_propagate_down_[0] && !this->param_propagate_down_[1]
+      && !propagate_down[0]) {
+    return;
+  }
+
+  GatherTemporalWeights();
+  const Dtype* tap_weight = temporal_weight_.cpu_data();
+  Dtype* tap_weight_diff = temporal_weight_.mutable_cpu_diff();
+  caffe_set(temporal_weight_.count(), Dtype(0), tap_weight_diff);
+  const Dtype* spatial_weight = this->blobs_[0]->cpu_data();
+  Dtype* spatial_weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  for (int n = 0; n < num_; ++n) {
+    // the intermediate volume is not kept from the forward pass
+    SpatialForward(bottom_data + n * bottom_dim);
+    const Dtype* mid_data = mid_buffer_.cpu_data();
+    Dtype* mid_diff = mid_buffer_.mutable_cpu_diff();
+    caffe_set(mid_buffer_.count(), Dtype(0), mid_diff);
+    const Dtype* top_diff_n = top_diff + n * top_dim;
+    for (int t = 0; t < length_out_; ++t) {
+      for (int r = 0; r < kernel_depth_; ++r) {
+        const int l = t * temporal_stride_ - temporal_pad_ + r;
+        if (l < 0 || l >= length_) {
+          continue;
+        }
+        // gradient w.r.t. the temporal weights of tap r
+        caffe_cpu_strided_gemm<Dtype>(CblasNoTrans, CblasTrans, num_output_,
+            mid_output_, spatial_dim_, (Dtype)1., top_diff_n + t * spatial_dim_,
+            top_ld, mid_data + l * spatial_dim_, mid_ld, (Dtype)1.,
+            tap_weight_diff + r * num_output_ * mid_output_, mid_output_);
+        // gradient w.r.t. the intermediate frame l
+        caffe_cpu_strided_gemm<Dtype>(CblasTrans, CblasNoTrans, mid_output_,
+            spatial_dim_, num_output_, (Dtype)1.,
+            tap_weight + r * num_output_ * mid_output_, mid_output_,
+            top_diff_n + t * spatial_dim_, top_ld, (Dtype)1.,
+            mid_diff + l * spatial_dim_, mid_ld);
+      }
+    }
+    // spatial factor, with the columns left by SpatialForward
+    if (this->param_propagate_down_[0]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, mid_output_, col_rows,
+          mid_ld, (Dtype)1., mid_diff, spatial_col_.cpu_data(), (Dtype)1.,
+          spatial_weight_diff);
+    }
+    if (propagate_down[0]) {
+      Dtype* col_diff = spatial_col_.mutable_cpu_diff();
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, col_rows, mid_ld,
+          mid_output_, (Dtype)1., spatial_weight, mid_diff, (Dtype)0.,
+          col_diff);
+      col2vol_cpu(col_diff, channels_, length_, height_, width_, kernel_size_,
+          1, pad_, 0, stride_, 1, bottom[0]->mutable_cpu_diff()
+          + n * bottom_dim);
+    }
+  }
+
+  if (this->param_propagate_down_[1]) {
+    Dtype* weight_diff = this->blobs_[1]->mutable_cpu_diff();
+    for (int o = 0; o < num_output_; ++o) {
+      for (int m = 0; m < mid_output_; ++m) {
+        for (int r = 0; r < kernel_depth_; ++r) {
+          weight_diff[(o * mid_output_ + m) * kernel_depth_ + r] +=
+              tap_weight_diff[(r * num_output_ + o) * mid_output_ + m];
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Convolution2Plus1DLayer);
+REGISTER_LAYER_CLASS(Convolution2Plus1D);
+
+}  // namespace caffe
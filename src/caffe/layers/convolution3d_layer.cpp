@@ -15,10 +15,14 @@
  */
 
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
 #include "caffe/layers/convolution3d_layer.hpp"
+#include "caffe/util/conv3d_depthwise.hpp"
+#include "caffe/util/conv3d_ndhwc.hpp"
+#include "caffe/util/conv3d_winograd.hpp"
 #include "caffe/util/vol2col.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -38,54 +42,111 @@ void Convolution3DLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     temporal_stride_ = this->layer_param_.convolution3d_param().temporal_stride();
     pad_ = this->layer_param_.convolution3d_param().pad();
     temporal_pad_ = this->layer_param_.convolution3d_param().temporal_pad();
+    ndhwc_ = this->layer_param_.convolution3d_param().layout() == NDHWC;
     vector<int>bottom_shape = bottom[0]->shape();
     num_ = bottom_shape[0];
-    channels_ = bottom_shape[1];
-    length_ = bottom_shape[2];
-    height_ = bottom_shape[3];
-    width_ = bottom_shape[4];
+    channels_ = bottom_shape[ndhwc_ ? 4 : 1];
+    length_ = bottom_shape[ndhwc_ ? 1 : 2];
+    height_ = bottom_shape[ndhwc_ ? 2 : 3];
+    width_ = bottom_shape[ndhwc_ ? 3 : 4];
     num_output_ = this->layer_param_.convolution3d_param().num_output();
     filter_group_ = this->layer_param_.convolution3d_param().filter_group();
+    group_ = this->layer_param_.convolution3d_param().group();
     CHECK_GT(num_output_, 0);
-
-    // number of output filters must be divided by filter_group
-    CHECK_EQ(num_output_ % filter_group_, 0);
+    CHECK_EQ(channels_ % group_, 0) << "Number of input channels must be divided by group";
+    CHECK_EQ(num_output_ % group_, 0) << "Number of outputs must be divided by group";
+
+    // number of output filters of every group must be divided by filter_group
+    CHECK_EQ(num_output_ / group_ % filter_group_, 0);
+    if (ndhwc_) {
+        CHECK_EQ(group_, 1) << "NDHWC layout does not support group.";
+        CHECK_NE(this->layer_param_.convolution3d_param().engine(),
+                 Convolution3DParameter_Engine_WINOGRAD) << "NDHWC layout does not support WINOGRAD.";
+    }
 
 }
 
 template <typename Dtype>
 void Convolution3DLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top)
 {
-    // The vol2col result buffer would only hold one image at a time to avoid
-    // overly large memory usage.
-
+    num_ = bottom[0]->shape(0);
     int height_out = (height_ + 2 * pad_ - kernel_size_) / stride_ + 1;
     int width_out = (width_ + 2 * pad_ - kernel_size_) / stride_ + 1;
     int length_out = (length_ + 2 * temporal_pad_ - kernel_depth_) / temporal_stride_ + 1;
 
-    // buffer for one image
+    bias_term_ = this->layer_param_.convolution3d_param().bias_term();
+
+    // Figure out the dimensions for individual gemms: every group of input
+    // channels is convolved filter_group_ times per volume.
+    M_ = num_output_ / group_ / filter_group_;
+    K_ = channels_ / group_ * kernel_depth_ * kernel_size_ * kernel_size_;
+    N_ = length_out * height_out * width_out;
+    depthwise_ = group_ > 1 && group_ == channels_;
+
+    // The vol2col result buffer would only hold one image at a time to avoid
+    // overly large memory usage, unless col_buffer_mb allows the CPU passes
+    // to unfold several images (plus their GEMM output) at once.
+    // A pointwise kernel needs no column buffer at all: vol2col would be a
+    // plain copy of the bottom.
+    pointwise_ = kernel_size_ == 1 && kernel_depth_ == 1 && stride_ == 1
+            && temporal_stride_ == 1 && pad_ == 0 && temporal_pad_ == 0;
+    batch_samples_ = 1;
+    const size_t col_buffer_bytes =
+            size_t(this->layer_param_.convolution3d_param().col_buffer_mb()) << 20;
+    if (col_buffer_bytes > 0 && !pointwise_ && !depthwise_ && !ndhwc_) {
+        const size_t sample_bytes = size_t(K_ * group_ + num_output_) * N_ * sizeof(Dtype);
+        batch_samples_ = std::max<int>(1, std::min<size_t>(num_, col_buffer_bytes / sample_bytes));
+    }
+
     vector<int> shape(5);
-    shape[0] = 1;
-    shape[1] = channels_ * kernel_depth_ * kernel_size_ * kernel_size_;
+    shape[0] = batch_samples_;
+    shape[1] = K_ * group_;
     shape[2] = length_out;
     shape[3] = height_out;
     shape[4] = width_out;
     col_buffer_.Reshape(shape);
+    if (batch_samples_ > 1) {
+        vector<int> output_shape(2);
+        output_shape[0] = num_output_;
+        output_shape[1] = batch_samples_ * N_;
+        output_buffer_.Reshape(output_shape);
+    }
 
+    const Convolution3DParameter_Engine engine = this->layer_param_.convolution3d_param().engine();
+    winograd_ = engine == Convolution3DParameter_Engine_WINOGRAD;
+    if (winograd_) {
+        CHECK(kernel_size_ == 3 && kernel_depth_ == 3 && stride_ == 1 && temporal_stride_ == 1)
+                << "WINOGRAD engine only supports 3x3x3 kernels with stride 1.";
+        CHECK_EQ(group_, 1) << "WINOGRAD engine does not support group.";
+        winograd_workspace_.Reshape(vector<int>(1, conv3d_winograd_workspace_size(
+                channels_, length_, height_, width_, num_output_, pad_, temporal_pad_)));
+        // Forward reshapes every time: the transformed filters only go stale
+        // with their shape, or with the weights, which Forward compares
+        const int filter_size = conv3d_winograd_filter_size(num_output_, channels_);
+        if (winograd_filter_.count() != filter_size) {
+            winograd_filter_.Reshape(vector<int>(1, filter_size));
+            winograd_weight_.Reshape(vector<int>(1, 0));
+        }
+    }
 
-    bias_term_ = this->layer_param_.convolution3d_param().bias_term();
-
-    // Figure out the dimensions for individual gemms.
-    M_ = num_output_ / filter_group_; // doing convolution filter_group_ times per volume
-    K_ = channels_ * kernel_depth_ * kernel_size_ * kernel_size_;
-    N_ = length_out * height_out * width_out;
+    // one channels x num_output_ matrix per kernel tap
+    if (ndhwc_ && !pointwise_) {
+        tap_weight_.Reshape(vector<int>(1, num_output_ * K_));
+    }
 
     // output size
     shape[0] = bottom[0]->shape(0);
-    shape[1] = num_output_;
-    shape[2] = length_out;
-    shape[3] = height_out;
-    shape[4] = width_out;
+    if (ndhwc_) {
+        shape[1] = length_out;
+        shape[2] = height_out;
+        shape[3] = width_out;
+        shape[4] = num_output_;
+    } else {
+        shape[1] = num_output_;
+        shape[2] = length_out;
+        shape[3] = height_out;
+        shape[4] = width_out;
+    }
     top[0]->Reshape(shape);
 
     // Check if we need to set up the weights
@@ -99,7 +160,7 @@ void Convolution3DLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom, con
         }
         // Initialize the weights
         shape[0] = num_output_;
-        shape[1] = channels_;
+        shape[1] = channels_ / group_;
         shape[2] = kernel_depth_;
         shape[3] = kernel_size_;
         shape[4] = kernel_size_;
@@ -134,29 +195,144 @@ void Convolution3DLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
                                              const vector<Blob<Dtype>*>& top) {
     const Dtype* bottom_data = bottom[0]->cpu_data();
     Dtype* top_data = top[0]->mutable_cpu_data();
-    Dtype* col_data = col_buffer_.mutable_cpu_data();
     const Dtype* weight = this->blobs_[0]->cpu_data();
 
     int weight_offset = M_ * K_;
     int top_offset = M_ * N_;
+    const int group_output = num_output_ / group_;
+    const int weight_group_offset = group_output * K_;
+    const int top_group_offset = group_output * N_;
+    // 5-D blobs have no legacy offset(n)
+    const int bottom_dim = bottom[0]->count(1);
+    const int top_dim = top[0]->count(1);
+
+    if (ndhwc_) {
+        const Dtype* bias_multiplier =
+                bias_term_ ? reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()) : NULL;
+        if (pointwise_) {
+            // every position of the whole batch is a row of one GEMM
+            caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num_ * N_, num_output_, channels_,
+                                  (Dtype)1., bottom_data, weight, (Dtype)0., top_data);
+            for (int n = 0; bias_term_ && n < num_; ++n) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, num_output_, 1,
+                                      (Dtype)1., bias_multiplier, this->blobs_[1]->cpu_data(),
+                                      (Dtype)1., top_data + n * top_dim);
+            }
+            return;
+        }
+        Dtype* tap_weight = tap_weight_.mutable_cpu_data();
+        conv3d_ndhwc_gather_weight_cpu(weight, num_output_, channels_, kernel_size_,
+                                       kernel_depth_, tap_weight);
+        const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+        for (int n = 0; n < num_; ++n) {
+            conv3d_ndhwc_cpu(bottom_data + n * bottom_dim, channels_, length_, height_, width_,
+                    tap_weight, num_output_, kernel_size_, kernel_depth_, pad_, temporal_pad_,
+                    stride_, temporal_stride_, bias, top_data + n * top_dim);
+        }
+        return;
+    }
+
+    if (pointwise_) {
+        for (int n = 0; n < num_; ++n) {
+            for (int g = 0; g < group_; ++g) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_output, N_, K_,
+                                      (Dtype)1., weight + g * weight_group_offset,
+                                      bottom_data + n * bottom_dim + g * K_ * N_,
+                                      (Dtype)0., top_data + n * top_dim + g * top_group_offset);
+            }
+            if (bias_term_) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
+                                      N_, 1, (Dtype)1., this->blobs_[1]->cpu_data(),
+                        reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()),
+                        (Dtype)1., top_data + n * top_dim);
+            }
+        }
+        return;
+    }
+
+    if (winograd_) {
+        // transform the filters only if the weights changed since last time
+        const int weight_count = this->blobs_[0]->count();
+        if (winograd_weight_.count() != weight_count
+                || !std::equal(weight, weight + weight_count, winograd_weight_.cpu_data())) {
+            winograd_weight_.ReshapeLike(*this->blobs_[0]);
+            caffe_copy(weight_count, weight, winograd_weight_.mutable_cpu_data());
+            conv3d_winograd_transform_filter_cpu(weight, num_output_, channels_,
+                                                 winograd_filter_.mutable_cpu_data());
+        }
+        const Dtype* filter = winograd_filter_.cpu_data();
+        Dtype* workspace = winograd_workspace_.mutable_cpu_data();
+        const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+        for (int n = 0; n < num_; ++n) {
+            conv3d_winograd_cpu(bottom_data + n * bottom_dim, channels_, length_, height_, width_,
+                    filter, num_output_, pad_, temporal_pad_, bias, top_data + n * top_dim,
+                    workspace);
+        }
+        return;
+    }
+
+    if (depthwise_) {
+        const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+        for (int n = 0; n < num_; ++n) {
+            conv3d_depthwise_cpu(bottom_data + n * bottom_dim, channels_, length_, height_, width_,
+                    weight, num_output_ / channels_, kernel_size_, kernel_depth_, pad_,
+                    temporal_pad_, stride_, temporal_stride_, bias, top_data + n * top_dim);
+        }
+        return;
+    }
+
+    Dtype* col_data = col_buffer_.mutable_cpu_data();
+
+    if (batch_samples_ > 1) {
+        // Every filter group shares the same columns, so one GEMM over the
+        // filters of a group and all batch_samples_ volumes does the work.
+        Dtype* output_data = output_buffer_.mutable_cpu_data();
+        const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+        for (int n0 = 0; n0 < num_; n0 += batch_samples_) {
+            const int batch = std::min(batch_samples_, num_ - n0);
+            vol2col_batch_cpu(bottom_data + n0 * bottom_dim, batch, channels_, length_, height_,
+                    width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, col_data);
+            for (int g = 0; g < group_; ++g) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_output, batch * N_, K_,
+                                      (Dtype)1., weight + g * weight_group_offset,
+                                      col_data + g * K_ * batch * N_,
+                                      (Dtype)0., output_data + g * group_output * batch * N_);
+            }
+            // scatter back to [n, c, l, h, w], adding the bias on the way
+            for (int o = 0; o < num_output_; ++o) {
+                const Dtype bias_value = bias ? bias[o] : Dtype(0);
+                for (int b = 0; b < batch; ++b) {
+                    const Dtype* output_row = output_data + (o * batch + b) * N_;
+                    Dtype* top_row = top_data + (n0 + b) * top_dim + o * N_;
+                    for (int i = 0; i < N_; ++i) {
+                        top_row[i] = output_row[i] + bias_value;
+                    }
+                }
+            }
+        }
+        return;
+    }
 
     for (int n = 0; n < num_; ++n) {
         // First, im2col
-        vol2col_cpu(bottom_data + bottom[0]->offset(n), channels_, length_, height_,
+        vol2col_cpu(bottom_data + n * bottom_dim, channels_, length_, height_,
                 width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, col_data);
 
-        // Second, inner-product without filter groups
-        for (int g=0 ; g < filter_group_; ++g) {
-            caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
-                                  (Dtype)1., weight + g * weight_offset, col_data,
-                                  (Dtype)0., top_data + top[0]->offset(n) + g * top_offset);
+        // Second, inner-product of every group with its own channels' columns
+        for (int g = 0; g < group_; ++g) {
+            for (int f = 0; f < filter_group_; ++f) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
+                                      (Dtype)1., weight + g * weight_group_offset + f * weight_offset,
+                                      col_data + g * K_ * N_, (Dtype)0.,
+                                      top_data + n * top_dim + g * top_group_offset + f * top_offset);
+            }
         }
         // third, add bias
         if (bias_term_) {
             caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
                                   N_, 1, (Dtype)1., this->blobs_[1]->cpu_data(),
                     reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()),
-                    (Dtype)1., top_data + top[0]->offset(n));
+                    (Dtype)1., top_data + n * top_dim);
         }
 
     }
@@ -170,58 +346,166 @@ void Convolution3DLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    Dtype* col_data = col_buffer_.mutable_cpu_data();
-    Dtype* col_diff = col_buffer_.mutable_cpu_diff();
+    const int bottom_dim = bottom[0]->count(1);
+    const int top_dim = top[0]->count(1);
     // bias gradient if necessary
     Dtype* bias_diff = NULL;
 
     if (bias_term_) {
         bias_diff = this->blobs_[1]->mutable_cpu_diff();
         for (int n = 0; n < num_; ++n) {
-            caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, N_,
-                                  1., top_diff + top[0]->offset(n),
-                    reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()), 1.,
-                    bias_diff);
+            // channels-last top diffs sum down their N_ x num_output_ columns
+            if (ndhwc_) {
+                caffe_cpu_gemv<Dtype>(CblasTrans, N_, num_output_,
+                                      1., top_diff + n * top_dim,
+                        reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()), 1.,
+                        bias_diff);
+            } else {
+                caffe_cpu_gemv<Dtype>(CblasNoTrans, num_output_, N_,
+                                      1., top_diff + n * top_dim,
+                        reinterpret_cast<const Dtype*>(bias_multiplier_->cpu_data()), 1.,
+                        bias_diff);
+            }
+        }
+    }
+
+    if (ndhwc_) {
+        if (pointwise_) {
+            // gradient w.r.t. weight. Note that we will accumulate diffs.
+            caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_output_, channels_, num_ * N_,
+                                  (Dtype)1., top_diff, bottom_data, (Dtype)1., weight_diff);
+            if (propagate_down[0]) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_ * N_, channels_, num_output_,
+                                      (Dtype)1., top_diff, weight, (Dtype)0., bottom_diff);
+            }
+            return;
+        }
+        Dtype* tap_weight = tap_weight_.mutable_cpu_data();
+        Dtype* tap_weight_diff = tap_weight_.mutable_cpu_diff();
+        conv3d_ndhwc_gather_weight_cpu(weight, num_output_, channels_, kernel_size_,
+                                       kernel_depth_, tap_weight);
+        caffe_set(tap_weight_.count(), Dtype(0), tap_weight_diff);
+        for (int n = 0; n < num_; ++n) {
+            conv3d_ndhwc_backward_cpu(bottom_data + n * bottom_dim, channels_, length_, height_,
+                    width_, top_diff + n * top_dim, tap_weight, num_output_, kernel_size_,
+                    kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, tap_weight_diff,
+                    propagate_down[0] ? bottom_diff + n * bottom_dim : static_cast<Dtype*>(NULL));
         }
+        conv3d_ndhwc_scatter_weight_cpu(tap_weight_diff, num_output_, channels_, kernel_size_,
+                                        kernel_depth_, weight_diff);
+        return;
     }
 
     int weight_offset = M_ * K_;
     int top_offset = M_ * N_;
+    const int group_output = num_output_ / group_;
+    const int weight_group_offset = group_output * K_;
+    const int top_group_offset = group_output * N_;
+
+    if (pointwise_) {
+        for (int n = 0; n < num_; ++n) {
+            for (int g = 0; g < group_; ++g) {
+                // gradient w.r.t. weight. Note that we will accumulate diffs.
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, group_output, K_, N_,
+                                      (Dtype)1., top_diff + n * top_dim + g * top_group_offset,
+                                      bottom_data + n * bottom_dim + g * K_ * N_, (Dtype)1.,
+                                      weight_diff + g * weight_group_offset);
+                // gradient w.r.t. bottom data, if necessary
+                if (propagate_down[0]) {
+                    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, group_output,
+                                          (Dtype)1., weight + g * weight_group_offset,
+                                          top_diff + n * top_dim + g * top_group_offset,
+                                          (Dtype)0., bottom_diff + n * bottom_dim + g * K_ * N_);
+                }
+            }
+        }
+        return;
+    }
+
+    if (depthwise_) {
+        for (int n = 0; n < num_; ++n) {
+            conv3d_depthwise_backward_cpu(bottom_data + n * bottom_dim, channels_, length_, height_,
+                    width_, top_diff + n * top_dim, weight, num_output_ / channels_, kernel_size_,
+                    kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, weight_diff,
+                    propagate_down[0] ? bottom_diff + n * bottom_dim : static_cast<Dtype*>(NULL));
+        }
+        return;
+    }
+
+    Dtype* col_data = col_buffer_.mutable_cpu_data();
+    Dtype* col_diff = col_buffer_.mutable_cpu_diff();
+
+    if (batch_samples_ > 1) {
+        Dtype* output_diff = output_buffer_.mutable_cpu_diff();
+        for (int n0 = 0; n0 < num_; n0 += batch_samples_) {
+            const int batch = std::min(batch_samples_, num_ - n0);
+            vol2col_batch_cpu(bottom_data + n0 * bottom_dim, batch, channels_, length_, height_,
+                    width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, col_data);
+            // gather the top diff into the column order of the joint GEMM
+            for (int o = 0; o < num_output_; ++o) {
+                for (int b = 0; b < batch; ++b) {
+                    caffe_copy(N_, top_diff + (n0 + b) * top_dim + o * N_,
+                               output_diff + (o * batch + b) * N_);
+                }
+            }
+            for (int g = 0; g < group_; ++g) {
+                const int col_group_offset = g * K_ * batch * N_;
+                const int output_group_offset = g * group_output * batch * N_;
+                // gradient w.r.t. weight. Note that we will accumulate diffs.
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, group_output, K_, batch * N_,
+                                      (Dtype)1., output_diff + output_group_offset,
+                                      col_data + col_group_offset,
+                                      (Dtype)1., weight_diff + g * weight_group_offset);
+                // gradient w.r.t. bottom data, if necessary
+                if (propagate_down[0]) {
+                    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, batch * N_, group_output,
+                                          (Dtype)1., weight + g * weight_group_offset,
+                                          output_diff + output_group_offset,
+                                          (Dtype)0., col_diff + col_group_offset);
+                }
+            }
+            if (propagate_down[0]) {
+                col2vol_batch_cpu(col_diff, batch, channels_, length_, height_, width_, kernel_size_,
+                                  kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_,
+                                  bottom_diff + n0 * bottom_dim);
+            }
+        }
+        return;
+    }
 
     for (int n = 0; n < num_; ++n) {
         // since we saved memory in the forward pass by not storing all col data,
         // we will need to recompute them.
-        vol2col_cpu(bottom_data + bottom[0]->offset(n), channels_, length_, height_,
+        vol2col_cpu(bottom_data + n * bottom_dim, channels_, length_, height_,
                 width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_,
                 temporal_stride_, col_data);
 
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        for (int g=0; g<filter_group_; ++g){
-            caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, N_,
-                                  (Dtype)1., top_diff + top[0]->offset(n) + g * top_offset,
-                    col_data, (Dtype)1.,
-                    weight_diff + g * weight_offset);
-        }
+        for (int g = 0; g < group_; ++g) {
+            const Dtype* group_top_diff = top_diff + n * top_dim + g * top_group_offset;
+            // gradient w.r.t. weight. Note that we will accumulate diffs.
+            for (int f = 0; f < filter_group_; ++f) {
+                caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, N_,
+                                      (Dtype)1., group_top_diff + f * top_offset,
+                                      col_data + g * K_ * N_, (Dtype)1.,
+                                      weight_diff + g * weight_group_offset + f * weight_offset);
+            }
 
-        // gradient w.r.t. bottom data, if necessary
-        if (propagate_down[0]) {
-            // compute first filter group -> col_diff
-            caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
-                                  (Dtype)1., weight,
-                                  top_diff + top[0]->offset(n),
-                    (Dtype)0., col_diff);
-
-            // accumulate the other filter groups -> col_diff? It is different Caffe group implementation?
-            for (int g=1; g<filter_group_; ++g){
-                caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
-                                      (Dtype)1., weight + g * weight_offset,
-                                      top_diff + top[0]->offset(n) + g * top_offset,
-                        (Dtype)1., col_diff);
+            // gradient w.r.t. bottom data, if necessary: the filter groups
+            // of a group accumulate into the columns of its channels
+            if (propagate_down[0]) {
+                for (int f = 0; f < filter_group_; ++f) {
+                    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
+                                          (Dtype)1., weight + g * weight_group_offset + f * weight_offset,
+                                          group_top_diff + f * top_offset,
+                                          (Dtype)(f > 0 ? 1. : 0.), col_diff + g * K_ * N_);
+                }
             }
+        }
 
+        if (propagate_down[0]) {
             // vol2im back to the data
             col2vol_cpu(col_diff, channels_, length_, height_, width_, kernel_size_, kernel_depth_, pad_,
-                        temporal_pad_, stride_, temporal_stride_, bottom_diff + bottom[0]->offset(n));
+                        temporal_pad_, stride_, temporal_stride_, bottom_diff + n * bottom_dim);
         }
 
     }
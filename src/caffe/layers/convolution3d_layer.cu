@@ -34,26 +34,57 @@ template <typename Dtype>
 void Convolution3DLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
                                             const vector<Blob<Dtype>*>& top)
 {
+    // channels-last blobs are convolved on the CPU only
+    if (ndhwc_) {
+        Forward_cpu(bottom, top);
+        return;
+    }
     const Dtype* bottom_data = bottom[0]->gpu_data();
     Dtype* top_data = top[0]->mutable_gpu_data();
-    Dtype* col_data = col_buffer_.mutable_gpu_data();
     const Dtype* weight = this->blobs_[0]->gpu_data();
 
     int weight_offset = M_ * K_;
     int top_offset = M_ * N_;
+    const int group_output = num_output_ / group_;
+    const int weight_group_offset = group_output * K_;
+    const int top_group_offset = group_output * N_;
 
     // indices for calling offset function of a blob
     vector<int> indices(5, 0);
+    if (pointwise_) {
+        // the bottom is its own column buffer
+        for (int n = 0; n < num_; ++n) {
+            indices[0] = n;
+            for (int g = 0; g < group_; ++g) {
+                caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, group_output, N_, K_,
+                                      (Dtype)1., weight + g * weight_group_offset,
+                                      bottom_data + bottom[0]->offset(indices) + g * K_ * N_,
+                                      (Dtype)0., top_data + top[0]->offset(indices) + g * top_group_offset);
+            }
+            if (bias_term_) {
+                caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output_,
+                                      N_, 1, (Dtype)1., this->blobs_[1]->gpu_data(),
+                        reinterpret_cast<const Dtype*>(bias_multiplier_->gpu_data()),
+                        (Dtype)1., top_data + top[0]->offset(indices));
+            }
+        }
+        return;
+    }
+
+    Dtype* col_data = col_buffer_.mutable_gpu_data();
     for (int n = 0; n < num_; ++n) {
         indices[0] = n;
         // First, im2col
         vol2col_gpu(bottom_data + bottom[0]->offset(indices), channels_, length_, height_,
                 width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, col_data);
-        // Second, innerproduct with groups
-        for (int g=0; g<filter_group_; ++g){
-            caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
-                                  (Dtype)1., weight + g * weight_offset, col_data,
-                                  (Dtype)0., top_data + top[0]->offset(indices) + g * top_offset);
+        // Second, innerproduct of every group with its own channels' columns
+        for (int g = 0; g < group_; ++g) {
+            for (int f = 0; f < filter_group_; ++f) {
+                caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, K_,
+                                      (Dtype)1., weight + g * weight_group_offset + f * weight_offset,
+                                      col_data + g * K_ * N_, (Dtype)0.,
+                                      top_data + top[0]->offset(indices) + g * top_group_offset + f * top_offset);
+            }
         }
         // third, add bias
         if (bias_term_) {
@@ -69,13 +100,15 @@ template <typename Dtype>
 void Convolution3DLayer<Dtype>::Backward_gpu (const vector<Blob<Dtype>*>& top,
                                               const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom)
 {
+    if (ndhwc_) {
+        Backward_cpu(top, propagate_down, bottom);
+        return;
+    }
     const Dtype* top_diff = top[0]->gpu_diff();
     const Dtype* weight = this->blobs_[0]->gpu_data();
     Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
     const Dtype* bottom_data = bottom[0]->gpu_data();
     Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
-    Dtype* col_data = col_buffer_.mutable_gpu_data();
-    Dtype* col_diff = col_buffer_.mutable_gpu_diff();
     // bias gradient if necessary
     Dtype* bias_diff = NULL;
 
@@ -94,36 +127,62 @@ void Convolution3DLayer<Dtype>::Backward_gpu (const vector<Blob<Dtype>*>& top,
 
     int weight_offset = M_ * K_;
     int top_offset = M_ * N_;
+    const int group_output = num_output_ / group_;
+    const int weight_group_offset = group_output * K_;
+    const int top_group_offset = group_output * N_;
 
     // indices for calling offset function of a blob [n,c,l,h,w]
     vector<int> indices(5, 0);
+    if (pointwise_) {
+        for (int n = 0; n < num_; ++n) {
+            indices[0] = n;
+            for (int g = 0; g < group_; ++g) {
+                // gradient w.r.t. weight. Note that we will accumulate diffs.
+                caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, group_output, K_, N_,
+                                      (Dtype)1., top_diff + top[0]->offset(indices) + g * top_group_offset,
+                                      bottom_data + bottom[0]->offset(indices) + g * K_ * N_, (Dtype)1.,
+                                      weight_diff + g * weight_group_offset);
+                // gradient w.r.t. bottom data, if necessary
+                if (propagate_down[0]) {
+                    caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, group_output,
+                                          (Dtype)1., weight + g * weight_group_offset,
+                                          top_diff + top[0]->offset(indices) + g * top_group_offset,
+                                          (Dtype)0., bottom_diff + bottom[0]->offset(indices) + g * K_ * N_);
+                }
+            }
+        }
+        return;
+    }
+
+    Dtype* col_data = col_buffer_.mutable_gpu_data();
+    Dtype* col_diff = col_buffer_.mutable_gpu_diff();
     for (int n = 0; n < num_; ++n) {
         indices[0] = n;
         // since we saved memory in the forward pass by not storing all col data,
         // we will need to recompute them.
         vol2col_gpu(bottom_data + bottom[0]->offset(indices), channels_, length_, height_,
                 width_, kernel_size_, kernel_depth_, pad_, temporal_pad_, stride_, temporal_stride_, col_data);
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        for (int g=0; g<filter_group_; ++g) {
-            caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, N_,
-                                  (Dtype)1., top_diff + top[0]->offset(indices) + g * top_offset,
-                    col_data, (Dtype)1.,
-                    weight_diff + g * weight_offset);
+        for (int g = 0; g < group_; ++g) {
+            const Dtype* group_top_diff = top_diff + top[0]->offset(indices) + g * top_group_offset;
+            // gradient w.r.t. weight. Note that we will accumulate diffs.
+            for (int f = 0; f < filter_group_; ++f) {
+                caffe_gpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, K_, N_,
+                                      (Dtype)1., group_top_diff + f * top_offset,
+                                      col_data + g * K_ * N_, (Dtype)1.,
+                                      weight_diff + g * weight_group_offset + f * weight_offset);
+            }
+            // gradient w.r.t. bottom data, if necessary: the filter groups
+            // of a group accumulate into the columns of its channels
+            if (propagate_down[0]) {
+                for (int f = 0; f < filter_group_; ++f) {
+                    caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
+                                          (Dtype)1., weight + g * weight_group_offset + f * weight_offset,
+                                          group_top_diff + f * top_offset,
+                                          (Dtype)(f > 0 ? 1. : 0.), col_diff + g * K_ * N_);
+                }
+            }
         }
-        // gradient w.r.t. bottom data, if necessary
         if (propagate_down[0]) {
-            caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
-                                  (Dtype)1., weight,
-                                  top_diff + top[0]->offset(indices),
-                    (Dtype)0., col_diff);
-
-            // accumulate the other filter groups -> col_diff? It is different Caffe group implementation?
-            for (int g=1; g<filter_group_; ++g) {
-                caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, K_, N_, M_,
-                                      (Dtype)1., weight + g * weight_offset,
-                                      top_diff + top[0]->offset(indices) + g * top_offset,
-                        (Dtype)1., col_diff);
-            }
             // col2vol back to the data
             col2vol_gpu(col_diff, channels_, length_, height_, width_, kernel_size_, kernel_depth_, pad_,
                         temporal_pad_, stride_, temporal_stride_, bottom_diff + bottom[0]->offset(indices));
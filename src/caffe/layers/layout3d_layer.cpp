@@ -0,0 +1,71 @@
+#include <vector>
+
+#include "caffe/layers/layout3d_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void Layout3DLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(5, bottom[0]->num_axes()) << "Layout3D converts 5-D blobs only.";
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  vector<int> top_shape(bottom[0]->shape());
+  num_ = top_shape[0];
+  if (this->layer_param_.layout3d_param().layout() == NDHWC) {
+    // N x C x D x H x W -> N x D x H x W x C
+    channels_ = top_shape[1];
+    top_shape.erase(top_shape.begin() + 1);
+    top_shape.push_back(channels_);
+  } else {
+    // N x D x H x W x C -> N x C x D x H x W
+    channels_ = top_shape[4];
+    top_shape.pop_back();
+    top_shape.insert(top_shape.begin() + 1, channels_);
+  }
+  spatial_dim_ = bottom[0]->count(1) / channels_;
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void Layout3DLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const bool to_ndhwc = this->layer_param_.layout3d_param().layout() == NDHWC;
+  const int dim = channels_ * spatial_dim_;
+  for (int n = 0; n < num_; ++n) {
+    if (to_ndhwc) {
+      caffe_cpu_transpose(channels_, spatial_dim_, bottom_data + n * dim,
+          top_data + n * dim);
+    } else {
+      caffe_cpu_transpose(spatial_dim_, channels_, bottom_data + n * dim,
+          top_data + n * dim);
+    }
+  }
+}
+
+template <typename Dtype>
+void Layout3DLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const bool to_ndhwc = this->layer_param_.layout3d_param().layout() == NDHWC;
+  const int dim = channels_ * spatial_dim_;
+  for (int n = 0; n < num_; ++n) {
+    if (to_ndhwc) {
+      caffe_cpu_transpose(spatial_dim_, channels_, top_diff + n * dim,
+          bottom_diff + n * dim);
+    } else {
+      caffe_cpu_transpose(channels_, spatial_dim_, top_diff + n * dim,
+          bottom_diff + n * dim);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Layout3DLayer);
+REGISTER_LAYER_CLASS(Layout3D);
+
+}  // namespace caffe
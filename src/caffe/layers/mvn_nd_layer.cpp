@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/mvn_nd_layer.hpp"
@@ -18,14 +20,14 @@ void MVN_NDLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       mean_shape[i] = 1;
   mean_.Reshape(mean_shape);
   variance_.Reshape(mean_shape);
+  // The CPU passes work row by row; temp_ and sum_multiplier_ are only
+  // allocated once the GPU passes touch them.
   temp_.ReshapeLike(*bottom[0]);
   // sum_multiplier shape
   vector<int> mult_shape(bottom[0]->shape());
   for (int i = 0; i < axis_; i++)
       mult_shape[i] = 1;
   sum_multiplier_.Reshape(mult_shape);
-  Dtype* multiplier_data = sum_multiplier_.mutable_cpu_data();
-  caffe_set(sum_multiplier_.count(), Dtype(1), multiplier_data);
   eps_ = this->layer_param_.mvn_param().eps();
 }
 
@@ -34,34 +36,40 @@ void MVN_NDLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-
-  // subtract mean
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1. / dim_, bottom_data,
-      sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, -1.,
-      mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-      temp_.mutable_cpu_data());
-  caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);  // X-EX
-
-  if (this->layer_param_.mvn_param().normalize_variance()) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(bottom[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1. / dim_, temp_.cpu_data(),
-        sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X-EX)^2)
-
-    // normalize variance
-    caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-          variance_.mutable_cpu_data());
-
-    caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, 1.,
-          variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
+  Dtype* mean_data = mean_.mutable_cpu_data();
+  Dtype* variance_data = variance_.mutable_cpu_data();
+  const bool normalize_variance =
+      this->layer_param_.mvn_param().normalize_variance();
+  const int dim = dim_;
+
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int n = 0; n < num_; ++n) {
+    const Dtype* x = bottom_data + n * dim;
+    Dtype* y = top_data + n * dim;
+    // Sum the row shifted by its first element, which keeps the variance
+    // from cancelling out when the mean is large.
+    const Dtype shift = x[0];
+    Dtype sum = 0, sum_sq = 0;
+    for (int i = 0; i < dim; ++i) {
+      const Dtype centered = x[i] - shift;
+      sum += centered;
+      sum_sq += centered * centered;
+    }
+    const Dtype mean = shift + sum / dim;
+    Dtype scale = 1;
+    if (normalize_variance) {
+      const Dtype variance = std::max(Dtype(0),
+          (sum_sq - sum * sum / dim) / dim);
+      // the std, plus eps
+      variance_data[n] = std::sqrt(variance) + eps_;
+      scale = Dtype(1) / variance_data[n];
+    }
+    mean_data[n] = mean;
+    for (int i = 0; i < dim; ++i) {
+      y[i] = (x[i] - mean) * scale;
+    }
   }
 }
 
@@ -71,46 +79,42 @@ void MVN_NDLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<Blob<Dtype>*>& bottom) {
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* variance_data = variance_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-
-  if (this->layer_param_.mvn_param().normalize_variance()) {
-    caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1., bottom_diff,
-          sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, 1.,
-          mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          bottom_diff);
-    caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1., top_diff,
-            sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, 1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 1.,
-            bottom_diff);
-
-    caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff, Dtype(-1. / dim_),
-        bottom_diff);
-
-    // put the squares of bottom into temp_
-    caffe_powx(temp_.count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, 1.,
-        variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-        temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
-  } else {
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1. / dim_, top_diff,
-      sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_, dim_, 1, -1.,
-      mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-      temp_.mutable_cpu_data());
-    caffe_add(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
+  const bool normalize_variance =
+      this->layer_param_.mvn_param().normalize_variance();
+  const int dim = dim_;
+
+  // With y = (x - EX) / (std + eps),
+  // dx = (dy - E(dy) - y * E(dy * y)) / (std + eps); without the variance
+  // normalization, dx = dy - E(dy).
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int n = 0; n < num_; ++n) {
+    const Dtype* dy = top_diff + n * dim;
+    const Dtype* y = top_data + n * dim;
+    Dtype* dx = bottom_diff + n * dim;
+    Dtype sum_dy = 0, sum_dy_y = 0;
+    for (int i = 0; i < dim; ++i) {
+      sum_dy += dy[i];
+      sum_dy_y += dy[i] * y[i];
+    }
+    const Dtype mean_dy = sum_dy / dim;
+    if (normalize_variance) {
+      const Dtype mean_dy_y = sum_dy_y / dim;
+      const Dtype scale = Dtype(1) / variance_data[n];
+      for (int i = 0; i < dim; ++i) {
+        dx[i] = (dy[i] - mean_dy - y[i] * mean_dy_y) * scale;
+      }
+    } else {
+      for (int i = 0; i < dim; ++i) {
+        dx[i] = dy[i] - mean_dy;
+      }
+    }
   }
 }
 
-
 #ifdef CPU_ONLY
 STUB_GPU(MVN_NDLayer);
 #endif
@@ -10,6 +10,8 @@ void MVN_NDLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
+  caffe_gpu_set(sum_multiplier_.count(), Dtype(1),
+      sum_multiplier_.mutable_gpu_data());
 
   // subtract mean
   caffe_gpu_gemv<Dtype>(CblasNoTrans, num_, dim_, 1. / dim_, bottom_data,
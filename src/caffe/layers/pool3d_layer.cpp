@@ -30,242 +30,447 @@ using std::min;
 
 namespace caffe {
 
+// The CPU kernels below pool one (length x height x width) volume at a time,
+// so that the volumes can be spread over OpenMP threads. A volume interleaves
+// the given number of channels at every position: one for the
+// (num x channels) volumes of an NCDHW blob, all of them for the num volumes
+// of an NDHWC blob. Each output row first reduces the kernel_depth x
+// kernel_size input rows of its window into a single row of width * channels
+// elements -- contiguous, branch-free loops the compiler vectorizes -- and
+// then reduces that row along every window of the width axis.
+
+// Max pooling of one volume; records the offset of every winner in mask,
+// which is either max_idx_ (int) or the top mask (Dtype). The row pass only
+// keeps maxima; the winning row is looked up again once per window.
+template <typename Dtype, typename MaskType>
+static void max_pool3d_volume(const Dtype* bottom_data, const int channels,
+    const int length, const int height, const int width,
+    const int pooled_length, const int pooled_height, const int pooled_width,
+    const int kernel_size, const int kernel_depth, const int stride,
+    const int temporal_stride, Dtype* row_max, Dtype* top_data,
+    MaskType* mask) {
+  const int row_size = width * channels;
+  for (int pl = 0; pl < pooled_length; ++pl) {
+    const int lstart = pl * temporal_stride;
+    const int lend = min(lstart + kernel_depth, length);
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      const int hstart = ph * stride;
+      const int hend = min(hstart + kernel_size, height);
+      caffe_copy(row_size, bottom_data + (lstart * height + hstart)
+          * row_size, row_max);
+      for (int l = lstart; l < lend; ++l) {
+        for (int h = (l == lstart ? hstart + 1 : hstart); h < hend; ++h) {
+          const Dtype* row = bottom_data + (l * height + h) * row_size;
+          for (int i = 0; i < row_size; ++i) {
+            row_max[i] = max(row_max[i], row[i]);
+          }
+        }
+      }
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        const int wstart = pw * stride;
+        const int wend = min(wstart + kernel_size, width);
+        for (int c = 0; c < channels; ++c) {
+          int maxw = wstart;
+          for (int w = wstart + 1; w < wend; ++w) {
+            if (row_max[w * channels + c] > row_max[maxw * channels + c]) {
+              maxw = w;
+            }
+          }
+          const Dtype maxval = row_max[maxw * channels + c];
+          int maxidx = -1;
+          for (int l = lstart; l < lend && maxidx < 0; ++l) {
+            for (int h = hstart; h < hend; ++h) {
+              const int index = ((l * height + h) * width + maxw) * channels
+                  + c;
+              if (bottom_data[index] == maxval) {
+                maxidx = index;
+                break;
+              }
+            }
+          }
+          // Only a NaN can match nothing; keep the mask inside the window.
+          if (maxidx < 0) {
+            maxidx = ((lstart * height + hstart) * width + maxw) * channels
+                + c;
+          }
+          const int pool_index = ((pl * pooled_height + ph) * pooled_width
+              + pw) * channels + c;
+          top_data[pool_index] = maxval;
+          mask[pool_index] = static_cast<MaskType>(maxidx);
+        }
+      }
+    }
+  }
+}
+
+// Average pooling of one volume; windows count the padding they cover.
+template <typename Dtype>
+static void ave_pool3d_volume(const Dtype* bottom_data, const int channels,
+    const int length, const int height, const int width,
+    const int pooled_length, const int pooled_height, const int pooled_width,
+    const int kernel_size, const int kernel_depth, const int stride,
+    const int temporal_stride, const int pad, const int temporal_pad,
+    Dtype* row_sum, Dtype* top_data) {
+  const int row_size = width * channels;
+  for (int pl = 0; pl < pooled_length; ++pl) {
+    int lstart = pl * temporal_stride - temporal_pad;
+    int lend = min(lstart + kernel_depth, length + temporal_pad);
+    const int pool_length = lend - lstart;
+    lstart = max(lstart, 0);
+    lend = min(lend, length);
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      int hstart = ph * stride - pad;
+      int hend = min(hstart + kernel_size, height + pad);
+      const int pool_area = pool_length * (hend - hstart);
+      hstart = max(hstart, 0);
+      hend = min(hend, height);
+      caffe_set(row_size, Dtype(0), row_sum);
+      for (int l = lstart; l < lend; ++l) {
+        for (int h = hstart; h < hend; ++h) {
+          const Dtype* row = bottom_data + (l * height + h) * row_size;
+          for (int i = 0; i < row_size; ++i) {
+            row_sum[i] += row[i];
+          }
+        }
+      }
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        int wstart = pw * stride - pad;
+        int wend = min(wstart + kernel_size, width + pad);
+        const int pool_size = pool_area * (wend - wstart);
+        wstart = max(wstart, 0);
+        wend = min(wend, width);
+        Dtype* top = top_data + ((pl * pooled_height + ph) * pooled_width
+            + pw) * channels;
+        caffe_set(channels, Dtype(0), top);
+        for (int w = wstart; w < wend; ++w) {
+          for (int c = 0; c < channels; ++c) {
+            top[c] += row_sum[w * channels + c];
+          }
+        }
+        for (int c = 0; c < channels; ++c) {
+          top[c] /= pool_size;
+        }
+      }
+    }
+  }
+}
+
+// The gradient of ave_pool3d_volume: spreads every window's share of its
+// top diff over a row, then adds the row to every input row of the window.
+template <typename Dtype>
+static void ave_unpool3d_volume(const Dtype* top_diff, const int channels,
+    const int length, const int height, const int width,
+    const int pooled_length, const int pooled_height, const int pooled_width,
+    const int kernel_size, const int kernel_depth, const int stride,
+    const int temporal_stride, const int pad, const int temporal_pad,
+    Dtype* row_diff, Dtype* bottom_diff) {
+  const int row_size = width * channels;
+  for (int pl = 0; pl < pooled_length; ++pl) {
+    int lstart = pl * temporal_stride - temporal_pad;
+    int lend = min(lstart + kernel_depth, length + temporal_pad);
+    const int pool_length = lend - lstart;
+    lstart = max(lstart, 0);
+    lend = min(lend, length);
+    for (int ph = 0; ph < pooled_height; ++ph) {
+      int hstart = ph * stride - pad;
+      int hend = min(hstart + kernel_size, height + pad);
+      const int pool_area = pool_length * (hend - hstart);
+      hstart = max(hstart, 0);
+      hend = min(hend, height);
+      caffe_set(row_size, Dtype(0), row_diff);
+      for (int pw = 0; pw < pooled_width; ++pw) {
+        int wstart = pw * stride - pad;
+        int wend = min(wstart + kernel_size, width + pad);
+        const int pool_size = pool_area * (wend - wstart);
+        const Dtype* top = top_diff + ((pl * pooled_height + ph)
+            * pooled_width + pw) * channels;
+        wstart = max(wstart, 0);
+        wend = min(wend, width);
+        for (int w = wstart; w < wend; ++w) {
+          for (int c = 0; c < channels; ++c) {
+            row_diff[w * channels + c] += top[c] / pool_size;
+          }
+        }
+      }
+      for (int l = lstart; l < lend; ++l) {
+        for (int h = hstart; h < hend; ++h) {
+          Dtype* row = bottom_diff + (l * height + h) * row_size;
+          for (int i = 0; i < row_size; ++i) {
+            row[i] += row_diff[i];
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void Pooling3DLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(bottom.size(), 1) << "Pooling3DLayer takes a single blob as input.";
-  CHECK_EQ(top.size(), 1) << "Pooling3DLayer takes a single blob as output.";
-  kernel_size_ = this->layer_param_.pooling3d_param().kernel_size();
-  kernel_depth_ = this->layer_param_.pooling3d_param().kernel_depth();
-  stride_ = this->layer_param_.pooling3d_param().stride();
-  temporal_stride_ = this->layer_param_.pooling3d_param().temporal_stride();
-  pad_ = this->layer_param_.pooling3d_param().pad();
-  if (pad_ != 0) {
-    CHECK_EQ(this->layer_param_.pooling3d_param().pool(),
-             Pooling3DParameter_PoolMethod_AVE)
+  const Pooling3DParameter& pool_param =
+      this->layer_param_.pooling3d_param();
+  global_pooling_ = pool_param.global_pooling();
+  if (global_pooling_) {
+    CHECK(!(pool_param.has_kernel_size() || pool_param.has_kernel_depth()))
+        << "With global_pooling: true kernel size cannot be specified";
+    CHECK(pool_param.stride() == 1 && pool_param.temporal_stride() == 1
+        && pool_param.pad() == 0 && pool_param.temporal_pad() == 0)
+        << "With global_pooling: true; only pad = 0 and stride = 1";
+  }
+  kernel_size_ = pool_param.kernel_size();
+  kernel_depth_ = pool_param.kernel_depth();
+  stride_ = pool_param.stride();
+  temporal_stride_ = pool_param.temporal_stride();
+  pad_ = pool_param.pad();
+  temporal_pad_ = pool_param.temporal_pad();
+  ndhwc_ = pool_param.layout() == NDHWC;
+  if (pad_ != 0 || temporal_pad_ != 0) {
+    CHECK_EQ(pool_param.pool(), Pooling3DParameter_PoolMethod_AVE)
         << "Padding implemented only for average pooling.";
+    CHECK_LT(pad_, kernel_size_);
+    CHECK_LT(temporal_pad_, kernel_depth_);
   }
-
-  vector<int> bottom_shape = bottom[0]->shape();
-  channels_ = bottom_shape[1];
-  length_ = bottom_shape[2];
-  height_ = bottom_shape[3];
-  width_ = bottom_shape[4];
-  pooled_height_ = static_cast<int>(ceil(static_cast<float>(
-      height_ + 2 * pad_ - kernel_size_) / stride_)) + 1;
-  pooled_width_ = static_cast<int>(ceil(static_cast<float>(
-      width_ + 2 * pad_ - kernel_size_) / stride_)) + 1;
-  pooled_length_ = static_cast<int>(ceil(static_cast<float>(
-	      length_ - kernel_depth_) / temporal_stride_)) + 1;
 }
 
 template <typename Dtype>
-void Pooling3DLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom, const vector<Blob<Dtype> *> &top)
-{
-    CHECK_EQ(5, bottom[0]->num_axes()) << "Input must have 5 axes, "
-                                       << "corresponding to (num, channels, length, height, width)";
-    int num = bottom[0]->shape()[0];
-    int vv[5] = {num, channels_, pooled_length_, pooled_height_, pooled_width_};
-    vector<int> top_shape(vv, vv+5);
-    top[0]->Reshape(top_shape);
-
-    // If stochastic pooling, we will initialize the random index part.
-    if (this->layer_param_.pooling3d_param().pool() ==
-        Pooling3DParameter_PoolMethod_STOCHASTIC) {
-      rand_idx_.Reshape(top_shape);
+void Pooling3DLayer<Dtype>::Reshape(const vector<Blob<Dtype> *> &bottom,
+      const vector<Blob<Dtype> *> &top) {
+  CHECK_EQ(5, bottom[0]->num_axes()) << "Input must have 5 axes, "
+      << "corresponding to (num, channels, length, height, width)";
+  channels_ = bottom[0]->shape(ndhwc_ ? 4 : 1);
+  length_ = bottom[0]->shape(ndhwc_ ? 1 : 2);
+  height_ = bottom[0]->shape(ndhwc_ ? 2 : 3);
+  width_ = bottom[0]->shape(ndhwc_ ? 3 : 4);
+  if (global_pooling_) {
+    // Windows are clipped to the volume, so a square kernel as large as
+    // the larger side covers non-square frames as well.
+    kernel_depth_ = length_;
+    kernel_size_ = max(height_, width_);
+    pooled_length_ = pooled_height_ = pooled_width_ = 1;
+  } else {
+    CHECK_GT(kernel_size_, 0) << "Filter dimensions cannot be zero.";
+    CHECK_GT(kernel_depth_, 0) << "Filter dimensions cannot be zero.";
+    pooled_height_ = static_cast<int>(ceil(static_cast<float>(
+        height_ + 2 * pad_ - kernel_size_) / stride_)) + 1;
+    pooled_width_ = static_cast<int>(ceil(static_cast<float>(
+        width_ + 2 * pad_ - kernel_size_) / stride_)) + 1;
+    pooled_length_ = static_cast<int>(ceil(static_cast<float>(
+        length_ + 2 * temporal_pad_ - kernel_depth_) / temporal_stride_)) + 1;
+    // If we have padding, ensure that the last pooling starts strictly
+    // inside the volume (instead of at the padding); otherwise clip the
+    // last.
+    if (pad_) {
+      if ((pooled_height_ - 1) * stride_ >= height_ + pad_) {
+        --pooled_height_;
+      }
+      if ((pooled_width_ - 1) * stride_ >= width_ + pad_) {
+        --pooled_width_;
+      }
     }
+    if (temporal_pad_ && (pooled_length_ - 1) * temporal_stride_
+        >= length_ + temporal_pad_) {
+      --pooled_length_;
+    }
+  }
+  int vv[5] = {bottom[0]->shape(0), channels_, pooled_length_,
+      pooled_height_, pooled_width_};
+  if (ndhwc_) {
+    int ndhwc_shape[5] = {bottom[0]->shape(0), pooled_length_,
+        pooled_height_, pooled_width_, channels_};
+    std::copy(ndhwc_shape, ndhwc_shape + 5, vv);
+  }
+  vector<int> top_shape(vv, vv+5);
+  top[0]->Reshape(top_shape);
+  if (top.size() > 1) {
+    top[1]->ReshapeLike(*top[0]);
+  }
+  // If max pooling, we will initialize the vector index part.
+  if (this->layer_param_.pooling3d_param().pool() ==
+      Pooling3DParameter_PoolMethod_MAX && top.size() == 1) {
+    max_idx_.Reshape(top_shape);
+  }
+  // If stochastic pooling, we will initialize the random index part.
+  if (this->layer_param_.pooling3d_param().pool() ==
+      Pooling3DParameter_PoolMethod_STOCHASTIC) {
+    rand_idx_.Reshape(top_shape);
+  }
 }
 
 template <typename Dtype>
 void Pooling3DLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-	  const Dtype* bottom_data = bottom[0]->cpu_data();
-      Dtype* top_data = top[0]->mutable_cpu_data();
-	  // Different pooling methods. We explicitly do the switch outside the for
-	  // loop to save time, although this results in more codes.
-      int top_count = top[0]->count();
-      switch (this->layer_param_.pooling3d_param().pool()) {
-      case Pooling3DParameter_PoolMethod_MAX:
-	    // Initialize
-	    for (int i = 0; i < top_count; ++i) {
-	      top_data[i] = -FLT_MAX;
-	    }
-	    // The main loop
-	    for (int n = 0; n < bottom[0]->num(); ++n) {
-	      for (int c = 0; c < channels_; ++c) {
-	    	for (int pl = 0; pl < pooled_length_; ++pl) {
-	          for (int ph = 0; ph < pooled_height_; ++ph) {
-	            for (int pw = 0; pw < pooled_width_; ++pw) {
-	              int hstart = ph * stride_;
-	              int wstart = pw * stride_;
-	              int lstart = pl * temporal_stride_;
-	              int hend = min(hstart + kernel_size_, height_);
-	              int wend = min(wstart + kernel_size_, width_);
-	              int lend = min(lstart + kernel_depth_, length_);
-                  const int pool_index = (pl * pooled_height_ + ph) * pooled_width_ + pw;
-	              for (int l = lstart; l < lend; ++l) {
-	                for (int h = hstart; h < hend; ++h) {
-	                  for (int w = wstart; w < wend; ++w) {
-                          const int index = (l * height_ + h) * width_ + w;
-                          if (bottom_data[index] > top_data[pool_index])
-                              top_data[pool_index] = bottom_data[index];
-	                  }
-	                }
-	              }
-	            }
-	          }
-	    	}
-	        // compute offset
-	        bottom_data += bottom[0]->offset(0, 1);
-            top_data += top[0]->offset(0, 1);
-	      }
-	    }
-	    break;
-      case Pooling3DParameter_PoolMethod_AVE:
-	    for (int i = 0; i < top_count; ++i) {
-	      top_data[i] = 0;
-	    }
-	    // The main loop
-	    for (int n = 0; n < bottom[0]->num(); ++n) {
-	      for (int c = 0; c < channels_; ++c) {
-	    	for (int pl = 0; pl < pooled_length_; ++pl) {
-	          for (int ph = 0; ph < pooled_height_; ++ph) {
-	            for (int pw = 0; pw < pooled_width_; ++pw) {
-	              int hstart = ph * stride_ - pad_;
-	              int wstart = pw * stride_ - pad_;
-	              int lstart = pl * temporal_stride_;
-	              int hend = min(hstart + kernel_size_, height_ + pad_);
-	              int wend = min(wstart + kernel_size_, width_ + pad_);
-	              int lend = min(lstart + kernel_depth_, length_);
-	              int pool_size = (hend - hstart) * (wend - wstart) * (lend - lstart);
-	              hstart = max(hstart, 0);
-	              wstart = max(wstart, 0);
-
-	              hend = min(hend, height_);
-	              wend = min(wend, width_);
-	              lend = min(lend, length_);
-	              for (int l = lstart; l < lend; ++l) {
-	                for (int h = hstart; h < hend; ++h) {
-	                  for (int w = wstart; w < wend; ++w) {
-	                    top_data[(pl * pooled_height_ + ph) * pooled_width_ + pw] +=
-	                        bottom_data[(l * height_ + h) * width_ + w];
-	                  }
-	                }
-	              }
-	              top_data[(pl * pooled_height_ + ph) * pooled_width_ + pw] /= pool_size;
-	            }
-	          }
-	    	}
-	        // compute offset
-	        bottom_data += bottom[0]->offset(0, 1);
-            top_data += top[0]->offset(0, 1);
-	      }
-	    }
-	    break;
-      case Pooling3DParameter_PoolMethod_STOCHASTIC:
-	    NOT_IMPLEMENTED;
-	    break;
-	  default:
-	    LOG(FATAL) << "Unknown pooling method.";
-	  }
-
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  // Blob::offset only handles 4 axes, so step over the 5-D volumes by hand:
+  // an NDHWC sample is a single volume interleaving all the channels.
+  const int inner = ndhwc_ ? channels_ : 1;
+  const int volumes = ndhwc_ ? bottom[0]->shape(0) : bottom[0]->count(0, 2);
+  const int volume_size = bottom[0]->count() / volumes;
+  const int pooled_volume_size = top[0]->count() / volumes;
+  // We'll output the mask to top[1] if it's of size >1.
+  const bool use_top_mask = top.size() > 1;
+  int* mask = NULL;  // suppress warnings about uninitialized variables
+  Dtype* top_mask = NULL;
+  // Different pooling methods. We explicitly do the switch outside the for
+  // loop to save time, although this results in more codes.
+  switch (this->layer_param_.pooling3d_param().pool()) {
+  case Pooling3DParameter_PoolMethod_MAX:
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_cpu_data();
+    } else {
+      mask = max_idx_.mutable_cpu_data();
+    }
+    if (global_pooling_) {
+      // One sweep over every volume.
+#ifdef _OPENMP
+      #pragma omp parallel for
+#endif
+      for (int v = 0; v < volumes; ++v) {
+        const Dtype* volume = bottom_data + v * volume_size;
+        for (int c = 0; c < inner; ++c) {
+          int maxidx = c;
+          for (int i = c + inner; i < volume_size; i += inner) {
+            if (volume[i] > volume[maxidx]) {
+              maxidx = i;
+            }
+          }
+          top_data[v * inner + c] = volume[maxidx];
+          if (use_top_mask) {
+            top_mask[v * inner + c] = static_cast<Dtype>(maxidx);
+          } else {
+            mask[v * inner + c] = maxidx;
+          }
+        }
+      }
+      break;
+    }
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int v = 0; v < volumes; ++v) {
+      vector<Dtype> row_max(width_ * inner);
+      if (use_top_mask) {
+        max_pool3d_volume(bottom_data + v * volume_size, inner, length_,
+            height_, width_, pooled_length_, pooled_height_, pooled_width_,
+            kernel_size_, kernel_depth_, stride_, temporal_stride_,
+            &row_max[0], top_data + v * pooled_volume_size,
+            top_mask + v * pooled_volume_size);
+      } else {
+        max_pool3d_volume(bottom_data + v * volume_size, inner, length_,
+            height_, width_, pooled_length_, pooled_height_, pooled_width_,
+            kernel_size_, kernel_depth_, stride_, temporal_stride_,
+            &row_max[0], top_data + v * pooled_volume_size,
+            mask + v * pooled_volume_size);
+      }
+    }
+    break;
+  case Pooling3DParameter_PoolMethod_AVE:
+    if (global_pooling_) {
+#ifdef _OPENMP
+      #pragma omp parallel for
+#endif
+      for (int v = 0; v < volumes; ++v) {
+        const Dtype* volume = bottom_data + v * volume_size;
+        Dtype* top = top_data + v * inner;
+        caffe_set(inner, Dtype(0), top);
+        for (int i = 0; i < volume_size; i += inner) {
+          for (int c = 0; c < inner; ++c) {
+            top[c] += volume[i + c];
+          }
+        }
+        for (int c = 0; c < inner; ++c) {
+          top[c] /= volume_size / inner;
+        }
+      }
+      break;
+    }
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int v = 0; v < volumes; ++v) {
+      vector<Dtype> row_sum(width_ * inner);
+      ave_pool3d_volume(bottom_data + v * volume_size, inner, length_,
+          height_, width_, pooled_length_, pooled_height_, pooled_width_,
+          kernel_size_, kernel_depth_, stride_, temporal_stride_, pad_,
+          temporal_pad_, &row_sum[0], top_data + v * pooled_volume_size);
+    }
+    break;
+  case Pooling3DParameter_PoolMethod_STOCHASTIC:
+    NOT_IMPLEMENTED;
+    break;
+  default:
+    LOG(FATAL) << "Unknown pooling method.";
+  }
 }
 
 template <typename Dtype>
 void Pooling3DLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-    if (!propagate_down[0]) {
-        return;
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int inner = ndhwc_ ? channels_ : 1;
+  const int volumes = ndhwc_ ? bottom[0]->shape(0) : bottom[0]->count(0, 2);
+  const int volume_size = bottom[0]->count() / volumes;
+  const int pooled_volume_size = top[0]->count() / volumes;
+  // We'll read the mask from top[1] if it's of size >1.
+  const bool use_top_mask = top.size() > 1;
+  const int* mask = NULL;  // suppress warnings about uninitialized variables
+  const Dtype* top_mask = NULL;
+  switch (this->layer_param_.pooling3d_param().pool()) {
+  case Pooling3DParameter_PoolMethod_MAX:
+    // The mask recorded by the forward pass names the single winner of
+    // every window, so the gradient is one scatter over the top.
+    if (use_top_mask) {
+      top_mask = top[1]->cpu_data();
+    } else {
+      mask = max_idx_.cpu_data();
     }
-    const Dtype* top_diff = top[0]->cpu_diff();
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    // Different pooling methods. We explicitly do the switch outside the for
-    // loop to save time, although this results in more codes.
-    memset(bottom_diff, 0, bottom[0]->count() * sizeof(Dtype));
-    switch (this->layer_param_.pooling3d_param().pool()) {
-    case Pooling3DParameter_PoolMethod_MAX:
-        // The main loop
-        for (int n = 0; n < top[0]->num(); ++n) {
-            for (int c = 0; c < channels_; ++c) {
-                for (int pl = 0; pl < pooled_length_; ++pl) {
-                    for (int ph = 0; ph < pooled_height_; ++ph) {
-                        for (int pw = 0; pw < pooled_width_; ++pw) {
-                            int hstart = ph * stride_;
-                            int wstart = pw * stride_;
-                            int lstart = pl * temporal_stride_;
-                            int hend = min(hstart + kernel_size_, height_);
-                            int wend = min(wstart + kernel_size_, width_);
-                            int lend = min(lstart + kernel_depth_, length_);
-
-                            const int top_index = (pl * pooled_height_ + ph) * pooled_width_ + pw;
-                            for (int l = lstart; l < lend; ++l) {
-                                for (int h = hstart; h < hend; ++h) {
-                                    for (int w = wstart; w < wend; ++w) {
-                                        const int bottom_index = (l * height_ + h) * width_ + w;
-                                        bottom_diff[bottom_index] +=
-                                                top_diff[top_index] *
-                                                (bottom_data[bottom_index] == top_data[top_index]);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                // offset
-                bottom_data += bottom[0]->offset(0, 1);
-                top_data += top[0]->offset(0, 1);
-                bottom_diff += bottom[0]->offset(0, 1);
-                top_diff += top[0]->offset(0, 1);
-            }
-        }
-        break;
-    case Pooling3DParameter_PoolMethod_AVE:
-        // The main loop
-        for (int n = 0; n < top[0]->num(); ++n) {
-            for (int c = 0; c < channels_; ++c) {
-                for (int pl = 0; pl < pooled_length_; ++pl) {
-                    for (int ph = 0; ph < pooled_height_; ++ph) {
-                        for (int pw = 0; pw < pooled_width_; ++pw) {
-                            int hstart = ph * stride_ - pad_;
-                            int wstart = pw * stride_ - pad_;
-                            int lstart = pl * temporal_stride_;
-                            int hend = min(hstart + kernel_size_, height_ + pad_);
-                            int wend = min(wstart + kernel_size_, width_ + pad_);
-                            int lend = min(lstart + kernel_depth_, length_);
-                            int pool_size = (hend - hstart) * (wend - wstart) * (lend - lstart);
-                            hstart = max(hstart, 0);
-                            wstart = max(wstart, 0);
-                            hend = min(hend, height_);
-                            wend = min(wend, width_);
-                            lend = min(lend, length_);
-                            for (int l = lstart; l < lend; ++l) {
-                                for (int h = hstart; h < hend; ++h) {
-                                    for (int w = wstart; w < wend; ++w) {
-                                        bottom_diff[(l * height_ + h) * width_ + w] +=
-                                                top_diff[(pl * pooled_height_ + ph) * pooled_width_ + pw] / pool_size;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-                // offset
-                bottom_data += bottom[0]->offset(0, 1);
-                top_data += top[0]->offset(0, 1);
-                bottom_diff += bottom[0]->offset(0, 1);
-                top_diff += top[0]->offset(0, 1);
-            }
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int v = 0; v < volumes; ++v) {
+      Dtype* volume_diff = bottom_diff + v * volume_size;
+      caffe_set(volume_size, Dtype(0), volume_diff);
+      for (int i = v * pooled_volume_size; i < (v + 1) * pooled_volume_size;
+          ++i) {
+        const int bottom_index =
+            use_top_mask ? static_cast<int>(top_mask[i]) : mask[i];
+        volume_diff[bottom_index] += top_diff[i];
+      }
+    }
+    break;
+  case Pooling3DParameter_PoolMethod_AVE:
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int v = 0; v < volumes; ++v) {
+      Dtype* volume_diff = bottom_diff + v * volume_size;
+      if (global_pooling_) {
+        for (int i = 0; i < volume_size; i += inner) {
+          for (int c = 0; c < inner; ++c) {
+            volume_diff[i + c] = top_diff[v * inner + c]
+                / (volume_size / inner);
+          }
         }
-        break;
-    case Pooling3DParameter_PoolMethod_STOCHASTIC:
-        NOT_IMPLEMENTED;
-        break;
-    default:
-        LOG(FATAL) << "Unknown pooling method.";
+        continue;
+      }
+      vector<Dtype> row_diff(width_ * inner);
+      caffe_set(volume_size, Dtype(0), volume_diff);
+      ave_unpool3d_volume(top_diff + v * pooled_volume_size, inner, length_,
+          height_, width_, pooled_length_, pooled_height_, pooled_width_,
+          kernel_size_, kernel_depth_, stride_, temporal_stride_, pad_,
+          temporal_pad_, &row_diff[0], volume_diff);
     }
-
+    break;
+  case Pooling3DParameter_PoolMethod_STOCHASTIC:
+    NOT_IMPLEMENTED;
+    break;
+  default:
+    LOG(FATAL) << "Unknown pooling method.";
+  }
 }
 
 #ifdef CPU_ONLY
@@ -31,7 +31,8 @@ template <typename Dtype>
 __global__ void MaxPoolForward(const int nthreads, const Dtype* bottom_data,
     const int num, const int channels, const int length, const int height,
     const int width, const int pooled_length, const int pooled_height, const int pooled_width,
-    const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, Dtype* top_data) {
+    const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, Dtype* top_data,
+    int* mask, Dtype* top_mask) {
   CUDA_KERNEL_LOOP(index, nthreads) {
     int pw = index % pooled_width;
     int ph = (index / pooled_width) % pooled_height;
@@ -45,15 +46,24 @@ __global__ void MaxPoolForward(const int nthreads, const Dtype* bottom_data,
     int lstart = pl * temporal_stride;
     int lend = min(lstart + kernel_depth, length);
     Dtype maxval = -FLT_MAX;
+    int maxidx = -1;
     bottom_data += (n * channels + c) * length * height * width;
     for (int l = lstart; l < lend; ++l) {
       for (int h = hstart; h < hend; ++h) {
         for (int w = wstart; w < wend; ++w) {
-          maxval = max(maxval, bottom_data[(l * height + h) * width + w]);
+          if (bottom_data[(l * height + h) * width + w] > maxval) {
+            maxidx = (l * height + h) * width + w;
+            maxval = bottom_data[maxidx];
+          }
         }
       }
     }
     top_data[index] = maxval;
+    if (mask) {
+      mask[index] = maxidx;
+    } else {
+      top_mask[index] = maxidx;
+    }
 
   }
 }
@@ -62,7 +72,8 @@ template <typename Dtype>
 __global__ void AvePoolForward(const int nthreads, const Dtype* bottom_data,
     const int num, const int channels, const int length, const int height,
     const int width, const int pooled_length, const int pooled_height, const int pooled_width,
-    const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, const int pad, Dtype* top_data) {
+    const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, const int pad,
+    const int temporal_pad, Dtype* top_data) {
   CUDA_KERNEL_LOOP(index, nthreads) {
     int pw = index % pooled_width;
     int ph = (index / pooled_width) % pooled_height;
@@ -71,13 +82,14 @@ __global__ void AvePoolForward(const int nthreads, const Dtype* bottom_data,
     int n = index / pooled_width / pooled_height / pooled_length / channels;
     int hstart = ph * stride - pad;
     int wstart = pw * stride - pad;
-    int lstart = pl * temporal_stride;
+    int lstart = pl * temporal_stride - temporal_pad;
     int hend = min(hstart + kernel_size, height + pad);
     int wend = min(wstart + kernel_size, width + pad);
-    int lend = min(lstart + kernel_depth, length);
+    int lend = min(lstart + kernel_depth, length + temporal_pad);
     int pool_size = (hend - hstart) * (wend - wstart) * (lend - lstart);
     hstart = max(hstart, 0);
     wstart = max(wstart, 0);
+    lstart = max(lstart, 0);
     hend = min(hend, height);
     wend = min(wend, width);
     lend = min(lend, length);
@@ -99,23 +111,36 @@ __global__ void AvePoolForward(const int nthreads, const Dtype* bottom_data,
 template <typename Dtype>
 void Pooling3DLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (ndhwc_) {
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   int count = top[0]->count();
+  // We'll output the mask to top[1] if it's of size >1.
+  const bool use_top_mask = top.size() > 1;
+  int* mask = NULL;
+  Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling3d_param().pool()) {
   case Pooling3DParameter_PoolMethod_MAX:
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_gpu_data();
+    } else {
+      mask = max_idx_.mutable_gpu_data();
+    }
     // NOLINT_NEXT_LINE(whitespace/operators)
     MaxPoolForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
         count, bottom_data, bottom[0]->shape(0), channels_, length_,
         height_, width_, pooled_length_, pooled_height_, pooled_width_, kernel_size_, kernel_depth_,
-        stride_, temporal_stride_, top_data);
+        stride_, temporal_stride_, top_data, mask, top_mask);
     break;
   case Pooling3DParameter_PoolMethod_AVE:
     // NOLINT_NEXT_LINE(whitespace/operators)
     AvePoolForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
         count, bottom_data, bottom[0]->shape(0), channels_, length_,
         height_, width_, pooled_length_, pooled_height_, pooled_width_, kernel_size_, kernel_depth_,
-        stride_, temporal_stride_, pad_, top_data);
+        stride_, temporal_stride_, pad_, temporal_pad_, top_data);
     break;
   case Pooling3DParameter_PoolMethod_STOCHASTIC:
     // NOT IMPLEMENTED YET
@@ -127,8 +152,8 @@ void Pooling3DLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-__global__ void MaxPoolBackward(const int nthreads, const Dtype* bottom_data,
-    const Dtype* top_data, const Dtype* top_diff,
+__global__ void MaxPoolBackward(const int nthreads, const Dtype* top_diff,
+    const int* mask, const Dtype* top_mask,
     const int num, const int channels, const int length, const int height,
     const int width, const int pooled_length, const int pooled_height, const int pooled_width,
     const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, Dtype* bottom_diff) {
@@ -140,24 +165,41 @@ __global__ void MaxPoolBackward(const int nthreads, const Dtype* bottom_data,
     int l = (index / width / height) % length;
     int c = (index / width / height / length) % channels;
     int n = index / width / height / length / channels;
-    
+
     int phstart = (h < kernel_size) ? 0 : (h - kernel_size) / stride + 1;
     int phend = min(h / stride + 1, pooled_height);
     int pwstart = (w < kernel_size) ? 0 : (w - kernel_size) / stride + 1;
     int pwend = min(w / stride + 1, pooled_width);
     int plstart = (l < kernel_depth) ? 0 : (l - kernel_depth) / temporal_stride + 1;
     int plend = min(l / temporal_stride + 1, pooled_length);
-    
+
     Dtype gradient = 0;
-    Dtype bottom_datum =
-        bottom_data[(((n * channels + c) * length + l) * height + h) * width + w];
-    top_data += (n * channels + c) * pooled_length * pooled_height * pooled_width;
-    top_diff += (n * channels + c) * pooled_length * pooled_height * pooled_width;
-    for (int pl = plstart; pl < plend; ++pl) {
-      for (int ph = phstart; ph < phend; ++ph) {
-        for (int pw = pwstart; pw < pwend; ++pw) {
-          gradient += top_diff[(pl * pooled_height + ph) * pooled_width + pw] *
-              (bottom_datum == top_data[(pl * pooled_height + ph) * pooled_width + pw]);
+    const int bottom_offset = (l * height + h) * width + w;
+    const int top_offset =
+        (n * channels + c) * pooled_length * pooled_height * pooled_width;
+    top_diff += top_offset;
+    if (mask) {
+      mask += top_offset;
+      for (int pl = plstart; pl < plend; ++pl) {
+        for (int ph = phstart; ph < phend; ++ph) {
+          for (int pw = pwstart; pw < pwend; ++pw) {
+            const int top_index = (pl * pooled_height + ph) * pooled_width + pw;
+            if (mask[top_index] == bottom_offset) {
+              gradient += top_diff[top_index];
+            }
+          }
+        }
+      }
+    } else {
+      top_mask += top_offset;
+      for (int pl = plstart; pl < plend; ++pl) {
+        for (int ph = phstart; ph < phend; ++ph) {
+          for (int pw = pwstart; pw < pwend; ++pw) {
+            const int top_index = (pl * pooled_height + ph) * pooled_width + pw;
+            if (top_mask[top_index] == bottom_offset) {
+              gradient += top_diff[top_index];
+            }
+          }
         }
       }
     }
@@ -171,13 +213,13 @@ __global__ void AvePoolBackward(const int nthreads, const Dtype* top_diff,
     const int num, const int channels, const int length, const int height,
     const int width, const int pooled_length, const int pooled_height, const int pooled_width,
     const int kernel_size, const int kernel_depth, const int stride, const int temporal_stride, const int pad,
-    Dtype* bottom_diff) {
+    const int temporal_pad, Dtype* bottom_diff) {
   CUDA_KERNEL_LOOP(index, nthreads) {
     // find out the local index
     // find out the local offset
     int w = index % width + pad;
     int h = (index / width) % height + pad;
-    int l = (index / width / height) % length;
+    int l = (index / width / height) % length + temporal_pad;
     int c = (index / width / height / length) % channels;
     int n = index / width / height / length / channels;
     int phstart = (h < kernel_size) ? 0 : (h - kernel_size) / stride + 1;
@@ -195,10 +237,10 @@ __global__ void AvePoolBackward(const int nthreads, const Dtype* top_diff,
           // figure out the pooling size
           int hstart = ph * stride - pad;
           int wstart = pw * stride - pad;
-          int lstart = pl * temporal_stride;
+          int lstart = pl * temporal_stride - temporal_pad;
           int hend = min(hstart + kernel_size, height + pad);
           int wend = min(wstart + kernel_size, width + pad);
-          int lend = min(lstart + kernel_depth, length);
+          int lend = min(lstart + kernel_depth, length + temporal_pad);
           int pool_size = (hend - hstart) * (wend - wstart) * (lend - lstart);
           gradient += top_diff[(pl * pooled_height + ph) * pooled_width + pw] / pool_size;
         }
@@ -214,14 +256,27 @@ void Pooling3DLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
+  if (ndhwc_) {
+    Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
   const Dtype* top_diff = top[0]->gpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
   int count = bottom[0]->count();
+  // We'll read the mask from top[1] if it's of size >1.
+  const bool use_top_mask = top.size() > 1;
+  const int* mask = NULL;
+  const Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling3d_param().pool()) {
   case Pooling3DParameter_PoolMethod_MAX:
+    if (use_top_mask) {
+      top_mask = top[1]->gpu_data();
+    } else {
+      mask = max_idx_.gpu_data();
+    }
     // NOLINT_NEXT_LINE(whitespace/operators)
     MaxPoolBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
-        count, bottom[0]->gpu_data(), top[0]->gpu_data(), top_diff,
+        count, top_diff, mask, top_mask,
         top[0]->shape(0), channels_, length_, height_, width_, pooled_length_, pooled_height_,
         pooled_width_, kernel_size_, kernel_depth_, stride_, temporal_stride_, bottom_diff);
     break;
@@ -230,7 +285,7 @@ void Pooling3DLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     AvePoolBackward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
         count, top_diff, top[0]->shape(0), channels_, length_,
         height_, width_, pooled_length_, pooled_height_, pooled_width_, kernel_size_, kernel_depth_, 
-        stride_, temporal_stride_, pad_, bottom_diff);
+        stride_, temporal_stride_, pad_, temporal_pad_, bottom_diff);
     break;
   case Pooling3DParameter_PoolMethod_STOCHASTIC:
     // NOT IMPLEMENTED YET
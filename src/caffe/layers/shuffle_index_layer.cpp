@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/shuffle_index_layer.hpp"
@@ -13,6 +14,12 @@ void ShuffleIndexLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype> *> &bottom,
         new_axes_.push_back(this->layer_param_.shuffle_index_param().new_index(i));
     CHECK_EQ(new_axes_.size(), bottom[0]->num_axes())
             << "New index should have same dimensions as input blob dimension.";
+    vector<bool> used(new_axes_.size(), false);
+    for (int i = 0; i < new_axes_.size(); i++) {
+        CHECK(new_axes_[i] >= 0 && new_axes_[i] < new_axes_.size() && !used[new_axes_[i]])
+                << "New index should be a permutation of the input axes.";
+        used[new_axes_[i]] = true;
+    }
 }
 
 template<typename Dtype>
@@ -26,43 +33,122 @@ void ShuffleIndexLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
     CHECK_EQ(bottom[0]->count(), top[0]->count())
             << "Input and output blob shold have same number of elements.";
+
+    // top axis i runs along bottom axis new_axes_[i], and the other way round
+    const int num_axes = new_axes_.size();
+    vector<int> forward_in_strides(num_axes), backward_in_strides(num_axes);
+    vector<int> bottom_shape(bottom[0]->shape());
+    for (int i = 0; i < num_axes; i++) {
+        forward_in_strides[i] = bottom[0]->count(new_axes_[i] + 1);
+        backward_in_strides[new_axes_[i]] = top[0]->count(i + 1);
+    }
+    CompilePermutation(new_shape, forward_in_strides, &forward_shape_,
+                       &forward_strides_);
+    CompilePermutation(bottom_shape, backward_in_strides, &backward_shape_,
+                       &backward_strides_);
 }
 
 template<typename Dtype>
-vector<int> ShuffleIndexLayer<Dtype>::ConvertIndex2VectorIndex(const vector<int>& blob_shape,
-                                                               const int blob_count, const int index)
-{
-    int index_cnt = index;
-    int num_axes = blob_shape.size();
-    vector<int> vec_index(num_axes);
-    for(int i = num_axes-1; i >= 0; i--) {
-        vec_index[i] = index_cnt % blob_shape[i];
-        index_cnt /= blob_shape[i];
+void ShuffleIndexLayer<Dtype>::CompilePermutation(const vector<int>& out_shape,
+                                                  const vector<int>& in_strides,
+                                                  vector<int>* shape,
+                                                  vector<int>* strides) {
+    shape->clear();
+    strides->clear();
+    for (int i = 0; i < out_shape.size(); i++) {
+        if (out_shape[i] == 1)
+            continue;
+        // the axis follows the previous one in the input as well
+        if (!shape->empty() && strides->back() == in_strides[i] * out_shape[i]) {
+            shape->back() *= out_shape[i];
+            strides->back() = in_strides[i];
+        } else {
+            shape->push_back(out_shape[i]);
+            strides->push_back(in_strides[i]);
+        }
     }
-    return vec_index;
 }
 
 template<typename Dtype>
-void ShuffleIndexLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-                                           const vector<Blob<Dtype>*>& top) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    Dtype* top_data = top[0]->mutable_cpu_data();
-    int bottom_count = bottom[0]->count();
-    vector<int> bottom_shape = bottom[0]->shape();
+void ShuffleIndexLayer<Dtype>::Permute(const vector<int>& shape,
+                                       const vector<int>& strides,
+                                       const Dtype* in, Dtype* out) {
+    const int num_axes = shape.size();
+    int count = 1;
+    for (int i = 0; i < num_axes; i++)
+        count *= shape[i];
+    // a single merged axis is read in order
+    if (num_axes <= 1) {
+        caffe_copy(count, in, out);
+        return;
+    }
+    const int last = num_axes - 1;
+    vector<int> out_strides(num_axes, 1);
+    for (int i = last - 1; i >= 0; i--)
+        out_strides[i] = out_strides[i + 1] * shape[i + 1];
 
-    for (int index = 0; index < bottom_count; index++) {
-        // index of a vector
-        vector<int> vec_index = ConvertIndex2VectorIndex(bottom_shape, bottom_count, index);
-        vector<int> new_vec_index(bottom_shape.size());
-        for (int i = 0; i < bottom_shape.size(); i++)
-            new_vec_index[i] = vec_index[new_axes_[i]];
+    if (strides[last] == 1) {
+        // whole rows move together
+        const int row = shape[last];
+        const int rows = count / row;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+        for (int r = 0; r < rows; r++) {
+            int in_offset = 0;
+            for (int i = last - 1, index = r; i >= 0; i--) {
+                in_offset += (index % shape[i]) * strides[i];
+                index /= shape[i];
+            }
+            std::copy(in + in_offset, in + in_offset + row, out + r * row);
+        }
+        return;
+    }
 
-        // move data element
-        int top_offset = top[0]->offset(new_vec_index);
-        top_data[top_offset] = bottom_data[index];
+    // Transpose tiles of the out axis the input runs along and the
+    // innermost out axis, so that both sides stay in cache.
+    int inner = 0;
+    for (int i = 1; i < num_axes; i++) {
+        if (strides[i] < strides[inner])
+            inner = i;
+    }
+    const int kTile = 32;
+    const int tiles = (shape[inner] + kTile - 1) / kTile;
+    const int outer = count / (shape[inner] * shape[last]);
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+    for (int task = 0; task < outer * tiles; task++) {
+        int in_offset = 0, out_offset = 0;
+        for (int i = last - 1, index = task / tiles; i >= 0; i--) {
+            if (i == inner)
+                continue;
+            const int k = index % shape[i];
+            index /= shape[i];
+            in_offset += k * strides[i];
+            out_offset += k * out_strides[i];
+        }
+        const int a0 = (task % tiles) * kTile;
+        const int a1 = std::min(a0 + kTile, shape[inner]);
+        for (int b0 = 0; b0 < shape[last]; b0 += kTile) {
+            const int b1 = std::min(b0 + kTile, shape[last]);
+            for (int a = a0; a < a1; a++) {
+                const Dtype* in_row = in + in_offset + a * strides[inner];
+                Dtype* out_row = out + out_offset + a * out_strides[inner];
+                for (int b = b0; b < b1; b++)
+                    out_row[b] = in_row[b * strides[last]];
+            }
+        }
     }
 }
 
+template<typename Dtype>
+void ShuffleIndexLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+                                           const vector<Blob<Dtype>*>& top) {
+    Permute(forward_shape_, forward_strides_, bottom[0]->cpu_data(),
+            top[0]->mutable_cpu_data());
+}
+
 template<typename Dtype>
 void ShuffleIndexLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                                             const vector<bool>& propagate_down,
@@ -70,22 +156,8 @@ void ShuffleIndexLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     if (!propagate_down[0]) {
       return;
     }
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    int bottom_count = bottom[0]->count();
-    vector<int> bottom_shape = bottom[0]->shape();
-
-    for (int index = 0; index < bottom_count; index++) {
-        // index of a vector
-        vector<int> vec_index = ConvertIndex2VectorIndex(bottom_shape, bottom_count, index);
-        vector<int> new_vec_index(bottom_shape.size());
-        for (int i = 0; i < bottom_shape.size(); i++)
-            new_vec_index[i] = vec_index[new_axes_[i]];
-
-        // move data element
-        int top_offset = top[0]->offset(new_vec_index);
-        bottom_diff[index] = top_diff[top_offset];
-    }
+    Permute(backward_shape_, backward_strides_, top[0]->cpu_diff(),
+            bottom[0]->mutable_cpu_diff());
 }
 
 #ifdef CPU_ONLY
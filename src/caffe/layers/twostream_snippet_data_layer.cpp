@@ -13,6 +13,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/twostream_snippet_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -46,8 +47,8 @@ void TwostreamSnippetDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>
     // Reshape top[0] and prefetch_data according to the batch_size.
     top_shape[0] = batch_size * num_test_views_;
     top[0]->Reshape(top_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].rgb_data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->rgb_data_.Reshape(top_shape);
     }
     LOG(INFO) << "rgb data size: " << top[0]->num() << ","
               << top[0]->channels() << "," << top[0]->height() << ","
@@ -62,8 +63,8 @@ void TwostreamSnippetDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>
     // Reshape top[0] and prefetch_data according to the batch_size.
     top_shape[0] = batch_size * num_test_views_;
     top[1]->Reshape(top_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-        this->prefetch_[i].flow_data_.Reshape(top_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+        this->prefetch_[i]->flow_data_.Reshape(top_shape);
     }
     LOG(INFO) << "flow data size: " << top[1]->num() << ","
               << top[1]->channels() << "," << top[1]->height() << ","
@@ -73,8 +74,8 @@ void TwostreamSnippetDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>
     if (this->output_labels_) {
         vector<int> label_shape(1, batch_size);
         top[2]->Reshape(label_shape);
-        for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-            this->prefetch_[i].label_.Reshape(label_shape);
+        for (int i = 0; i < this->prefetch_.size(); ++i) {
+            this->prefetch_[i]->label_.Reshape(label_shape);
         }
     }
 }
@@ -158,6 +159,8 @@ void TwostreamSnippetDataLayer<Dtype>::load_batch(TwostreamBatch<Dtype>* batch)
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
     DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+    Profiler::Get().RecordBatch(this->layer_param_.name(),
+        batch_timer.MicroSeconds(), read_time, trans_time);
 }
 
 INSTANTIATE_CLASS(TwostreamSnippetDataLayer);
@@ -13,6 +13,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/video_clip_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -46,8 +47,8 @@ void VideoClipDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size * num_test_views_;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -56,8 +57,8 @@ void VideoClipDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -119,6 +120,8 @@ void VideoClipDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  Profiler::Get().RecordBatch(this->layer_param_.name(),
+      batch_timer.MicroSeconds(), read_time, trans_time);
 }
 
 INSTANTIATE_CLASS(VideoClipDataLayer);
@@ -1,6 +1,7 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -13,6 +14,7 @@
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe{
@@ -27,7 +29,9 @@ void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     const int new_height  = this->layer_param_.video_data_param().new_height();
     const int new_width  = this->layer_param_.video_data_param().new_width();
     const int new_length  = this->layer_param_.video_data_param().new_length();
-    const int num_segments = this->layer_param_.video_data_param().num_segments();
+    const bool variable_length = this->layer_param_.video_data_param().variable_length();
+    // In variable length mode a sample is read one snippet per time step.
+    const int num_segments = variable_length ? 1 : this->layer_param_.video_data_param().num_segments();
     const string& source = this->layer_param_.video_data_param().source();
 
     LOG(INFO) << "Opening file: " << source;
@@ -48,6 +52,10 @@ void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
     LOG(INFO) << "A total of " << lines_.size() << " videos.";
     lines_id_ = 0;
+    worker_samples_.resize(this->loader_workers());
+    bucket_batch_id_ = 0;
+    CHECK_EQ(top.size() == 3, variable_length)
+        << "VideoData takes a continuation indicator top iff variable_length is set";
 
     Datum datum;
     const unsigned int frame_prefectch_rng_seed = caffe_rng_rand();
@@ -70,23 +78,28 @@ void VideoDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(batch_size, 0) << "Positive batch size required";
     if (crop_size > 0){
         top[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
-        for (int i = 0; i < this->PREFETCH_COUNT; i++)
-            this->prefetch_[i].data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
+        for (int i = 0; i < this->prefetch_.size(); i++)
+            this->prefetch_[i]->data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
     } else {
         top[0]->Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-        for (int i = 0; i < this->PREFETCH_COUNT; i++)
-            this->prefetch_[i].data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
+        for (int i = 0; i < this->prefetch_.size(); i++)
+            this->prefetch_[i]->data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
     }
     LOG(INFO) << "output data size: " << top[0]->num() << "," << top[0]->channels() << "," << top[0]->height() << "," << top[0]->width();
 
-    // label
+    // label, shaped T x N with a single time step until the first batch
     vector<int> label_shape(1, batch_size);
+    if (variable_length)
+        label_shape.insert(label_shape.begin(), 1);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; i++)
-        this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); i++)
+        this->prefetch_[i]->label_.Reshape(label_shape);
+    if (variable_length)
+        top[2]->Reshape(label_shape);
 
     vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
     this->transformed_data_.Reshape(top_shape);
+    step_shape_ = top_shape;
 }
 
 template <typename Dtype>
@@ -97,54 +110,147 @@ void VideoDataLayer<Dtype>::ShuffleVideos() {
     shuffle(lines_duration_.begin(), lines_duration_.end(),prefetch_rng2);
 }
 
+template <typename Dtype>
+void VideoDataLayer<Dtype>::NextVideo() {
+    lines_id_++;
+    if (lines_id_ >= lines_.size()) {
+        DLOG(INFO) << "Restarting data prefetching from start.";
+        lines_id_ = 0;
+        if(this->layer_param_.video_data_param().shuffle()){
+            ShuffleVideos();
+        }
+    }
+}
+
+template <typename Dtype>
+int VideoDataLayer<Dtype>::NumSteps(int duration) const {
+    const VideoDataParameter& video_data_param = this->layer_param_.video_data_param();
+    int num_steps = std::max<int>(1, duration / video_data_param.new_length());
+    if (video_data_param.max_steps() > 0)
+        num_steps = std::min<int>(num_steps, video_data_param.max_steps());
+    return num_steps;
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::SampleOffsets(int duration, int num_steps, vector<int>* offsets) {
+    const int new_length = this->layer_param_.video_data_param().new_length();
+    int average_duration = (int) duration / num_steps;
+    offsets->clear();
+    for (int i = 0; i < num_steps; ++i) {
+        if (this->phase_==TRAIN){
+            caffe::rng_t* frame_rng = static_cast<caffe::rng_t*>(frame_prefetch_rng_->generator());
+            int offset = (*frame_rng)() % (average_duration - new_length + 1);
+            offsets->push_back(offset+i*average_duration);
+        } else{
+            offsets->push_back(int((average_duration-new_length+1)/2 + i*average_duration));
+        }
+    }
+}
+
+static bool CompareNumSteps(const ListSample& a, const ListSample& b) {
+    return a.offsets.size() < b.offsets.size();
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::PlanBuckets() {
+    const VideoDataParameter& video_data_param = this->layer_param_.video_data_param();
+    const int batch_size = video_data_param.batch_size();
+    const int num_batches = std::max<int>(1, video_data_param.bucket_pool());
+
+    vector<ListSample> pool(batch_size * num_batches);
+    for (int i = 0; i < pool.size(); ++i) {
+        pool[i].filename = lines_[lines_id_].first;
+        pool[i].label = lines_[lines_id_].second;
+        SampleOffsets(lines_duration_[lines_id_], NumSteps(lines_duration_[lines_id_]), &pool[i].offsets);
+        NextVideo();
+    }
+    // neighbours in length end up in the same batch
+    std::stable_sort(pool.begin(), pool.end(), CompareNumSteps);
+    bucket_batches_.resize(num_batches);
+    for (int b = 0; b < num_batches; ++b) {
+        bucket_batches_[b].assign(pool.begin() + b * batch_size, pool.begin() + (b + 1) * batch_size);
+    }
+    // but the batches themselves are not visited from short to long
+    if (this->phase_ == TRAIN && video_data_param.shuffle()) {
+        caffe::rng_t* frame_rng = static_cast<caffe::rng_t*>(frame_prefetch_rng_->generator());
+        shuffle(bucket_batches_.begin(), bucket_batches_.end(), frame_rng);
+    }
+    bucket_batch_id_ = 0;
+}
+
 template <typename Dtype>
 void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+    plan_batch(0);
+    fill_batch(batch, 0);
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::plan_batch(int worker_id) {
+    VideoDataParameter video_data_param = this->layer_param_.video_data_param();
+    const int batch_size = video_data_param.batch_size();
+    const int num_segments = video_data_param.num_segments();
+    const int lines_size = lines_.size();
+
+    vector<ListSample>& samples = worker_samples_[worker_id];
+    if (video_data_param.variable_length()) {
+        if (bucket_batch_id_ >= bucket_batches_.size())
+            PlanBuckets();
+        samples.swap(bucket_batches_[bucket_batch_id_++]);
+        return;
+    }
+    samples.resize(batch_size);
+    for (int item_id = 0; item_id < batch_size; ++item_id){
+        CHECK_GT(lines_size, lines_id_);
+        ListSample& sample = samples[item_id];
+        sample.filename = lines_[lines_id_].first;
+        sample.label = lines_[lines_id_].second;
+        SampleOffsets(lines_duration_[lines_id_], num_segments, &sample.offsets);
+
+        //next iteration
+        NextVideo();
+    }
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::fill_batch(Batch<Dtype>* batch, int worker_id) {
     Datum datum;
     CPUTimer batch_timer;
     batch_timer.Start();
     double read_time = 0;
     double trans_time = 0;
     CPUTimer timer;
+    Blob<Dtype>* transformed_data = this->loader_transformed_data(worker_id);
     CHECK(batch->data_.count());
-    CHECK(this->transformed_data_.count());
+    CHECK(transformed_data->count());
 
     VideoDataParameter video_data_param = this->layer_param_.video_data_param();
-    const int batch_size = video_data_param.batch_size();
     const int new_height = video_data_param.new_height();
     const int new_width = video_data_param.new_width();
     const int new_length = video_data_param.new_length();
-    const int num_segments = video_data_param.num_segments();
-    const int lines_size = lines_.size();
+    const vector<ListSample>& samples = worker_samples_[worker_id];
+    if (video_data_param.variable_length()) {
+        FillSequenceBatch(batch, worker_id);
+        return;
+    }
 
     // do we need to reshape batcha data before deferencing the pointer? NO
     Dtype* prefetch_data = batch->data_.mutable_cpu_data();
     Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-    for (int item_id = 0; item_id < batch_size; ++item_id){
+    for (int item_id = 0; item_id < samples.size(); ++item_id){
         // get a blob
         timer.Start();
-        CHECK_GT(lines_size, lines_id_);
-        vector<int> offsets;
-        int average_duration = (int) lines_duration_[lines_id_] / num_segments;
-        for (int i = 0; i < num_segments; ++i) {
-            if (this->phase_==TRAIN){
-                caffe::rng_t* frame_rng = static_cast<caffe::rng_t*>(frame_prefetch_rng_->generator());
-                int offset = (*frame_rng)() % (average_duration - new_length + 1);
-                offsets.push_back(offset+i*average_duration);
-            } else{
-                offsets.push_back(int((average_duration-new_length+1)/2 + i*average_duration));
-            }
-        }
+        const ListSample& sample = samples[item_id];
         if (this->layer_param_.video_data_param().modality() == VideoDataParameter_Modality_FLOW) {
-            if(!ReadSegmentFlowToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum))
+            if(!ReadSegmentFlowToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum))
                 continue;
         }
         else if (this->layer_param_.video_data_param().modality() == VideoDataParameter_Modality_FOREGROUND_SALIENCY) {
-            if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, false))
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, false))
                 continue;
         }
         else {
-            if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true))
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, true))
                 continue;
         }
 
@@ -152,27 +258,112 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         timer.Start();
         // Apply transformations (mirror, crop...) to the image
         int offset1 = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(prefetch_data + offset1);
-        this->data_transformer_->Transform(datum, &(this->transformed_data_));
+        transformed_data->set_cpu_data(prefetch_data + offset1);
+        this->loader_transformer(worker_id)->Transform(datum, transformed_data);
         trans_time += timer.MicroSeconds();
 
-        prefetch_label[item_id] = lines_[lines_id_].second;
-        //LOG()
-
-        //next iteration
-        lines_id_++;
-        if (lines_id_ >= lines_size) {
-            DLOG(INFO) << "Restarting data prefetching from start.";
-            lines_id_ = 0;
-            if(this->layer_param_.video_data_param().shuffle()){
-                ShuffleVideos();
-            }
-        }
+        prefetch_label[item_id] = sample.label;
     }
     batch_timer.Stop();
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
     DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+    Profiler::Get().RecordBatch(this->layer_param_.name(),
+        batch_timer.MicroSeconds(), read_time, trans_time);
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::FillSequenceBatch(Batch<Dtype>* batch, int worker_id) {
+    Datum datum;
+    CPUTimer batch_timer;
+    batch_timer.Start();
+    VideoDataParameter video_data_param = this->layer_param_.video_data_param();
+    const int new_height = video_data_param.new_height();
+    const int new_width = video_data_param.new_width();
+    const int new_length = video_data_param.new_length();
+    const vector<ListSample>& samples = worker_samples_[worker_id];
+    const int num = samples.size();
+    Blob<Dtype>* transformed_data = this->loader_transformed_data(worker_id);
+
+    // the batch is as long as its longest video; shorter ones are padded
+    int num_steps = 0;
+    for (int item_id = 0; item_id < num; ++item_id)
+        num_steps = std::max<int>(num_steps, samples[item_id].offsets.size());
+    vector<int> data_shape = step_shape_;
+    data_shape[0] = num_steps * num;
+    batch->data_.Reshape(data_shape);
+    vector<int> label_shape(2);
+    label_shape[0] = num_steps;
+    label_shape[1] = num;
+    batch->label_.Reshape(label_shape);
+    Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+    Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+    caffe_set(batch->data_.count(), Dtype(0), prefetch_data);
+    caffe_set(batch->label_.count(), Dtype(-1), prefetch_label);
+    const int step_count = batch->data_.count(1);
+
+    for (int item_id = 0; item_id < num; ++item_id){
+        const ListSample& sample = samples[item_id];
+        if (video_data_param.modality() == VideoDataParameter_Modality_FLOW) {
+            if(!ReadSegmentFlowToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum))
+                continue;
+        }
+        else if (video_data_param.modality() == VideoDataParameter_Modality_FOREGROUND_SALIENCY) {
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, false))
+                continue;
+        }
+        else {
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, true))
+                continue;
+        }
+
+        // Transform all steps at once so they share a crop and mirror, then
+        // scatter each step to its time-major row.
+        const int sample_steps = sample.offsets.size();
+        vector<int> sample_shape = step_shape_;
+        sample_shape[1] *= sample_steps;
+        transformed_data->Reshape(sample_shape);
+        this->loader_transformer(worker_id)->Transform(datum, transformed_data);
+        const Dtype* sample_data = transformed_data->cpu_data();
+        for (int t = 0; t < sample_steps; ++t) {
+            caffe_copy(step_count, sample_data + t * step_count,
+                       prefetch_data + batch->data_.offset(t * num + item_id));
+            prefetch_label[t * num + item_id] = sample.label;
+        }
+    }
+    batch_timer.Stop();
+    DLOG(INFO) << "Prefetch sequence batch of " << num_steps << " steps: "
+               << batch_timer.MilliSeconds() << " ms.";
+    Profiler::Get().RecordBatch(this->layer_param_.name(),
+        batch_timer.MicroSeconds(), 0, 0);
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::FillContinuation(const vector<Blob<Dtype>*>& top) {
+    if (top.size() < 3)
+        return;
+    const int num = top[1]->shape(1);
+    top[2]->ReshapeLike(*top[1]);
+    const Dtype* label = top[1]->cpu_data();
+    Dtype* cont = top[2]->mutable_cpu_data();
+    for (int i = 0; i < top[2]->count(); ++i) {
+        // a sequence starts at t = 0 and padded steps carry label -1
+        cont[i] = (i >= num && label[i] >= 0) ? Dtype(1) : Dtype(0);
+    }
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+                                        const vector<Blob<Dtype>*>& top) {
+    BasePrefetchingDataLayer<Dtype>::Forward_cpu(bottom, top);
+    FillContinuation(top);
+}
+
+template <typename Dtype>
+void VideoDataLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+                                        const vector<Blob<Dtype>*>& top) {
+    BasePrefetchingDataLayer<Dtype>::Forward_gpu(bottom, top);
+    FillContinuation(top);
 }
 
 INSTANTIATE_CLASS(VideoDataLayer);
@@ -13,6 +13,7 @@
 #include "caffe/util/benchmark.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe{
@@ -47,6 +48,7 @@ void VideoSegmentDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& b
 
     LOG(INFO) << "A total of " << lines_.size() << " videos.";
     lines_id_ = 0;
+    worker_samples_.resize(this->loader_workers());
 
     Datum datum;
     vector<int> offsets(1);
@@ -64,20 +66,20 @@ void VideoSegmentDataLayer<Dtype>:: DataLayerSetUp(const vector<Blob<Dtype>*>& b
     CHECK_GT(batch_size, 0) << "Positive batch size required";
     if (crop_size > 0){
         top[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
-        for (int i = 0; i < this->PREFETCH_COUNT; i++)
-            this->prefetch_[i].data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
+        for (int i = 0; i < this->prefetch_.size(); i++)
+            this->prefetch_[i]->data_.Reshape(batch_size, datum.channels(), crop_size, crop_size);
     } else {
         top[0]->Reshape(batch_size, datum.channels(), datum.height(), datum.width());
-        for (int i = 0; i < this->PREFETCH_COUNT; i++)
-            this->prefetch_[i].data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
+        for (int i = 0; i < this->prefetch_.size(); i++)
+            this->prefetch_[i]->data_.Reshape(batch_size, datum.channels(), datum.height(), datum.width());
     }
     LOG(INFO) << "output data size: " << top[0]->num() << "," << top[0]->channels() << "," << top[0]->height() << "," << top[0]->width();
 
     // label
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; i++)
-        this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); i++)
+        this->prefetch_[i]->label_.Reshape(label_shape);
 
     vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
     this->transformed_data_.Reshape(top_shape);
@@ -93,46 +95,76 @@ void VideoSegmentDataLayer<Dtype>::ShuffleVideos() {
 
 template <typename Dtype>
 void VideoSegmentDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+    plan_batch(0);
+    fill_batch(batch, 0);
+}
+
+template <typename Dtype>
+void VideoSegmentDataLayer<Dtype>::plan_batch(int worker_id) {
+    const int batch_size = this->layer_param_.video_segment_data_param().batch_size();
+    const int lines_size = lines_.size();
+
+    vector<ListSample>& samples = worker_samples_[worker_id];
+    samples.resize(batch_size);
+    for (int item_id = 0; item_id < batch_size; ++item_id){
+        CHECK_GT(lines_size, lines_id_);
+        ListSample& sample = samples[item_id];
+        sample.filename = lines_[lines_id_].first;
+        sample.label = lines_[lines_id_].second;
+        sample.offsets.assign(1, lines_start_fr_[lines_id_] - 1);        // offsets store start_fr to be compatible with old system.
+
+        //next iteration
+        lines_id_++;
+        if (lines_id_ >= lines_size) {
+            DLOG(INFO) << "Restarting data prefetching from start.";
+            lines_id_ = 0;
+            if (this->layer_param_.video_segment_data_param().shuffle()){
+                ShuffleVideos();
+            }
+        }
+    }
+}
+
+template <typename Dtype>
+void VideoSegmentDataLayer<Dtype>::fill_batch(Batch<Dtype>* batch, int worker_id) {
     Datum datum;
     CPUTimer batch_timer;
     batch_timer.Start();
     double read_time = 0;
     double trans_time = 0;
     CPUTimer timer;
+    Blob<Dtype>* transformed_data = this->loader_transformed_data(worker_id);
     CHECK(batch->data_.count());
-    CHECK(this->transformed_data_.count());
+    CHECK(transformed_data->count());
 
     VideoSegmentDataParameter video_segment_data_param = this->layer_param_.video_segment_data_param();
-    const int batch_size = video_segment_data_param.batch_size();
     const int new_height = video_segment_data_param.new_height();
     const int new_width = video_segment_data_param.new_width();
     const int new_length = video_segment_data_param.new_length();
-    const int lines_size = lines_.size();
+    const vector<ListSample>& samples = worker_samples_[worker_id];
 
     // do we need to reshape batcha data before deferencing the pointer? NO
     Dtype* prefetch_data = batch->data_.mutable_cpu_data();
     Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-    vector<int> offsets(1);
-    for (int item_id = 0; item_id < batch_size; ++item_id){
+    for (int item_id = 0; item_id < samples.size(); ++item_id){
         // get a blob
         timer.Start();
-        CHECK_GT(lines_size, lines_id_);
-        offsets[0] = lines_start_fr_[lines_id_] - 1;        // offsets store start_fr to be compatible with old system.
+        const ListSample& sample = samples[item_id];
         if (this->layer_param_.video_segment_data_param().modality() == VideoSegmentDataParameter_Modality_FLOW) {
-            if(!ReadSegmentFlowToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum))
+            if(!ReadSegmentFlowToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum))
                 continue;
         }
         else if (this->layer_param_.video_segment_data_param().modality() == VideoSegmentDataParameter_Modality_FOREGROUND_SALIENCY) {
-            if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, false))
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, false))
                 continue;
         }
         else if (this->layer_param_.video_segment_data_param().modality() == VideoSegmentDataParameter_Modality_COLOR_FLOW) {
-            if (!ReadSegmentColorFlowToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true))
+            if (!ReadSegmentColorFlowToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, true))
                 continue;
         }
         else {
-            if(!ReadSegmentRGBToDatum(lines_[lines_id_].first, lines_[lines_id_].second, offsets, new_height, new_width, new_length, &datum, true))
+            if(!ReadSegmentRGBToDatum(sample.filename, sample.label, sample.offsets, new_height, new_width, new_length, &datum, true))
                 continue;
         }
 
@@ -140,27 +172,18 @@ void VideoSegmentDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         timer.Start();
         // Apply transformations (mirror, crop...) to the image
         int offset1 = batch->data_.offset(item_id);
-        this->transformed_data_.set_cpu_data(prefetch_data + offset1);
-        this->data_transformer_->Transform(datum, &(this->transformed_data_));
+        transformed_data->set_cpu_data(prefetch_data + offset1);
+        this->loader_transformer(worker_id)->Transform(datum, transformed_data);
         trans_time += timer.MicroSeconds();
 
-        prefetch_label[item_id] = lines_[lines_id_].second;
-        //LOG()
-
-        //next iteration
-        lines_id_++;
-        if (lines_id_ >= lines_size) {
-            DLOG(INFO) << "Restarting data prefetching from start.";
-            lines_id_ = 0;
-            if (this->layer_param_.video_segment_data_param().shuffle()){
-                ShuffleVideos();
-            }
-        }
+        prefetch_label[item_id] = sample.label;
     }
     batch_timer.Stop();
     DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
     DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
     DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+    Profiler::Get().RecordBatch(this->layer_param_.name(),
+        batch_timer.MicroSeconds(), read_time, trans_time);
 }
 
 INSTANTIATE_CLASS(VideoSegmentDataLayer);
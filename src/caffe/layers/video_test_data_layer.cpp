@@ -15,6 +15,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/video_test_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -36,6 +37,7 @@ void VideoTestDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
       LOG(FATAL) << "VideoTestData layer must be used in testing phase";
 
   const int batch_size = this->layer_param_.flow_data_param().batch_size();
+  worker_datums_.resize(this->loader_workers());
   // Read a data point, and use it to initialize the top blob.
   Datum& datum = *(reader_.full().peek());
 
@@ -46,8 +48,8 @@ void VideoTestDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size * CAFFE_NUM_TEST_VIEWS;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -56,8 +58,8 @@ void VideoTestDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -65,22 +67,43 @@ void VideoTestDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& botto
 // This function is called on prefetch thread
 template<typename Dtype>
 void VideoTestDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  plan_batch(0);
+  fill_batch(batch, 0);
+}
+
+// This function is called on a loader thread, in batch order
+template<typename Dtype>
+void VideoTestDataLayer<Dtype>::plan_batch(int worker_id) {
+  const int batch_size = this->layer_param_.flow_data_param().batch_size();
+  vector<Datum*>& datums = worker_datums_[worker_id];
+  datums.resize(batch_size);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    datums[item_id] = reader_.full().pop("Waiting for flow data");
+  }
+}
+
+// This function is called on a loader thread
+template<typename Dtype>
+void VideoTestDataLayer<Dtype>::fill_batch(Batch<Dtype>* batch,
+    int worker_id) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
+  Blob<Dtype>* transformed_data = this->loader_transformed_data(worker_id);
+  DataTransformer<Dtype>* data_transformer =
+      this->loader_transformer(worker_id);
   CHECK(batch->data_.count());
-  CHECK(this->transformed_data_.count());
+  CHECK(transformed_data->count());
+  const vector<Datum*>& datums = worker_datums_[worker_id];
 
   // Reshape according to the first datum of each batch
   // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.flow_data_param().batch_size();
-  Datum& datum = *(reader_.full().peek());
   // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  vector<int> top_shape = data_transformer->InferBlobShape(*datums[0]);
   top_shape[0] = CAFFE_NUM_TEST_VIEWS;
-  this->transformed_data_.Reshape(top_shape);
+  transformed_data->Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size * CAFFE_NUM_TEST_VIEWS;
   batch->data_.Reshape(top_shape);
@@ -92,29 +115,26 @@ void VideoTestDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for flow data"));
-    read_time += timer.MicroSeconds();
-//    DLOG(INFO) << "number of data in full queue: " << reader_.full().size();
+    const Datum& datum = *datums[item_id];
     timer.Start();
     // Apply data transformations (mirror, scale, crop...)
     int offset = batch->data_.offset(item_id * CAFFE_NUM_TEST_VIEWS);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->TransformVariedSizeTestDatum(datum, &(this->transformed_data_));
+    transformed_data->set_cpu_data(top_data + offset);
+    data_transformer->TransformVariedSizeTestDatum(datum, transformed_data);
     // Copy label.
     if (this->output_labels_) {
       top_label[item_id] = datum.label();
     }
     trans_time += timer.MicroSeconds();
 
-    reader_.free().push(const_cast<Datum*>(&datum));
+    reader_.free().push(datums[item_id]);
   }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  Profiler::Get().RecordBatch(this->layer_param_.name(),
+      batch_timer.MicroSeconds(), 0, trans_time);
 }
 
 INSTANTIATE_CLASS(VideoTestDataLayer);
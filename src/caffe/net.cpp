@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <map>
 #include <set>
@@ -13,8 +15,10 @@
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_layouts.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -56,9 +60,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
-  // Create a copy of filtered_param with splits added where necessary.
+  // Convert between the layouts of the 3D layers where necessary.
+  NetParameter layout_param;
+  InsertLayoutConversions(filtered_param, &layout_param);
+  // Create a copy of layout_param with splits added where necessary.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  InsertSplits(layout_param, &param);
+  DisableUnsafeInvertTop(&param);
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -279,9 +287,457 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  if (param.share_memory()) {
+    PlanSharedMemory(param);
+  }
+  bool checkpoints = param.checkpoint_interval() > 0;
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    checkpoints |= param.layer(layer_id).checkpoint();
+  }
+  if (checkpoints && phase_ == TRAIN && blob_memory_group_.empty()) {
+    PlanCheckpoints(param);
+  }
+  if (param.branch_threads() > 1) {
+    PlanBranches(param);
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+int Net<Dtype>::GroupBlobsByMemory() {
+  // Blobs that share memory already, as Split and Flatten tops share their
+  // bottom's, stay together and are live as long as any of them is.
+  map<SyncedMemory*, int> memory_group;
+  blob_memory_group_.resize(blobs_.size());
+  int num_groups = 0;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (memory && memory_group.count(memory)) {
+      blob_memory_group_[blob_id] = memory_group[memory];
+    } else {
+      blob_memory_group_[blob_id] = num_groups;
+      if (memory) {
+        memory_group[memory] = num_groups;
+      }
+      ++num_groups;
+    }
+  }
+  return num_groups;
+}
+
+template <typename Dtype>
+void Net<Dtype>::KeepNetBlobs(const NetParameter& param,
+    vector<bool>* kept) {
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    (*kept)[blob_memory_group_[net_input_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    (*kept)[blob_memory_group_[net_output_blob_indices_[i]]] = true;
+  }
+  for (int i = 0; i < param.keep_blob_size(); ++i) {
+    CHECK(has_blob(param.keep_blob(i))) << "Unknown blob "
+        << param.keep_blob(i) << " to keep.";
+    (*kept)[blob_memory_group_[blob_names_index_[param.keep_blob(i)]]] = true;
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanSharedMemory(const NetParameter& param) {
+  if (phase_ != TEST) {
+    LOG(WARNING) << "Net " << name_ << " runs backward in phase "
+        << Phase_Name(phase_) << "; ignoring share_memory.";
+    return;
+  }
+  const int num_groups = GroupBlobsByMemory();
+  memory_group_live_.assign(num_groups,
+      make_pair(static_cast<int>(layers_.size()), -1));
+  vector<bool> kept(num_groups, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      pair<int, int>& live =
+          memory_group_live_[blob_memory_group_[bottom_id_vecs_[layer_id][i]]];
+      live.first = std::min(live.first, layer_id);
+      live.second = std::max(live.second, layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int group = blob_memory_group_[top_id_vecs_[layer_id][i]];
+      memory_group_live_[group].first =
+          std::min(memory_group_live_[group].first, layer_id);
+      memory_group_live_[group].second =
+          std::max(memory_group_live_[group].second, layer_id);
+      // data layers may hand their tops memory of their own
+      if (bottom_id_vecs_[layer_id].empty()) {
+        kept[group] = true;
+      }
+    }
+  }
+  KeepNetBlobs(param, &kept);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (kept[blob_memory_group_[blob_id]]) {
+      blob_memory_group_[blob_id] = -1;
+    }
+  }
+  AssignSharedMemory();
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanCheckpoints(const NetParameter& param) {
+  // Every checkpoint layer ends a segment, whose other tops are recomputed.
+  const int interval = param.checkpoint_interval();
+  layer_segment_.resize(layers_.size());
+  segment_start_.assign(1, 0);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    layer_segment_[layer_id] = segment_start_.size() - 1;
+    const bool checkpoint = layers_[layer_id]->layer_param().checkpoint()
+        || (interval > 0 && (layer_id + 1) % interval == 0);
+    if (checkpoint && layer_id + 1 < layers_.size()) {
+      segment_start_.push_back(layer_id + 1);
+    }
+  }
+  // A group is recomputed if all the layers using it are in one segment,
+  // and is live for all of that segment.
+  const int num_groups = GroupBlobsByMemory();
+  vector<int> group_segment(num_groups, -1);
+  vector<bool> kept(num_groups, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const int segment = layer_segment_[layer_id];
+    const bool checkpoint = segment + 1 < segment_start_.size()
+        && segment_start_[segment + 1] == layer_id + 1;
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int group = blob_memory_group_[bottom_id_vecs_[layer_id][i]];
+      kept[group] = kept[group]
+          || (group_segment[group] >= 0 && group_segment[group] != segment);
+      group_segment[group] = segment;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int group = blob_memory_group_[top_id_vecs_[layer_id][i]];
+      kept[group] = kept[group] || checkpoint
+          || bottom_id_vecs_[layer_id].empty()
+          || (group_segment[group] >= 0 && group_segment[group] != segment);
+      group_segment[group] = segment;
+    }
+  }
+  KeepNetBlobs(param, &kept);
+  // Layers changing a kept blob in place cannot run again, so their other
+  // tops are kept as well.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      bool in_place_kept = false;
+      for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+        const int group = blob_memory_group_[top_id_vecs_[layer_id][i]];
+        for (int j = 0; j < bottom_id_vecs_[layer_id].size(); ++j) {
+          in_place_kept |= kept[group]
+              && group == blob_memory_group_[bottom_id_vecs_[layer_id][j]];
+        }
+      }
+      for (int i = 0; i < top_id_vecs_[layer_id].size() && in_place_kept;
+           ++i) {
+        const int group = blob_memory_group_[top_id_vecs_[layer_id][i]];
+        changed |= !kept[group];
+        kept[group] = true;
+      }
+    }
+  }
+  memory_group_live_.resize(num_groups);
+  for (int group = 0; group < num_groups; ++group) {
+    const int segment = std::max(group_segment[group], 0);
+    memory_group_live_[group].first = segment_start_[segment];
+    memory_group_live_[group].second = segment + 1 < segment_start_.size() ?
+        segment_start_[segment + 1] - 1 : layers_.size() - 1;
+  }
+  layer_recompute_.assign(layers_.size(), false);
+  layer_rng_.resize(layers_.size());
+  int num_recomputed = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      if (!kept[blob_memory_group_[top_id_vecs_[layer_id][i]]]) {
+        layer_recompute_[layer_id] = true;
+      }
+    }
+    num_recomputed += layer_recompute_[layer_id];
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (kept[blob_memory_group_[blob_id]]) {
+      blob_memory_group_[blob_id] = -1;
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Net " << name_ << " recomputes "
+      << num_recomputed << " layers in " << segment_start_.size()
+      << " segments.";
+  AssignSharedMemory();
+}
+
+template <typename Dtype>
+void Net<Dtype>::SetLayerRng(const int layer_id, const bool replay) {
+  if (replay) {
+    *caffe_rng() = layer_rng_[layer_id];
+  } else {
+    layer_rng_[layer_id] = *caffe_rng();
+  }
+#ifndef CPU_ONLY
+  // curand cannot save its state, so is seeded from the one saved.
+  if (Caffe::mode() == Caffe::GPU && Caffe::curand_generator()) {
+    CURAND_CHECK(curandSetPseudoRandomGeneratorSeed(
+        Caffe::curand_generator(), caffe_rng_rand()));
+    CURAND_CHECK(curandSetGeneratorOffset(Caffe::curand_generator(), 0));
+  }
+#endif
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(const int segment) {
+  // Leave the random state as it would be without recomputing.
+  const rng_t rng = *caffe_rng();
+  const int end = segment + 1 < segment_start_.size() ?
+      segment_start_[segment + 1] : layers_.size();
+  for (int i = segment_start_[segment]; i < end; ++i) {
+    if (!layer_recompute_[i]) {
+      continue;
+    }
+    vector<shared_ptr<Blob<Dtype> > > blobs;
+    if (layers_[i]->ForwardUpdatesBlobs()) {
+      for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+        blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        blobs[j]->CopyFrom(*layers_[i]->blobs()[j], false, true);
+      }
+    }
+    SetLayerRng(i, true);
+    ForwardLayer(i, "recompute");
+    for (int j = 0; j < blobs.size(); ++j) {
+      layers_[i]->blobs()[j]->CopyFrom(*blobs[j]);
+    }
+  }
+  *caffe_rng() = rng;
+  live_segment_ = segment;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanBranches(const NetParameter& param) {
+  if (phase_ != TEST) {
+    LOG(WARNING) << "Net " << name_ << " draws random numbers in phase "
+        << Phase_Name(phase_) << "; ignoring branch_threads.";
+    return;
+  }
+  if (!blob_memory_group_.empty()) {
+    LOG(WARNING) << "Net " << name_ << " shares the memory of its "
+        << "activations; ignoring branch_threads.";
+    return;
+  }
+  // A layer waits for the layers before it writing the memory of its bottoms,
+  // tops and params, and, for the memory it writes, for those reading it.
+  // Blobs sharing memory, as Split and Flatten tops with their bottom, count
+  // as one, and a layer only writes its params if Forward updates them.
+  map<const void*, int> memory_id;
+  vector<int> last_writer;
+  vector<vector<int> > readers;
+  layer_forward_deps_.assign(layers_.size(), vector<int>());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    vector<pair<const void*, bool> > uses;
+    for (int i = 0; i < bottom_vecs_[layer_id].size(); ++i) {
+      uses.push_back(make_pair(bottom_vecs_[layer_id][i]->data().get() ?
+          static_cast<const void*>(bottom_vecs_[layer_id][i]->data().get()) :
+          bottom_vecs_[layer_id][i], false));
+    }
+    for (int i = 0; i < layers_[layer_id]->blobs().size(); ++i) {
+      uses.push_back(make_pair(layers_[layer_id]->blobs()[i]->data().get(),
+          layers_[layer_id]->ForwardUpdatesBlobs()));
+    }
+    for (int i = 0; i < top_vecs_[layer_id].size(); ++i) {
+      uses.push_back(make_pair(top_vecs_[layer_id][i]->data().get() ?
+          static_cast<const void*>(top_vecs_[layer_id][i]->data().get()) :
+          top_vecs_[layer_id][i], true));
+    }
+    set<int> deps;
+    for (int i = 0; i < uses.size(); ++i) {
+      if (!memory_id.count(uses[i].first)) {
+        const int id = memory_id.size();
+        memory_id[uses[i].first] = id;
+        last_writer.push_back(-1);
+        readers.push_back(vector<int>());
+      }
+      const int id = memory_id[uses[i].first];
+      if (last_writer[id] >= 0) {
+        deps.insert(last_writer[id]);
+      }
+      if (uses[i].second) {
+        deps.insert(readers[id].begin(), readers[id].end());
+        readers[id].clear();
+        last_writer[id] = layer_id;
+      } else {
+        readers[id].push_back(layer_id);
+      }
+    }
+    deps.erase(layer_id);
+    layer_forward_deps_[layer_id].assign(deps.begin(), deps.end());
+  }
+  // Backward runs the other way, and layers sharing params add up the diffs
+  // in the same order as when running in sequence.
+  layer_backward_deps_.assign(layers_.size(), vector<int>());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < layer_forward_deps_[layer_id].size(); ++i) {
+      layer_backward_deps_[layer_forward_deps_[layer_id][i]].push_back(
+          layer_id);
+    }
+  }
+  map<const void*, int> last_user;
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    for (int i = 0; i < layers_[layer_id]->blobs().size(); ++i) {
+      const void* diff = layers_[layer_id]->blobs()[i]->diff().get();
+      if (last_user.count(diff) && last_user[diff] != layer_id) {
+        layer_backward_deps_[layer_id].push_back(last_user[diff]);
+      }
+      last_user[diff] = layer_id;
+    }
+  }
+  layer_loss_.resize(layers_.size());
+  scheduler_.reset(new GraphScheduler(param.branch_threads()));
+  LOG_IF(INFO, Caffe::root_solver()) << "Running up to "
+      << param.branch_threads() << " layers at once.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunBranches(const vector<vector<int> >& layer_deps,
+    const int first, const int step, const int num_layers, bool forward) {
+  // The layers number k = (layer_id - first) / step for the scheduler, and
+  // only wait for the layers of this run.
+  vector<vector<int> > successors(num_layers);
+  for (int k = 0; k < num_layers; ++k) {
+    const vector<int>& deps = layer_deps[first + step * k];
+    for (int i = 0; i < deps.size(); ++i) {
+      const int dep = (deps[i] - first) / step;
+      if (dep >= 0 && dep < k) {
+        successors[dep].push_back(k);
+      }
+    }
+  }
+  scheduler_->Run(successors, boost::bind(&Net<Dtype>::RunBranchLayer, this,
+      first, step, forward, _1));
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunBranchLayer(const int first, const int step,
+    bool forward, const int k) {
+  const int i = first + step * k;
+  if (forward) {
+    layer_loss_[i] = ForwardLayer(i);
+  } else if (layer_need_backward_[i]) {
+    BackwardLayer(i);
+  }
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardLayer(const int layer_id, const char* category) {
+  const int64_t start = Profiler::Now();
+  const Dtype loss =
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+  Profiler::Get().Record(layer_names_[layer_id], category, start,
+      Profiler::Now() - start, layers_[layer_id]->ForwardFlops(),
+      LayerBytes(layer_id));
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardLayer(const int layer_id) {
+  const int64_t start = Profiler::Now();
+  layers_[layer_id]->Backward(top_vecs_[layer_id],
+      bottom_need_backward_[layer_id], bottom_vecs_[layer_id]);
+  // reading the data and diffs, and writing the diffs
+  Profiler::Get().Record(layer_names_[layer_id], "backward", start,
+      Profiler::Now() - start, 2 * layers_[layer_id]->ForwardFlops(),
+      2 * LayerBytes(layer_id));
+}
+
+template <typename Dtype>
+double Net<Dtype>::LayerBytes(const int layer_id) const {
+  double count = 0;
+  for (int i = 0; i < bottom_vecs_[layer_id].size(); ++i) {
+    count += bottom_vecs_[layer_id][i]->count();
+  }
+  for (int i = 0; i < top_vecs_[layer_id].size(); ++i) {
+    count += top_vecs_[layer_id][i]->count();
+  }
+  for (int i = 0; i < layers_[layer_id]->blobs().size(); ++i) {
+    count += layers_[layer_id]->blobs()[i]->count();
+  }
+  return count * sizeof(Dtype);
+}
+
+template <typename Dtype>
+void Net<Dtype>::AssignSharedMemory() {
+  const int num_groups = memory_group_live_.size();
+  vector<size_t> group_size(num_groups, 0);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = blob_memory_group_[blob_id];
+    if (group >= 0) {
+      group_size[group] = std::max(group_size[group],
+          blobs_[blob_id]->count() * sizeof(Dtype));
+    }
+  }
+  vector<pair<int, int> > group_order;
+  for (int group = 0; group < num_groups; ++group) {
+    if (group_size[group] > 0) {
+      group_order.push_back(make_pair(memory_group_live_[group].first, group));
+    }
+  }
+  std::sort(group_order.begin(), group_order.end());
+  // Hand every group, in the order they come alive, the allocation that
+  // fits it best among those whose last user has run before.
+  vector<int> group_allocation(num_groups, -1);
+  vector<size_t> allocation_size;
+  vector<int> allocation_live_until;
+  size_t unshared_size = 0;
+  for (int i = 0; i < group_order.size(); ++i) {
+    const int group = group_order[i].second;
+    const size_t size = group_size[group];
+    unshared_size += size;
+    int best = -1;
+    for (int a = 0; a < allocation_size.size(); ++a) {
+      if (allocation_live_until[a] >= memory_group_live_[group].first) {
+        continue;
+      }
+      // the smallest that fits, or else the largest
+      const bool fits = allocation_size[a] >= size;
+      const bool best_fits = best >= 0 && allocation_size[best] >= size;
+      if (best < 0
+          || (fits && (!best_fits || allocation_size[a] < allocation_size[best]))
+          || (!fits && !best_fits
+              && allocation_size[a] > allocation_size[best])) {
+        best = a;
+      }
+    }
+    if (best < 0) {
+      best = allocation_size.size();
+      allocation_size.push_back(0);
+      allocation_live_until.push_back(-1);
+    }
+    allocation_size[best] = std::max(allocation_size[best], size);
+    allocation_live_until[best] = memory_group_live_[group].second;
+    group_allocation[group] = best;
+  }
+  vector<shared_ptr<SyncedMemory> > allocations(allocation_size.size());
+  live_segment_ = -1;
+  size_t shared_size = 0;
+  for (int a = 0; a < allocations.size(); ++a) {
+    allocations[a].reset(new SyncedMemory(allocation_size[a]));
+    shared_size += allocation_size[a];
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int group = blob_memory_group_[blob_id];
+    if (group >= 0 && group_allocation[group] >= 0) {
+      blobs_[blob_id]->ShareDataMemory(allocations[group_allocation[group]]);
+    }
+  }
+  // Layers that share memory with their blobs share it anew.
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Net " << name_ << " shares "
+      << unshared_size << " bytes of activations in " << allocations.size()
+      << " allocations of " << shared_size << " bytes.";
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -312,6 +768,42 @@ void Net<Dtype>::FilterNet(const NetParameter& param,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::DisableUnsafeInvertTop(NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* bn_param = param->mutable_layer(i);
+    if (bn_param->type() != "BN" || !bn_param->bn_param().invert_top()
+        || bn_param->bottom_size() != 1 || bn_param->top_size() != 1
+        || bn_param->bottom(0) != bn_param->top(0)) {
+      continue;
+    }
+    // the names of the top, which the splits of it share
+    set<string> names;
+    names.insert(bn_param->top(0));
+    string changed_by;
+    for (int j = i + 1; j < param->layer_size() && changed_by.empty(); ++j) {
+      const LayerParameter& layer_param = param->layer(j);
+      for (int b = 0; b < layer_param.bottom_size(); ++b) {
+        if (!names.count(layer_param.bottom(b))) {
+          continue;
+        }
+        for (int t = 0; t < layer_param.top_size(); ++t) {
+          if (layer_param.type() == "Split") {
+            names.insert(layer_param.top(t));
+          } else if (layer_param.top(t) == layer_param.bottom(b)) {
+            changed_by = layer_param.name();
+          }
+        }
+      }
+    }
+    if (!changed_by.empty()) {
+      LOG(WARNING) << "Turning off invert_top of " << bn_param->name()
+          << ", whose top " << changed_by << " changes in place.";
+      bn_param->mutable_bn_param()->set_invert_top(false);
+    }
+  }
+}
+
 template <typename Dtype>
 bool Net<Dtype>::StateMeetsRule(const NetState& state,
     const NetStateRule& rule, const string& layer_name) {
@@ -544,9 +1036,20 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
   Dtype loss = 0;
+  if (scheduler_ && Caffe::mode() == Caffe::CPU && !debug_info_) {
+    RunBranches(layer_forward_deps_, start, 1, end - start + 1, true);
+    for (int i = start; i <= end; ++i) {
+      loss += layer_loss_[i];
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (!layer_recompute_.empty() && layer_recompute_[i]) {
+      SetLayerRng(i, false);
+      live_segment_ = layer_segment_[i];
+    }
+    Dtype layer_loss = ForwardLayer(i);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
@@ -587,12 +1090,21 @@ const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
 
 template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
+  CHECK(blob_memory_group_.empty() || !layer_segment_.empty()) << "Net "
+      << name_ << " shares the memory of its activations and cannot run "
+      << "backward.";
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (scheduler_ && Caffe::mode() == Caffe::CPU && !debug_info_) {
+    RunBranches(layer_backward_deps_, start, -1, start - end + 1, false);
+    return;
+  }
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
-      layers_[i]->Backward(
-          top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+      if (!layer_segment_.empty() && layer_segment_[i] != live_segment_) {
+        RecomputeSegment(layer_segment_[i]);
+      }
+      BackwardLayer(i);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
@@ -743,6 +1255,9 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (!blob_memory_group_.empty()) {
+    AssignSharedMemory();
+  }
 }
 
 template <typename Dtype>
@@ -967,7 +1482,14 @@ const shared_ptr<Blob<Dtype> > Net<Dtype>::blob_by_name(
     const string& blob_name) const {
   shared_ptr<Blob<Dtype> > blob_ptr;
   if (has_blob(blob_name)) {
-    blob_ptr = blobs_[blob_names_index_.find(blob_name)->second];
+    const int blob_id = blob_names_index_.find(blob_name)->second;
+    blob_ptr = blobs_[blob_id];
+    // once per blob, as callers may look blobs up on every iteration
+    LOG_IF(WARNING, !blob_memory_group_.empty()
+        && blob_memory_group_[blob_id] >= 0
+        && shared_blobs_warned_.insert(blob_id).second) << "Blob "
+        << blob_name << " shares memory with other blobs; add it to "
+        << "keep_blob to read it after Forward.";
   } else {
     blob_ptr.reset((Blob<Dtype>*)(NULL));
     LOG(WARNING) << "Unknown blob name " << blob_name;
@@ -7,6 +7,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -250,7 +251,10 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    {
+      ProfileScope profile("update", "solver");
+      ApplyUpdate();
+    }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -422,6 +426,11 @@ void Solver<Dtype>::Snapshot() {
   }
 
   SnapshotSolverState(model_filename);
+  if (param_.snapshot_trace()) {
+    Profiler::Get().WriteTrace(SnapshotFilename(".trace.json"));
+    LOG(INFO) << "Profile of the latest events:\n"
+        << Profiler::Get().Summary();
+  }
 }
 
 template <typename Dtype>
@@ -0,0 +1,255 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/prefetch_monitor.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PrefetchMonitorTest : public ::testing::Test {
+ protected:
+  // Exposes MaxDepth.
+  class Monitor : public PrefetchMonitor {
+   public:
+    explicit Monitor(const PrefetchParameter& param)
+        : PrefetchMonitor(param, "test") {}
+    using PrefetchMonitor::MaxDepth;
+  };
+
+  PrefetchMonitorTest() {
+    param_.set_adaptive(true);
+    param_.set_count(2);
+    param_.set_min_count(1);
+    param_.set_max_count(3);
+    param_.set_adapt_interval(2);
+    param_.set_log_interval(0);
+  }
+
+  PrefetchParameter param_;
+};
+
+TEST_F(PrefetchMonitorTest, TestFixed) {
+  param_.set_adaptive(false);
+  Monitor monitor(param_);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(monitor.Update(true, 1, false, 2, 100), 0);
+    EXPECT_EQ(monitor.Update(false, 0, true, 2, 100), 0);
+  }
+}
+
+TEST_F(PrefetchMonitorTest, TestGrowOnStalls) {
+  Monitor monitor(param_);
+  // one stall in a window of adapt_interval forwards adds a batch
+  EXPECT_EQ(monitor.Update(true, 1, false, 2, 100), 0);
+  EXPECT_EQ(monitor.Update(false, 0, false, 2, 100), 1);
+  // but not past max_count
+  EXPECT_EQ(monitor.Update(true, 1, false, 3, 100), 0);
+  EXPECT_EQ(monitor.Update(true, 1, false, 3, 100), 0);
+  // no stalls, no change
+  EXPECT_EQ(monitor.Update(false, 0, false, 2, 100), 0);
+  EXPECT_EQ(monitor.Update(false, 0, false, 2, 100), 0);
+}
+
+TEST_F(PrefetchMonitorTest, TestShrinkWhenSaturated) {
+  Monitor monitor(param_);
+  // the loader idle throughout a window retires a batch
+  EXPECT_EQ(monitor.Update(false, 0, true, 3, 100), 0);
+  EXPECT_EQ(monitor.Update(false, 0, true, 3, 100), -1);
+  // not if it was busy once
+  EXPECT_EQ(monitor.Update(false, 0, true, 2, 100), 0);
+  EXPECT_EQ(monitor.Update(false, 0, false, 2, 100), 0);
+  // and not below min_count
+  EXPECT_EQ(monitor.Update(false, 0, true, 1, 100), 0);
+  EXPECT_EQ(monitor.Update(false, 0, true, 1, 100), 0);
+}
+
+TEST_F(PrefetchMonitorTest, TestMemoryBudget) {
+  param_.set_max_count(8);
+  param_.set_memory_budget_mb(1);
+  Monitor monitor(param_);
+  EXPECT_EQ(monitor.MaxDepth(0), 8);
+  EXPECT_EQ(monitor.MaxDepth(1 << 10), 8);
+  EXPECT_EQ(monitor.MaxDepth(1 << 18), 4);
+  // never below min_count, even for batches larger than the budget
+  EXPECT_EQ(monitor.MaxDepth(1 << 21), 1);
+  param_.set_min_count(2);
+  EXPECT_EQ(Monitor(param_).MaxDepth(1 << 21), 2);
+  // stalls do not grow the queue past the budget
+  EXPECT_EQ(monitor.Update(true, 1, false, 4, 1 << 18), 0);
+  EXPECT_EQ(monitor.Update(true, 1, false, 4, 1 << 18), 0);
+  // and batches that grew past it give memory back at once
+  EXPECT_EQ(monitor.Update(false, 0, false, 4, 1 << 19), -1);
+}
+
+// A data layer loading batches of constants, exposing its queues.
+template <typename Dtype>
+class ConstantPrefetchingDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit ConstantPrefetchingDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param) {}
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    vector<int> shape(2);
+    shape[0] = 2;
+    shape[1] = 3;
+    top[0]->Reshape(shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(shape);
+    }
+  }
+  virtual inline const char* type() const { return "ConstantData"; }
+
+  // Take a loaded or free batch, once the loader is stopped.
+  Batch<Dtype>* TakeBatch() {
+    Batch<Dtype>* batch;
+    if (!this->prefetch_free_.try_pop(&batch)) {
+      CHECK(this->prefetch_full_.try_pop(&batch));
+    }
+    return batch;
+  }
+  void Recycle(Batch<Dtype>* batch, bool stalled, bool saturated) {
+    this->prefetch_stalled_ = stalled;
+    this->prefetch_saturated_ = saturated;
+    this->RecycleBatch(batch);
+  }
+  int depth() const { return this->prefetch_.size(); }
+  int queued() const {
+    return this->prefetch_free_.size() + this->prefetch_full_.size();
+  }
+  bool owns(const Batch<Dtype>* batch) const {
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      if (this->prefetch_[i].get() == batch) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    caffe_set(batch->data_.count(), Dtype(1), batch->data_.mutable_cpu_data());
+  }
+};
+
+template <typename TypeParam>
+class RecycleBatchTest : public CPUDeviceTest<TypeParam> {};
+
+TYPED_TEST_CASE(RecycleBatchTest, TestDtypes);
+
+TYPED_TEST(RecycleBatchTest, TestAddAndRetire) {
+  LayerParameter param;
+  PrefetchParameter* prefetch_param = param.mutable_prefetch_param();
+  prefetch_param->set_adaptive(true);
+  prefetch_param->set_count(2);
+  prefetch_param->set_min_count(1);
+  prefetch_param->set_max_count(3);
+  prefetch_param->set_adapt_interval(1);
+  prefetch_param->set_log_interval(0);
+  ConstantPrefetchingDataLayer<TypeParam> layer(param);
+  Blob<TypeParam> top;
+  vector<Blob<TypeParam>*> bottom_vec, top_vec(1, &top);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.StopInternalThread();
+  ASSERT_EQ(layer.depth(), 2);
+  ASSERT_EQ(layer.queued(), 2);
+
+  // a stall adds a batch shaped like the recycled one
+  Batch<TypeParam>* batch = layer.TakeBatch();
+  layer.Recycle(batch, true, false);
+  EXPECT_EQ(layer.depth(), 3);
+  EXPECT_EQ(layer.queued(), 3);
+  EXPECT_TRUE(layer.owns(batch));
+  for (int i = 0; i < 3; ++i) {
+    Batch<TypeParam>* queued_batch = layer.TakeBatch();
+    EXPECT_EQ(queued_batch->data_.count(), 6);
+    layer.Recycle(queued_batch, false, false);
+  }
+  // none past max_count
+  layer.Recycle(layer.TakeBatch(), true, false);
+  EXPECT_EQ(layer.depth(), 3);
+  EXPECT_EQ(layer.queued(), 3);
+
+  // an idle loader retires the recycled batch
+  batch = layer.TakeBatch();
+  layer.Recycle(batch, false, true);
+  EXPECT_EQ(layer.depth(), 2);
+  EXPECT_EQ(layer.queued(), 2);
+  EXPECT_FALSE(layer.owns(batch));
+  layer.Recycle(layer.TakeBatch(), false, true);
+  EXPECT_EQ(layer.depth(), 1);
+  // down to min_count
+  layer.Recycle(layer.TakeBatch(), false, true);
+  EXPECT_EQ(layer.depth(), 1);
+  EXPECT_EQ(layer.queued(), 1);
+}
+
+// A data layer loading the number of every batch, planned in order and
+// filled by its workers with delays that let later batches finish first.
+template <typename Dtype>
+class CountingPrefetchingDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit CountingPrefetchingDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param), next_(0) {}
+  virtual ~CountingPrefetchingDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    plans_.resize(this->loader_workers());
+    vector<int> shape(1, 1);
+    top[0]->Reshape(shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(shape);
+    }
+  }
+  virtual inline const char* type() const { return "CountingData"; }
+
+ protected:
+  virtual inline bool SupportsLoaderWorkers() const { return true; }
+  virtual void plan_batch(int worker_id) {
+    plans_[worker_id] = next_++;
+  }
+  virtual void fill_batch(Batch<Dtype>* batch, int worker_id) {
+    if (plans_[worker_id] % 4 == 0) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    }
+    batch->data_.mutable_cpu_data()[0] = plans_[worker_id];
+  }
+  virtual void load_batch(Batch<Dtype>* batch) {
+    plan_batch(0);
+    fill_batch(batch, 0);
+  }
+
+  int next_;
+  vector<int> plans_;
+};
+
+template <typename TypeParam>
+class LoaderWorkersTest : public CPUDeviceTest<TypeParam> {};
+
+TYPED_TEST_CASE(LoaderWorkersTest, TestDtypes);
+
+TYPED_TEST(LoaderWorkersTest, TestOrder) {
+  for (int workers = 1; workers <= 4; workers *= 2) {
+    LayerParameter param;
+    param.mutable_prefetch_param()->set_count(3);
+    param.mutable_prefetch_param()->set_workers(workers);
+    CountingPrefetchingDataLayer<TypeParam> layer(param);
+    Blob<TypeParam> top;
+    vector<Blob<TypeParam>*> bottom_vec, top_vec(1, &top);
+    layer.SetUp(bottom_vec, top_vec);
+    // the batches reach the net in the order they were planned
+    for (int i = 0; i < 20; ++i) {
+      layer.Forward(bottom_vec, top_vec);
+      EXPECT_EQ(top.cpu_data()[0], i) << "with " << workers << " workers";
+    }
+  }
+}
+
+}  // namespace caffe
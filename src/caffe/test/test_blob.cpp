@@ -112,6 +112,30 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestSwapData) {
+  Blob<TypeParam> other(2, 3, 4, 5);
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  TypeParam* other_data = other.mutable_cpu_data();
+  for (int i = 0; i < other.count(); ++i) {
+    data[i] = i;
+    other_data[i] = -i;
+  }
+  this->blob_preshaped_->SwapData(other);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data(), other_data);
+  EXPECT_EQ(other.cpu_data(), data);
+  for (int i = 0; i < other.count(); ++i) {
+    EXPECT_EQ(this->blob_preshaped_->cpu_data()[i], -i);
+    EXPECT_EQ(other.cpu_data()[i], i);
+  }
+  // A buffer received from a smaller blob must not be reused past its size.
+  Blob<TypeParam> small(1, 3, 4, 5);
+  Blob<TypeParam> large(2, 3, 4, 5);
+  large.Reshape(1, 3, 4, 5);
+  large.SwapData(small);
+  large.Reshape(2, 3, 4, 5);
+  EXPECT_GE(large.data()->size(), large.count() * sizeof(TypeParam));
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
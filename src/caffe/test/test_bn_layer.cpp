@@ -0,0 +1,250 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/bn_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class BNLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  BNLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    shape[3] = 3;
+    shape[4] = 5;
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    filler_param.set_mean(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~BNLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  void SetBNParam(BNParameter* param) {
+    param->mutable_slope_filler()->set_type("gaussian");
+    param->mutable_slope_filler()->set_mean(1.);
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+
+  // Forward and backward in place give what they give out of place, also
+  // when inverting the top with a zero scale, where the input cannot be
+  // recovered from the output.
+  void CheckInplace(const bool invert_top, const bool zero_scale) {
+    if (invert_top && Caffe::mode() == Caffe::GPU) {
+      LOG(ERROR) << "Skipping test: invert_top is only implemented on the CPU.";
+      return;
+    }
+    LayerParameter layer_param;
+    SetBNParam(layer_param.mutable_bn_param());
+    layer_param.mutable_bn_param()->set_invert_top(invert_top);
+    BNLayer<Dtype> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    if (zero_scale) {
+      layer.blobs()[0]->mutable_cpu_data()[1] = 0;
+    }
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+
+    // the same layer computing in place
+    Blob<Dtype> blob_inplace;
+    blob_inplace.CopyFrom(*blob_bottom_, false, true);
+    vector<Blob<Dtype>*> blob_inplace_vec(1, &blob_inplace);
+    BNLayer<Dtype> inplace_layer(layer_param);
+    inplace_layer.SetUp(blob_inplace_vec, blob_inplace_vec);
+    for (int i = 0; i < 2; ++i) {
+      inplace_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    inplace_layer.Forward(blob_inplace_vec, blob_inplace_vec);
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(blob_inplace.cpu_data()[i], blob_top_->cpu_data()[i],
+          1e-4);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_inplace.mutable_cpu_diff());
+    inplace_layer.Backward(blob_inplace_vec, propagate_down,
+        blob_inplace_vec);
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(blob_inplace.cpu_diff()[i], blob_bottom_->cpu_diff()[i],
+          1e-4);
+    }
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(inplace_layer.blobs()[0]->cpu_diff()[c],
+          layer.blobs()[0]->cpu_diff()[c], 1e-4);
+      EXPECT_NEAR(inplace_layer.blobs()[1]->cpu_diff()[c],
+          layer.blobs()[1]->cpu_diff()[c], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BNLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(BNLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetBNParam(layer_param.mutable_bn_param());
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int spatial_dim = 4 * 3 * 5;
+  const Dtype momentum = layer_param.bn_param().momentum();
+  for (int c = 0; c < 3; ++c) {
+    // every channel is normalized, then scaled and shifted
+    Dtype sum = 0, sum_sq = 0, bottom_sum = 0, bottom_sum_sq = 0;
+    for (int n = 0; n < 2; ++n) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        const int index = (n * 3 + c) * spatial_dim + i;
+        const Dtype x = this->blob_bottom_->cpu_data()[index];
+        const Dtype y = (this->blob_top_->cpu_data()[index]
+            - layer.blobs()[1]->cpu_data()[c]) / layer.blobs()[0]->cpu_data()[c];
+        sum += y;
+        sum_sq += y * y;
+        bottom_sum += x;
+        bottom_sum_sq += x * x;
+      }
+    }
+    const int m = 2 * spatial_dim;
+    EXPECT_NEAR(sum / m, 0, 1e-4);
+    EXPECT_NEAR(sum_sq / m, 1, 1e-3);
+    // the moving averages started from zero
+    const Dtype mean = bottom_sum / m;
+    EXPECT_NEAR(layer.blobs()[2]->cpu_data()[c], (1 - momentum) * mean, 1e-4);
+    EXPECT_NEAR(layer.blobs()[3]->cpu_data()[c],
+        (1 - momentum) * (bottom_sum_sq / m - mean * mean), 1e-4);
+  }
+}
+
+TYPED_TEST(BNLayerTest, TestFrozen) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  BNParameter* param = layer_param.mutable_bn_param();
+  this->SetBNParam(param);
+  param->set_frozen(true);
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype mean[3] = {0.5, -1, 2};
+  const Dtype variance[3] = {1, 0.25, 4};
+  for (int c = 0; c < 3; ++c) {
+    layer.blobs()[2]->mutable_cpu_data()[c] = mean[c];
+    layer.blobs()[3]->mutable_cpu_data()[c] = variance[c];
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_copy(this->blob_top_->count(), this->blob_bottom_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  const int spatial_dim = 4 * 3 * 5;
+  const Dtype eps = param->eps();
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      const Dtype a = layer.blobs()[0]->cpu_data()[c]
+          / std::sqrt(variance[c] + eps);
+      for (int i = 0; i < spatial_dim; ++i) {
+        const int index = (n * 3 + c) * spatial_dim + i;
+        const Dtype x = this->blob_bottom_->cpu_data()[index];
+        EXPECT_NEAR(this->blob_top_->cpu_data()[index],
+            (x - mean[c]) * a + layer.blobs()[1]->cpu_data()[c], 1e-4);
+        EXPECT_NEAR(this->blob_bottom_->cpu_diff()[index], x * a, 1e-4);
+      }
+    }
+  }
+  // the statistics stay put
+  EXPECT_EQ(layer.blobs()[2]->cpu_data()[1], mean[1]);
+  EXPECT_EQ(layer.blobs()[3]->cpu_data()[1], variance[1]);
+}
+
+TYPED_TEST(BNLayerTest, TestInplaceTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  this->SetBNParam(layer_param.mutable_bn_param());
+  vector<Blob<Dtype>*> blob_inplace_vec(1, this->blob_bottom_);
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(blob_inplace_vec, blob_inplace_vec);
+  const Dtype mean[3] = {0.5, -1, 2};
+  const Dtype variance[3] = {1, 0.25, 4};
+  for (int c = 0; c < 3; ++c) {
+    layer.blobs()[2]->mutable_cpu_data()[c] = mean[c];
+    layer.blobs()[3]->mutable_cpu_data()[c] = variance[c];
+  }
+  Blob<Dtype> bottom;
+  bottom.CopyFrom(*this->blob_bottom_, false, true);
+  layer.Forward(blob_inplace_vec, blob_inplace_vec);
+  caffe_copy(bottom.count(), bottom.cpu_data(),
+      this->blob_bottom_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(blob_inplace_vec, propagate_down, blob_inplace_vec);
+  // the gradient through the moving statistics, as when frozen
+  const int spatial_dim = 4 * 3 * 5;
+  const Dtype eps = layer_param.bn_param().eps();
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      const Dtype a = layer.blobs()[0]->cpu_data()[c]
+          / std::sqrt(variance[c] + eps);
+      for (int i = 0; i < spatial_dim; ++i) {
+        const int index = (n * 3 + c) * spatial_dim + i;
+        const Dtype x = bottom.cpu_data()[index];
+        EXPECT_NEAR(this->blob_bottom_->cpu_data()[index],
+            (x - mean[c]) * a + layer.blobs()[1]->cpu_data()[c], 1e-4);
+        EXPECT_NEAR(this->blob_bottom_->cpu_diff()[index], x * a, 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(BNLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetBNParam(layer_param.mutable_bn_param());
+  BNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(BNLayerTest, TestInplace) {
+  this->CheckInplace(false, false);
+}
+
+TYPED_TEST(BNLayerTest, TestInplaceInvertTop) {
+  this->CheckInplace(true, false);
+}
+
+TYPED_TEST(BNLayerTest, TestInplaceInvertTopZeroScale) {
+  this->CheckInplace(true, true);
+}
+
+}  // namespace caffe
@@ -0,0 +1,145 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/convolution2plus1d_layer.hpp"
+#include "caffe/layers/convolution3d_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class Convolution2Plus1DLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  Convolution2Plus1DLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 5;
+    shape[3] = 5;
+    shape[4] = 4;
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~Convolution2Plus1DLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  void SetConvolution2Plus1DParam(Convolution2Plus1DParameter* param) {
+    param->set_num_output(4);
+    param->set_kernel_size(3);
+    param->set_kernel_depth(3);
+    param->set_stride(2);
+    param->set_temporal_stride(2);
+    param->set_pad(1);
+    param->set_temporal_pad(1);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Convolution2Plus1DLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(Convolution2Plus1DLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetConvolution2Plus1DParam(
+      layer_param.mutable_convolution2plus1d_param());
+  Convolution2Plus1DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 4);
+  EXPECT_EQ(this->blob_top_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_->shape(3), 3);
+  EXPECT_EQ(this->blob_top_->shape(4), 2);
+  // 3 * 27 * 4 / (27 + 3 * 4) intermediate channels
+  EXPECT_EQ(layer.blobs()[0]->shape(0), 8);
+  EXPECT_EQ(layer.blobs()[1]->shape(1), 8);
+  EXPECT_EQ(layer.blobs()[1]->shape(2), 3);
+}
+
+TYPED_TEST(Convolution2Plus1DLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution2Plus1DParameter* param =
+      layer_param.mutable_convolution2plus1d_param();
+  this->SetConvolution2Plus1DParam(param);
+  param->set_mid_output(5);
+  Convolution2Plus1DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // The same factors as two Convolution3D layers.
+  LayerParameter spatial_param;
+  Convolution3DParameter* spatial =
+      spatial_param.mutable_convolution3d_param();
+  spatial->set_num_output(5);
+  spatial->set_kernel_size(3);
+  spatial->set_kernel_depth(1);
+  spatial->set_stride(2);
+  spatial->set_pad(1);
+  spatial->set_bias_term(false);
+  Convolution3DLayer<Dtype> spatial_layer(spatial_param);
+  Blob<Dtype> mid;
+  vector<Blob<Dtype>*> mid_vec(1, &mid);
+  spatial_layer.SetUp(this->blob_bottom_vec_, mid_vec);
+  spatial_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+  spatial_layer.Forward(this->blob_bottom_vec_, mid_vec);
+
+  LayerParameter temporal_param;
+  Convolution3DParameter* temporal =
+      temporal_param.mutable_convolution3d_param();
+  temporal->set_num_output(4);
+  temporal->set_kernel_size(1);
+  temporal->set_kernel_depth(3);
+  temporal->set_temporal_stride(2);
+  temporal->set_temporal_pad(1);
+  Convolution3DLayer<Dtype> temporal_layer(temporal_param);
+  Blob<Dtype> ref_top;
+  vector<Blob<Dtype>*> ref_top_vec(1, &ref_top);
+  temporal_layer.SetUp(mid_vec, ref_top_vec);
+  temporal_layer.blobs()[0]->CopyFrom(*layer.blobs()[1]);
+  temporal_layer.blobs()[1]->CopyFrom(*layer.blobs()[2]);
+  temporal_layer.Forward(mid_vec, ref_top_vec);
+
+  ASSERT_EQ(this->blob_top_->shape(), ref_top.shape());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution2Plus1DLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution2Plus1DParameter* param =
+      layer_param.mutable_convolution2plus1d_param();
+  this->SetConvolution2Plus1DParam(param);
+  param->set_mid_output(3);
+  Convolution2Plus1DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
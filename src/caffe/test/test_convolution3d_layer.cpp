@@ -0,0 +1,472 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/convolution3d_layer.hpp"
+#include "caffe/layers/layout3d_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// Reference 3D convolution for checking results:
+// accumulate through explicit loops over input, output, and filters.
+template <typename Dtype>
+void caffe_conv3d(const Blob<Dtype>* in, const Convolution3DParameter& param,
+    const vector<shared_ptr<Blob<Dtype> > >& weights, Blob<Dtype>* out) {
+  const int kernel_size = param.kernel_size();
+  const int kernel_depth = param.kernel_depth();
+  const int stride = param.stride();
+  const int temporal_stride = param.temporal_stride();
+  const int pad = param.pad();
+  const int temporal_pad = param.temporal_pad();
+  const int group = param.group();
+  const int channels = in->shape(1) / group;
+  const int outputs = out->shape(1) / group;
+  const int length = in->shape(2);
+  const int height = in->shape(3);
+  const int width = in->shape(4);
+  const Dtype* in_data = in->cpu_data();
+  const Dtype* weight_data = weights[0]->cpu_data();
+  Dtype* out_data = out->mutable_cpu_data();
+  for (int n = 0; n < out->shape(0); ++n) {
+    for (int o = 0; o < out->shape(1); ++o) {
+      for (int l = 0; l < out->shape(2); ++l) {
+        for (int y = 0; y < out->shape(3); ++y) {
+          for (int x = 0; x < out->shape(4); ++x) {
+            Dtype sum = param.bias_term() ? weights[1]->cpu_data()[o] : 0;
+            const int g = o / outputs;
+            for (int c = 0; c < channels; ++c) {
+              for (int r = 0; r < kernel_depth; ++r) {
+                for (int p = 0; p < kernel_size; ++p) {
+                  for (int q = 0; q < kernel_size; ++q) {
+                    const int in_l = l * temporal_stride - temporal_pad + r;
+                    const int in_y = y * stride - pad + p;
+                    const int in_x = x * stride - pad + q;
+                    if (in_l >= 0 && in_l < length && in_y >= 0
+                        && in_y < height && in_x >= 0 && in_x < width) {
+                      sum += in_data[(((n * in->shape(1) + g * channels + c)
+                          * length + in_l) * height + in_y) * width + in_x]
+                          * weight_data[(((o * channels + c) * kernel_depth + r)
+                          * kernel_size + p) * kernel_size + q];
+                    }
+                  }
+                }
+              }
+            }
+            out_data[(((n * out->shape(1) + o) * out->shape(2) + l)
+                * out->shape(3) + y) * out->shape(4) + x] = sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename TypeParam>
+class Convolution3DLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  Convolution3DLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    vector<int> shape(5);
+    shape[0] = 3;
+    shape[1] = 2;
+    shape[2] = 4;
+    shape[3] = 5;
+    shape[4] = 5;
+    blob_bottom_->Reshape(shape);
+    // fill the values
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~Convolution3DLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  void SetConvolution3DParam(Convolution3DParameter* param) {
+    param->set_kernel_size(3);
+    param->set_kernel_depth(3);
+    param->set_stride(2);
+    param->set_pad(1);
+    param->set_temporal_pad(1);
+    param->set_num_output(4);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+
+  // Copies blob to out in the given layout.
+  void ConvertLayout(Blob<Dtype>* blob, const Layout3D layout,
+      Blob<Dtype>* out) {
+    LayerParameter layer_param;
+    layer_param.mutable_layout3d_param()->set_layout(layout);
+    Layout3DLayer<Dtype> layer(layer_param);
+    vector<Blob<Dtype>*> bottom_vec(1, blob);
+    vector<Blob<Dtype>*> top_vec(1, out);
+    layer.SetUp(bottom_vec, top_vec);
+    layer.Forward(bottom_vec, top_vec);
+  }
+
+  // Runs the layer on the bottom converted to NDHWC and checks the top,
+  // converted back, against caffe_conv3d.
+  void TestNDHWCForward(LayerParameter* layer_param) {
+    Convolution3DParameter* param = layer_param->mutable_convolution3d_param();
+    param->set_layout(NDHWC);
+    Blob<Dtype> bottom_ndhwc;
+    ConvertLayout(blob_bottom_, NDHWC, &bottom_ndhwc);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom_ndhwc);
+    Convolution3DLayer<Dtype> layer(*layer_param);
+    layer.SetUp(bottom_vec, blob_top_vec_);
+    layer.Forward(bottom_vec, blob_top_vec_);
+    EXPECT_EQ(blob_top_->shape(4), param->num_output());
+    Blob<Dtype> top;
+    ConvertLayout(blob_top_, NCDHW, &top);
+    Blob<Dtype> ref_top;
+    ref_top.ReshapeLike(top);
+    caffe_conv3d(blob_bottom_, *param, layer.blobs(), &ref_top);
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(top.cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Convolution3DLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(Convolution3DLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetConvolution3DParam(layer_param.mutable_convolution3d_param());
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->shape(0), 3);
+  EXPECT_EQ(this->blob_top_->shape(1), 4);
+  EXPECT_EQ(this->blob_top_->shape(2), 4);
+  EXPECT_EQ(this->blob_top_->shape(3), 3);
+  EXPECT_EQ(this->blob_top_->shape(4), 3);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestSimpleConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestBatchedConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  // Enough room to unfold all samples for a single GEMM.
+  param->set_col_buffer_mb(1);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetConvolution3DParam(layer_param.mutable_convolution3d_param());
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestBatchedGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_col_buffer_mb(1);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestPointwiseConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_kernel_size(1);
+  param->set_kernel_depth(1);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_temporal_pad(0);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestPointwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_kernel_size(1);
+  param->set_kernel_depth(1);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_temporal_pad(0);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestWinogradConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_stride(1);
+  param->set_num_output(5);
+  param->set_engine(Convolution3DParameter_Engine_WINOGRAD);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+  // Same weights through the vol2col engine.
+  param->set_engine(Convolution3DParameter_Engine_CAFFE);
+  Convolution3DLayer<Dtype> caffe_layer(layer_param);
+  Blob<Dtype> caffe_top;
+  vector<Blob<Dtype>*> caffe_top_vec(1, &caffe_top);
+  caffe_layer.SetUp(this->blob_bottom_vec_, caffe_top_vec);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    caffe_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  caffe_layer.Forward(this->blob_bottom_vec_, caffe_top_vec);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], caffe_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestWinogradWeightUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_engine(Convolution3DParameter_Engine_WINOGRAD);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // New weights must not be convolved with the cached transformed filters.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(layer.blobs()[0].get());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestWinogradGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_temporal_pad(0);
+  param->set_engine(Convolution3DParameter_Engine_WINOGRAD);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestGroupConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape = this->blob_bottom_->shape();
+  shape[1] = 4;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_group(2);
+  param->set_filter_group(2);
+  // Per-sample columns, batched columns, and pointwise kernels.
+  for (int config = 0; config < 3; ++config) {
+    if (config == 1) {
+      param->set_col_buffer_mb(1);
+    } else if (config == 2) {
+      param->set_kernel_size(1);
+      param->set_kernel_depth(1);
+      param->set_stride(1);
+      param->set_pad(0);
+      param->set_temporal_pad(0);
+    }
+    Convolution3DLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(layer.blobs()[0]->shape(1), 2);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.ReshapeLike(*this->blob_top_);
+    caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i],
+          1e-4);
+    }
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestGroupGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape = this->blob_bottom_->shape();
+  shape[1] = 4;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_group(2);
+  param->set_filter_group(2);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestDepthwiseConvolution3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  // One input channel per group, two outputs per channel.
+  param->set_group(2);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> ref_top;
+  ref_top.ReshapeLike(*this->blob_top_);
+  caffe_conv3d(this->blob_bottom_, *param, layer.blobs(), &ref_top);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], ref_top.cpu_data()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestDepthwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_group(2);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestNDHWCConvolution3D) {
+  LayerParameter layer_param;
+  this->SetConvolution3DParam(layer_param.mutable_convolution3d_param());
+  this->TestNDHWCForward(&layer_param);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestNDHWCGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_layout(NDHWC);
+  vector<int> shape(this->blob_bottom_->shape());
+  shape.push_back(shape[1]);
+  shape.erase(shape.begin() + 1);
+  this->blob_bottom_->Reshape(shape);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestNDHWCPointwiseConvolution3D) {
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_kernel_size(1);
+  param->set_kernel_depth(1);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_temporal_pad(0);
+  this->TestNDHWCForward(&layer_param);
+}
+
+TYPED_TEST(Convolution3DLayerTest, TestNDHWCPointwiseGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Convolution3DParameter* param = layer_param.mutable_convolution3d_param();
+  this->SetConvolution3DParam(param);
+  param->set_kernel_size(1);
+  param->set_kernel_depth(1);
+  param->set_stride(1);
+  param->set_pad(0);
+  param->set_temporal_pad(0);
+  param->set_layout(NDHWC);
+  vector<int> shape(this->blob_bottom_->shape());
+  shape.push_back(shape[1]);
+  shape.erase(shape.begin() + 1);
+  this->blob_bottom_->Reshape(shape);
+  Convolution3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
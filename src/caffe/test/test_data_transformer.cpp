@@ -340,5 +340,73 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestTwostreamSharedCropMirror) {
+  TransformationParameter transform_param;
+  const int channels = 2;
+  const int height = 4;
+  const int width = 5;
+  const int crop_size = 2;
+  const int size = crop_size * crop_size;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_new_height(height);
+  transform_param.set_new_width(width);
+  transform_param.add_mean_value(0);
+  // rgb pixels are 0, 1, ..., flow ones 100, 101, ..., x flow first
+  Datum rgb_datum, flow_datum;
+  FillDatum(0, channels, height, width, true, &rgb_datum);
+  FillDatum(0, channels, height, width, true, &flow_datum);
+  string* flow_data = flow_datum.mutable_data();
+  for (int j = 0; j < flow_data->size(); ++j) {
+    (*flow_data)[j] = static_cast<char>(100 + j);
+  }
+  Blob<TypeParam> rgb_blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> flow_blob(1, channels, crop_size, crop_size);
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  transformer.InitRand();
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.TransformVariedSizeTwostreamDatum(rgb_datum, flow_datum,
+        &rgb_blob, &flow_blob);
+    const TypeParam* rgb = rgb_blob.cpu_data();
+    const TypeParam* flow = flow_blob.cpu_data();
+    // Find the crop and mirror that give the rgb output, computed from the
+    // input; the flow output must be what the same crop and mirror give,
+    // with x flow inverted when mirrored.
+    int num_found = 0;
+    for (int h_off = 0; h_off <= height - crop_size; ++h_off) {
+      for (int w_off = 0; w_off <= width - crop_size; ++w_off) {
+        for (int mirror = 0; mirror < 2; ++mirror) {
+          vector<TypeParam> expected_rgb, expected_flow;
+          for (int c = 0; c < channels; ++c) {
+            for (int h = 0; h < crop_size; ++h) {
+              for (int w = 0; w < crop_size; ++w) {
+                const int in_w = w_off + (mirror ? crop_size - 1 - w : w);
+                const int in = (c * height + h_off + h) * width + in_w;
+                expected_rgb.push_back(in);
+                expected_flow.push_back(mirror && c == 0 ?
+                    255 - (100 + in) : 100 + in);
+              }
+            }
+          }
+          bool match = true;
+          for (int j = 0; j < channels * size; ++j) {
+            match = match && rgb[j] == expected_rgb[j];
+          }
+          if (!match) {
+            continue;
+          }
+          ++num_found;
+          for (int j = 0; j < channels * size; ++j) {
+            EXPECT_EQ(expected_flow[j], flow[j]);
+          }
+        }
+      }
+    }
+    EXPECT_EQ(num_found, 1);
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fold_batch_norm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FoldBatchNormTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+  }
+
+  // Build a net of the given layers with random blobs, run it on random
+  // inputs, and run the net FoldBatchNorm makes of it on the same inputs.
+  void RunFolded(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    Net<float> net(param);
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(1.5);
+    UniformFiller<float> blob_filler(filler_param);
+    for (int i = 0; i < param.layer_size(); ++i) {
+      const vector<shared_ptr<Blob<float> > >& blobs =
+          net.layer_by_name(param.layer(i).name())->blobs();
+      for (int j = 0; j < blobs.size(); ++j) {
+        blob_filler.Fill(blobs[j].get());
+        blobs[j]->ToProto(param.mutable_layer(i)->add_blobs());
+      }
+    }
+    GaussianFiller<float> filler((FillerParameter()));
+    filler.Fill(net.blob_by_name("data").get());
+    filler.Fill(net.blob_by_name("clip").get());
+    net.Forward();
+
+    FoldBatchNorm(param, &folded_param_);
+    Net<float> folded_net(folded_param_);
+    folded_net.CopyTrainedLayersFrom(folded_param_);
+    folded_net.blob_by_name("data")->CopyFrom(*net.blob_by_name("data"));
+    folded_net.blob_by_name("clip")->CopyFrom(*net.blob_by_name("clip"));
+    folded_net.Forward();
+    for (int i = 0; i < net.output_blobs().size(); ++i) {
+      const string& blob_name =
+          net.blob_names()[net.output_blob_indices()[i]];
+      ASSERT_TRUE(folded_net.has_blob(blob_name)) << blob_name;
+      const Blob<float>* output = net.output_blobs()[i];
+      const Blob<float>* folded_output =
+          folded_net.blob_by_name(blob_name).get();
+      ASSERT_EQ(output->count(), folded_output->count());
+      for (int j = 0; j < output->count(); ++j) {
+        EXPECT_NEAR(output->cpu_data()[j], folded_output->cpu_data()[j],
+            1e-3 * std::max(1.f, std::fabs(output->cpu_data()[j])))
+            << blob_name;
+      }
+    }
+  }
+
+  bool HasLayer(const string& layer_name) const {
+    for (int i = 0; i < folded_param_.layer_size(); ++i) {
+      if (folded_param_.layer(i).name() == layer_name) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  NetParameter folded_param_;
+};
+
+static const char* kInputs =
+    "layer { "
+    "  name: 'data' type: 'Input' top: 'data' "
+    "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } "
+    "} "
+    "layer { "
+    "  name: 'clip' type: 'Input' top: 'clip' "
+    "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 6 dim: 6 } } "
+    "} ";
+
+TEST_F(FoldBatchNormTest, TestFold) {
+  const string proto = string(kInputs) +
+      // BN in place after a Convolution without bias
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 bias_term: false } "
+      "} "
+      "layer { name: 'conv_bn' type: 'BN' bottom: 'conv' top: 'conv' } "
+      // InnerProduct with transposed weights and a Bias
+      "layer { "
+      "  name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 5 transpose: true } "
+      "} "
+      "layer { name: 'ip_bias' type: 'Bias' bottom: 'ip' top: 'ip_bias' } "
+      // BatchNorm and in-place Scale after a Convolution3D
+      "layer { "
+      "  name: 'conv3d' type: 'Convolution3D' bottom: 'clip' top: 'conv3d' "
+      "  convolution3d_param { "
+      "    num_output: 4 kernel_size: 3 kernel_depth: 3 pad: 1 "
+      "    temporal_pad: 1 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv3d_bn' type: 'BatchNorm' bottom: 'conv3d' "
+      "  top: 'conv3d_bn' "
+      "} "
+      "layer { "
+      "  name: 'conv3d_scale' type: 'Scale' bottom: 'conv3d_bn' "
+      "  top: 'conv3d_bn' scale_param { bias_term: true } "
+      "} "
+      "layer { "
+      "  name: 'relu' type: 'ReLU' bottom: 'conv3d_bn' top: 'conv3d_bn' "
+      "} ";
+  this->RunFolded(proto);
+  EXPECT_EQ(this->folded_param_.layer_size(), 6);
+  EXPECT_FALSE(this->HasLayer("conv_bn"));
+  EXPECT_FALSE(this->HasLayer("ip_bias"));
+  EXPECT_FALSE(this->HasLayer("conv3d_bn"));
+  EXPECT_FALSE(this->HasLayer("conv3d_scale"));
+}
+
+TEST_F(FoldBatchNormTest, TestNoFold) {
+  const string proto = string(kInputs) +
+      // the unnormalized top is read as well
+      "layer { "
+      "  name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 } "
+      "} "
+      "layer { name: 'conv_bn' type: 'BN' bottom: 'conv' top: 'conv_bn' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'relu' } "
+      // a BN computing batch statistics
+      "layer { "
+      "  name: 'conv3d' type: 'Convolution3D' bottom: 'clip' top: 'conv3d' "
+      "  convolution3d_param { num_output: 4 kernel_size: 1 kernel_depth: 1 } "
+      "} "
+      "layer { "
+      "  name: 'conv3d_bn' type: 'BatchNorm' bottom: 'conv3d' "
+      "  top: 'conv3d' batch_norm_param { use_global_stats: false } "
+      "} ";
+  this->RunFolded(proto);
+  EXPECT_TRUE(this->HasLayer("conv_bn"));
+  EXPECT_TRUE(this->HasLayer("conv3d_bn"));
+}
+
+}  // namespace caffe
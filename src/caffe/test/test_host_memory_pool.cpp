@@ -0,0 +1,117 @@
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Caffe::set_host_memory_cache_limit(size_t(1) << 30);
+  }
+};
+
+TEST_F(HostMemoryPoolTest, TestClassSize) {
+  EXPECT_EQ(HostMemoryPool::ClassSize(1), 64);
+  EXPECT_EQ(HostMemoryPool::ClassSize(64), 64);
+  EXPECT_EQ(HostMemoryPool::ClassSize(65), 80);
+  EXPECT_EQ(HostMemoryPool::ClassSize(128), 128);
+  EXPECT_EQ(HostMemoryPool::ClassSize(129), 160);
+  size_t previous = 0;
+  for (size_t size = 1; size < (1 << 20); size = size * 3 / 2 + 1) {
+    const size_t class_size = HostMemoryPool::ClassSize(size);
+    EXPECT_GE(class_size, size);
+    EXPECT_LT(class_size, size + size / 4 + 64);
+    EXPECT_GE(class_size, previous);
+    EXPECT_EQ(HostMemoryPool::ClassSize(class_size), class_size);
+    previous = class_size;
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestReuse) {
+  HostMemoryPool& pool = HostMemoryPool::Get();
+  const size_t in_use = Caffe::host_memory_in_use();
+  void* ptr = pool.Allocate(1000, false);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % 64, 0);
+  EXPECT_EQ(Caffe::host_memory_in_use(), in_use + 1024);
+  EXPECT_GE(Caffe::host_memory_peak(), in_use + 1024);
+  pool.Free(ptr, 1000, false);
+  EXPECT_EQ(Caffe::host_memory_in_use(), in_use);
+  const size_t cached = Caffe::host_memory_cached();
+  EXPECT_GE(cached, 1024);
+  // a request of the same class gets the cached block back
+  EXPECT_EQ(pool.Allocate(1010, false), ptr);
+  EXPECT_EQ(Caffe::host_memory_cached(), cached - 1024);
+  pool.Free(ptr, 1010, false);
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemory) {
+  const size_t in_use = Caffe::host_memory_in_use();
+  const void* ptr;
+  {
+    SyncedMemory mem(1 << 20);
+    ptr = mem.cpu_data();
+    EXPECT_EQ(Caffe::host_memory_in_use(), in_use + (1 << 20));
+  }
+  EXPECT_EQ(Caffe::host_memory_in_use(), in_use);
+  // the block comes back zeroed
+  SyncedMemory mem(1 << 20);
+  EXPECT_EQ(mem.cpu_data(), ptr);
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(data[i], 0);
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestCacheLimit) {
+  HostMemoryPool& pool = HostMemoryPool::Get();
+  Caffe::set_host_memory_cache_limit(0);
+  EXPECT_EQ(Caffe::host_memory_cached(), 0);
+  void* ptr = pool.Allocate(1000, false);
+  pool.Free(ptr, 1000, false);
+  EXPECT_EQ(Caffe::host_memory_cached(), 0);
+}
+
+TEST_F(HostMemoryPoolTest, TestEviction) {
+  HostMemoryPool& pool = HostMemoryPool::Get();
+  pool.Trim();
+  Caffe::set_host_memory_cache_limit(4096);
+  void* ptr1024 = pool.Allocate(1024, false);
+  void* ptr2048 = pool.Allocate(2048, false);
+  void* ptr1536 = pool.Allocate(1536, false);
+  pool.Free(ptr1024, 1024, false);
+  pool.Free(ptr2048, 2048, false);
+  EXPECT_EQ(Caffe::host_memory_cached(), 3072);
+  // caching the last block evicts the class used longest ago
+  pool.Free(ptr1536, 1536, false);
+  EXPECT_EQ(Caffe::host_memory_cached(), 2048 + 1536);
+  EXPECT_EQ(pool.Allocate(2048, false), ptr2048);
+  EXPECT_EQ(Caffe::host_memory_cached(), 1536);
+  pool.Free(ptr2048, 2048, false);
+  // a lower limit evicts down to it
+  Caffe::set_host_memory_cache_limit(2048);
+  EXPECT_EQ(Caffe::host_memory_cached(), 2048);
+  // blocks larger than the limit are not cached at all
+  void* ptr = pool.Allocate(3000, false);
+  pool.Free(ptr, 3000, false);
+  EXPECT_EQ(Caffe::host_memory_cached(), 2048);
+}
+
+TEST_F(HostMemoryPoolTest, TestHugePages) {
+  HostMemoryPool& pool = HostMemoryPool::Get();
+  pool.Trim();
+  Caffe::set_host_huge_pages(true);
+  void* ptr = pool.Allocate(3 << 20, false);
+  Caffe::set_host_huge_pages(false);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % (2 << 20), 0);
+  static_cast<char*>(ptr)[(3 << 20) - 1] = 1;
+  pool.Free(ptr, 3 << 20, false);
+}
+
+}  // namespace caffe
@@ -186,6 +186,33 @@ TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestLoaderWorkers) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(2);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_shuffle(true);
+  // Four workers hand the net the labels one does, over several epochs.
+  vector<Dtype> labels[2];
+  for (int run = 0; run < 2; ++run) {
+    param.mutable_prefetch_param()->set_workers(run == 0 ? 1 : 4);
+    Caffe::set_random_seed(this->seed_);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 8; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < 2; ++i) {
+        labels[run].push_back(this->blob_top_label_->cpu_data()[i]);
+      }
+    }
+  }
+  ASSERT_EQ(labels[0].size(), labels[1].size());
+  for (int i = 0; i < labels[0].size(); ++i) {
+    EXPECT_EQ(labels[0][i], labels[1][i]);
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestSpace) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
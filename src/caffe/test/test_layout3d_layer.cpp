@@ -0,0 +1,559 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/bn_layer.hpp"
+#include "caffe/layers/layout3d_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/insert_layouts.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class Layout3DLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  Layout3DLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    shape[3] = 5;
+    shape[4] = 6;
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~Layout3DLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Layout3DLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(Layout3DLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Layout3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(this->blob_top_->num_axes(), 5);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 4);
+  EXPECT_EQ(this->blob_top_->shape(2), 5);
+  EXPECT_EQ(this->blob_top_->shape(3), 6);
+  EXPECT_EQ(this->blob_top_->shape(4), 3);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int spatial_dim = 4 * 5 * 6;
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        EXPECT_EQ(this->blob_bottom_->cpu_data()[(n * 3 + c) * spatial_dim
+            + i], this->blob_top_->cpu_data()[(n * spatial_dim + i) * 3 + c]);
+      }
+    }
+  }
+  // and back
+  layer_param.mutable_layout3d_param()->set_layout(NCDHW);
+  Layout3DLayer<Dtype> inverse_layer(layer_param);
+  Blob<Dtype> round_trip;
+  vector<Blob<Dtype>*> round_trip_vec(1, &round_trip);
+  inverse_layer.SetUp(this->blob_top_vec_, round_trip_vec);
+  inverse_layer.Forward(this->blob_top_vec_, round_trip_vec);
+  ASSERT_EQ(round_trip.shape(), this->blob_bottom_->shape());
+  for (int i = 0; i < round_trip.count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i], round_trip.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(Layout3DLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int layout = 0; layout < 2; ++layout) {
+    LayerParameter layer_param;
+    layer_param.mutable_layout3d_param()->set_layout(
+        layout == 0 ? NDHWC : NCDHW);
+    Layout3DLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(Layout3DLayerTest, TestBNNDHWC) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  BNParameter* bn_param = layer_param.mutable_bn_param();
+  bn_param->mutable_slope_filler()->set_type("gaussian");
+  bn_param->mutable_bias_filler()->set_type("gaussian");
+  BNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  LayerParameter layout_param;
+  Layout3DLayer<Dtype> layout_layer(layout_param);
+  Blob<Dtype> bottom_ndhwc, top_ndhwc;
+  vector<Blob<Dtype>*> bottom_ndhwc_vec(1, &bottom_ndhwc);
+  vector<Blob<Dtype>*> top_ndhwc_vec(1, &top_ndhwc);
+  layout_layer.SetUp(this->blob_bottom_vec_, bottom_ndhwc_vec);
+  layout_layer.Forward(this->blob_bottom_vec_, bottom_ndhwc_vec);
+  bn_param->set_layout(NDHWC);
+  BNLayer<Dtype> ndhwc_layer(layer_param);
+  ndhwc_layer.SetUp(bottom_ndhwc_vec, top_ndhwc_vec);
+  for (int i = 0; i < 2; ++i) {
+    ndhwc_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  ndhwc_layer.Forward(bottom_ndhwc_vec, top_ndhwc_vec);
+
+  const int spatial_dim = 4 * 5 * 6;
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        EXPECT_NEAR(this->blob_top_->cpu_data()[(n * 3 + c) * spatial_dim + i],
+            top_ndhwc.cpu_data()[(n * spatial_dim + i) * 3 + c], 1e-4);
+      }
+    }
+  }
+
+  // backward from the same top diff in either layout
+  Blob<Dtype> top_diff, top_diff_ndhwc;
+  vector<Blob<Dtype>*> top_diff_vec(1, &top_diff);
+  vector<Blob<Dtype>*> top_diff_ndhwc_vec(1, &top_diff_ndhwc);
+  top_diff.ReshapeLike(*this->blob_top_);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&top_diff);
+  layout_layer.Reshape(top_diff_vec, top_diff_ndhwc_vec);
+  layout_layer.Forward(top_diff_vec, top_diff_ndhwc_vec);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_copy(top_diff_ndhwc.count(), top_diff_ndhwc.cpu_data(),
+      top_ndhwc.mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  ndhwc_layer.Backward(top_ndhwc_vec, propagate_down, bottom_ndhwc_vec);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        EXPECT_NEAR(this->blob_bottom_->cpu_diff()[(n * 3 + c) * spatial_dim
+            + i], bottom_ndhwc.cpu_diff()[(n * spatial_dim + i) * 3 + c],
+            1e-4);
+      }
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(layer.blobs()[i]->cpu_data()[c],
+          ndhwc_layer.blobs()[i]->cpu_data()[c], 1e-4);
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      EXPECT_NEAR(layer.blobs()[i]->cpu_diff()[c],
+          ndhwc_layer.blobs()[i]->cpu_diff()[c], 1e-4);
+    }
+  }
+
+  // and through the moving statistics of frozen layers
+  bn_param->set_frozen(true);
+  BNLayer<Dtype> frozen_ndhwc_layer(layer_param);
+  frozen_ndhwc_layer.SetUp(bottom_ndhwc_vec, top_ndhwc_vec);
+  bn_param->set_layout(NCDHW);
+  BNLayer<Dtype> frozen_layer(layer_param);
+  frozen_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < 4; ++i) {
+    frozen_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    frozen_ndhwc_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  frozen_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  frozen_ndhwc_layer.Forward(bottom_ndhwc_vec, top_ndhwc_vec);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  caffe_copy(top_diff_ndhwc.count(), top_diff_ndhwc.cpu_data(),
+      top_ndhwc.mutable_cpu_diff());
+  frozen_layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  frozen_ndhwc_layer.Backward(top_ndhwc_vec, propagate_down,
+      bottom_ndhwc_vec);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int i = 0; i < spatial_dim; ++i) {
+        const int index = (n * 3 + c) * spatial_dim + i;
+        const int ndhwc_index = (n * spatial_dim + i) * 3 + c;
+        EXPECT_NEAR(this->blob_top_->cpu_data()[index],
+            top_ndhwc.cpu_data()[ndhwc_index], 1e-4);
+        EXPECT_NEAR(this->blob_bottom_->cpu_diff()[index],
+            bottom_ndhwc.cpu_diff()[ndhwc_index], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(Layout3DLayerTest, TestNetNDHWC) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 dim: 6 } } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution3d_param { "
+      "    num_output: 4 kernel_size: 3 kernel_depth: 3 pad: 1 "
+      "    temporal_pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling3D' "
+      "  bottom: 'conv' "
+      "  top: 'pool' "
+      "  pooling3d_param { "
+      "    pool: MAX kernel_size: 2 kernel_depth: 2 stride: 2 "
+      "    temporal_stride: 2 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> net(param);
+  param.set_layout3d(NDHWC);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> ndhwc_net(param);
+  EXPECT_TRUE(ndhwc_net.has_layer("data_ndhwc"));
+  EXPECT_TRUE(ndhwc_net.has_layer("pool_ncdhw"));
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.blob_by_name("data").get());
+  ndhwc_net.blob_by_name("data")->CopyFrom(*net.blob_by_name("data"));
+  net.Forward();
+  ndhwc_net.Forward();
+  const Blob<Dtype>* ip = net.blob_by_name("ip").get();
+  const Blob<Dtype>* ndhwc_ip = ndhwc_net.blob_by_name("ip").get();
+  ASSERT_EQ(ip->count(), ndhwc_ip->count());
+  for (int i = 0; i < ip->count(); ++i) {
+    EXPECT_NEAR(ip->cpu_data()[i], ndhwc_ip->cpu_data()[i], 1e-4);
+  }
+}
+
+class Layout3DInsertionTest : public ::testing::Test {
+ protected:
+  void RunInsertionTest(
+      const string& input_param_string, const string& output_param_string) {
+    // Test that InsertLayoutConversions called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    InsertLayoutConversions(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_layout_insert_param;
+    InsertLayoutConversions(actual_output_param,
+        &double_layout_insert_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+       double_layout_insert_param.DebugString());
+  }
+};
+
+TEST_F(Layout3DInsertionTest, TestNoInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'ip' "
+      "} ";
+  this->RunInsertionTest(input_proto, input_proto);
+}
+
+TEST_F(Layout3DInsertionTest, TestInsertion) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layout3d: NDHWC "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'bn' "
+      "  type: 'BN' "
+      "  bottom: 'conv' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling3D' "
+      "  bottom: 'bn' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Scale' "
+      "  bottom: 'pool' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool' "
+      "  top: 'ip2' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layout3d: NDHWC "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'data_ndhwc' "
+      "  type: 'Layout3D' "
+      "  bottom: 'data' "
+      "  top: 'data_ndhwc' "
+      "  layout3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data_ndhwc' "
+      "  top: 'conv' "
+      "  convolution3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'bn' "
+      "  type: 'BN' "
+      "  bottom: 'conv' "
+      "  top: 'bn' "
+      "  bn_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling3D' "
+      "  bottom: 'bn' "
+      "  top: 'pool' "
+      "  pooling3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'pool_ncdhw' "
+      "  type: 'Layout3D' "
+      "  bottom: 'pool' "
+      "  top: 'pool_ncdhw' "
+      "  layout3d_param { layout: NCDHW } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool_ncdhw' "
+      "  top: 'ip' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Scale' "
+      "  bottom: 'pool_ncdhw' "
+      "  top: 'pool_ncdhw' "
+      "} "
+      "layer { "
+      "  name: 'ip2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'pool_ncdhw' "
+      "  top: 'ip2' "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+TEST_F(Layout3DInsertionTest, TestKeptBlobs) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layout3d: NDHWC "
+      "keep_blob: 'conv' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'bn' "
+      "  type: 'BN' "
+      "  bottom: 'conv' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling3D' "
+      "  bottom: 'bn' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Scale' "
+      "  bottom: 'pool' "
+      "  top: 'pool' "
+      "} ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layout3d: NDHWC "
+      "keep_blob: 'conv' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'data_ndhwc' "
+      "  type: 'Layout3D' "
+      "  bottom: 'data' "
+      "  top: 'data_ndhwc' "
+      "  layout3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution3D' "
+      "  bottom: 'data_ndhwc' "
+      "  top: 'conv_ndhwc' "
+      "  convolution3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'bn' "
+      "  type: 'BN' "
+      "  bottom: 'conv_ndhwc' "
+      "  top: 'bn' "
+      "  bn_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'relu' "
+      "  type: 'ReLU' "
+      "  bottom: 'bn' "
+      "  top: 'bn' "
+      "} "
+      "layer { "
+      "  name: 'pool' "
+      "  type: 'Pooling3D' "
+      "  bottom: 'bn' "
+      "  top: 'pool_ndhwc' "
+      "  pooling3d_param { layout: NDHWC } "
+      "} "
+      "layer { "
+      "  name: 'pool_ndhwc_ncdhw' "
+      "  type: 'Layout3D' "
+      "  bottom: 'pool_ndhwc' "
+      "  top: 'pool' "
+      "  layout3d_param { layout: NCDHW } "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Scale' "
+      "  bottom: 'pool' "
+      "  top: 'pool' "
+      "} "
+      "layer { "
+      "  name: 'conv_ncdhw' "
+      "  type: 'Layout3D' "
+      "  bottom: 'conv_ndhwc' "
+      "  top: 'conv' "
+      "  layout3d_param { layout: NCDHW } "
+      "} ";
+  this->RunInsertionTest(input_proto, expected_output_proto);
+}
+
+}  // namespace caffe
@@ -0,0 +1,127 @@
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/mvn_nd_layer.hpp"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MVN_NDLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+ protected:
+  MVN_NDLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()) {
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    shape[3] = 3;
+    shape[4] = 2;
+    blob_bottom_->Reshape(shape);
+    // fill the values, far from zero mean
+    FillerParameter filler_param;
+    filler_param.set_mean(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~MVN_NDLayerTest() { delete blob_bottom_; delete blob_top_; }
+
+  // Every row of the top from the axis on has zero mean, and unit variance
+  // if normalize_variance.
+  void CheckRows(const int axis, const bool normalize_variance) {
+    const int num = blob_top_->count(0, axis);
+    const int dim = blob_top_->count(axis);
+    for (int n = 0; n < num; ++n) {
+      Dtype sum = 0, var = 0;
+      for (int i = 0; i < dim; ++i) {
+        const Dtype data = blob_top_->cpu_data()[n * dim + i];
+        sum += data;
+        var += data * data;
+      }
+      sum /= dim;
+      var /= dim;
+      EXPECT_NEAR(0, sum, 1e-4);
+      if (normalize_variance) {
+        EXPECT_NEAR(1, var, 1e-3);
+      } else {
+        // the top is the bottom less its mean
+        const Dtype offset = blob_bottom_->cpu_data()[n * dim]
+            - blob_top_->cpu_data()[n * dim];
+        for (int i = 0; i < dim; ++i) {
+          EXPECT_NEAR(blob_bottom_->cpu_data()[n * dim + i] - offset,
+              blob_top_->cpu_data()[n * dim + i], 1e-4);
+        }
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(MVN_NDLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(MVN_NDLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MVN_NDLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckRows(2, true);
+}
+
+TYPED_TEST(MVN_NDLayerTest, TestForwardMeanOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "mvn_param{normalize_variance: false}", &layer_param));
+  MVN_NDLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckRows(2, false);
+}
+
+TYPED_TEST(MVN_NDLayerTest, TestForwardAxis1) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "mvn_param{axis: 1}", &layer_param));
+  MVN_NDLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckRows(1, true);
+}
+
+TYPED_TEST(MVN_NDLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MVN_NDLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(MVN_NDLayerTest, TestGradientMeanOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "mvn_param{normalize_variance: false axis: 1}", &layer_param));
+  MVN_NDLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
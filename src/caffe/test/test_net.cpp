@@ -839,6 +839,270 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitSharedMemoryNet(const bool share_memory,
+      const string& keep_blob = "") {
+    string proto =
+        "name: 'SharedMemoryNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sigmoid' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sigmoid' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sigmoid' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} ";
+    if (share_memory) {
+      proto += "share_memory: true ";
+    }
+    if (!keep_blob.empty()) {
+      proto += "keep_blob: '" + keep_blob + "' ";
+    }
+    Caffe::set_random_seed(seed_);
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitCheckpointNet(const bool checkpoint) {
+    string proto =
+        "name: 'CheckpointNetwork' "
+        "state { phase: TRAIN } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 4 dim: 3 dim: 2 dim: 2 } } "
+        "} "
+        "layer { "
+        "  name: 'label' "
+        "  type: 'Input' "
+        "  top: 'label' "
+        "  input_param { shape { dim: 4 } } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'drop1' "
+        "  type: 'Dropout' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip2' "
+        "  top: 'ip2' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip2' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } ";
+    if (checkpoint) {
+      proto += "checkpoint: true ";
+    }
+    proto +=
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip3' "
+        "  top: 'ip4' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip4' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    Caffe::set_random_seed(seed_);
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitBranchNet(const int branch_threads) {
+    // Two towers off a split input, interleaved and sharing the weights of
+    // their last layers.
+    ostringstream proto;
+    proto <<
+        "name: 'BranchNetwork' "
+        "force_backward: true "
+        "branch_threads: " << branch_threads << " "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { "
+        "    shape { dim: 4 dim: 3 dim: 2 dim: 2 } "
+        "    shape { dim: 4 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_flow' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip_flow' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_rgb' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip_rgb' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_rgb' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip_rgb' "
+        "  top: 'ip_rgb' "
+        "} "
+        "layer { "
+        "  name: 'out_rgb' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip_rgb' "
+        "  top: 'out_rgb' "
+        "  param { name: 'shared' } "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sigmoid_flow' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip_flow' "
+        "  top: 'ip_flow' "
+        "} "
+        "layer { "
+        "  name: 'out_flow' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip_flow' "
+        "  top: 'out_flow' "
+        "  param { name: 'shared' } "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'out_rgb' "
+        "  bottom: 'out_flow' "
+        "  top: 'fused' "
+        "} "
+        "layer { "
+        "  name: 'fc' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'fused' "
+        "  top: 'fc' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'fc' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    Caffe::set_random_seed(seed_);
+    InitNetFromProtoString(proto.str());
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -2446,6 +2710,189 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestSharedMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the net with and without shared memory on inputs of two sizes, and
+  // check that the outputs agree and that blobs live at different times
+  // share memory while the inputs and outputs do not.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input1(2, 3, 4, 5);
+  Blob<Dtype> input2(5, 3, 4, 5);
+  filler.Fill(&input1);
+  filler.Fill(&input2);
+  this->InitSharedMemoryNet(false);
+  shared_ptr<Net<Dtype> > unshared_net = this->net_;
+  this->InitSharedMemoryNet(true);
+  EXPECT_EQ(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("sigmoid")->data());
+  EXPECT_NE(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("ip2")->data());
+  EXPECT_NE(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("data")->data());
+  EXPECT_NE(this->net_->blob_by_name("sigmoid")->data(),
+      this->net_->blob_by_name("ip3")->data());
+  const Blob<Dtype>* inputs[] = { &input1, &input2 };
+  for (int i = 0; i < 2; ++i) {
+    Blob<Dtype>* unshared_input = unshared_net->input_blobs()[0];
+    Blob<Dtype>* input = this->net_->input_blobs()[0];
+    unshared_input->ReshapeLike(*inputs[i]);
+    unshared_input->CopyFrom(*inputs[i]);
+    input->ReshapeLike(*inputs[i]);
+    input->CopyFrom(*inputs[i]);
+    unshared_net->Reshape();
+    this->net_->Reshape();
+    const Blob<Dtype>* unshared_output = unshared_net->Forward()[0];
+    const Blob<Dtype>* output = this->net_->Forward()[0];
+    ASSERT_EQ(unshared_output->count(), output->count());
+    EXPECT_EQ(inputs[i]->num(), output->num());
+    for (int j = 0; j < output->count(); ++j) {
+      EXPECT_FLOAT_EQ(unshared_output->cpu_data()[j], output->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestSharedMemoryKeepBlob) {
+  this->InitSharedMemoryNet(true, "ip1");
+  EXPECT_NE(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("sigmoid")->data());
+  EXPECT_NE(this->net_->blob_by_name("ip1")->data(),
+      this->net_->blob_by_name("ip2")->data());
+}
+
+TYPED_TEST(NetTest, TestInvertTop) {
+  const string net_head =
+      "name: 'InvertTopNet' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } } "
+      "layer { name: 'power' type: 'Power' bottom: 'data' top: 'x' } "
+      "layer { name: 'bn' type: 'BN' bottom: 'x' top: 'x' "
+      "  bn_param { invert_top: true } } ";
+  // a ReLU out of place leaves the top of BN alone
+  this->InitNetFromProtoString(net_head +
+      "layer { name: 'relu' type: 'ReLU' bottom: 'x' top: 'y' } ");
+  EXPECT_TRUE(this->net_->layer_by_name("bn")->layer_param().bn_param()
+      .invert_top());
+  // in place, it changes the top
+  this->InitNetFromProtoString(net_head +
+      "layer { name: 'relu' type: 'ReLU' bottom: 'x' top: 'x' } ");
+  EXPECT_FALSE(this->net_->layer_by_name("bn")->layer_param().bn_param()
+      .invert_top());
+  // also through the split of the top, which shares its data
+  this->InitNetFromProtoString(net_head +
+      "layer { name: 'relu' type: 'ReLU' bottom: 'x' top: 'x' } "
+      "layer { name: 'power2' type: 'Power' bottom: 'x' top: 'y' } ");
+  EXPECT_FALSE(this->net_->layer_by_name("bn")->layer_param().bn_param()
+      .invert_top());
+}
+
+TYPED_TEST(NetTest, TestCheckpoint) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Train the net for two iterations with and without recomputing the
+  // activations before the checkpoint, which must give the same losses,
+  // gradients and running statistics, Dropout included.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(vector<int>(1, 2 * 4 * 3 * 2 * 2));
+  filler.Fill(&data);
+  vector<Dtype> losses[2];
+  vector<shared_ptr<Blob<Dtype> > > params[2];
+  for (int checkpoint = 0; checkpoint < 2; ++checkpoint) {
+    this->InitCheckpointNet(checkpoint);
+    if (checkpoint) {
+      EXPECT_TRUE(this->net_->blob_by_name("ip4")->data()
+          == this->net_->blob_by_name("ip1")->data()
+          || this->net_->blob_by_name("ip4")->data()
+          == this->net_->blob_by_name("ip2")->data());
+      EXPECT_NE(this->net_->blob_by_name("ip3")->data(),
+          this->net_->blob_by_name("ip4")->data());
+    }
+    Blob<Dtype>* input = this->net_->input_blobs()[0];
+    Blob<Dtype>* label = this->net_->input_blobs()[1];
+    for (int iter = 0; iter < 2; ++iter) {
+      caffe_copy(input->count(), data.cpu_data() + iter * input->count(),
+          input->mutable_cpu_data());
+      for (int i = 0; i < label->count(); ++i) {
+        label->mutable_cpu_data()[i] = (iter + i) % 5;
+      }
+      this->net_->ClearParamDiffs();
+      Dtype loss;
+      this->net_->Forward(&loss);
+      this->net_->Backward();
+      losses[checkpoint].push_back(loss);
+      for (int i = 0; i < this->net_->params().size(); ++i) {
+        params[checkpoint].push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        params[checkpoint].back()->CopyFrom(*this->net_->params()[i], false,
+            true);
+        params[checkpoint].back()->CopyFrom(*this->net_->params()[i], true);
+      }
+    }
+  }
+  ASSERT_EQ(losses[0].size(), losses[1].size());
+  for (int i = 0; i < losses[0].size(); ++i) {
+    EXPECT_EQ(losses[0][i], losses[1][i]);
+  }
+  ASSERT_EQ(params[0].size(), params[1].size());
+  for (int i = 0; i < params[0].size(); ++i) {
+    for (int j = 0; j < params[0][i]->count(); ++j) {
+      EXPECT_EQ(params[0][i]->cpu_data()[j], params[1][i]->cpu_data()[j]);
+      EXPECT_EQ(params[0][i]->cpu_diff()[j], params[1][i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestBranchThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Run the towers at once, repeatedly, which must give the same outputs,
+  // losses and gradients as running the layers in order.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(vector<int>(1, 4 * 3 * 2 * 2));
+  Blob<Dtype> target(vector<int>(1, 4 * 3));
+  filler.Fill(&data);
+  filler.Fill(&target);
+  vector<Dtype> losses[2];
+  vector<shared_ptr<Blob<Dtype> > > blobs[2];
+  for (int parallel = 0; parallel < 2; ++parallel) {
+    this->InitBranchNet(parallel ? 4 : 1);
+    for (int iter = 0; iter < 5; ++iter) {
+      caffe_copy(data.count(), data.cpu_data(),
+          this->net_->input_blobs()[0]->mutable_cpu_data());
+      caffe_copy(target.count(), target.cpu_data(),
+          this->net_->input_blobs()[1]->mutable_cpu_data());
+      this->net_->ClearParamDiffs();
+      Dtype loss;
+      this->net_->Forward(&loss);
+      this->net_->Backward();
+      losses[parallel].push_back(loss);
+      vector<shared_ptr<Blob<Dtype> > > net_blobs = this->net_->blobs();
+      net_blobs.insert(net_blobs.end(), this->net_->params().begin(),
+          this->net_->params().end());
+      for (int i = 0; i < net_blobs.size(); ++i) {
+        blobs[parallel].push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        blobs[parallel].back()->CopyFrom(*net_blobs[i], false, true);
+        blobs[parallel].back()->CopyFrom(*net_blobs[i], true);
+      }
+    }
+  }
+  ASSERT_EQ(losses[0].size(), losses[1].size());
+  for (int i = 0; i < losses[0].size(); ++i) {
+    EXPECT_EQ(losses[0][i], losses[1][i]);
+  }
+  ASSERT_EQ(blobs[0].size(), blobs[1].size());
+  for (int i = 0; i < blobs[0].size(); ++i) {
+    ASSERT_EQ(blobs[0][i]->count(), blobs[1][i]->count());
+    for (int j = 0; j < blobs[0][i]->count(); ++j) {
+      EXPECT_EQ(blobs[0][i]->cpu_data()[j], blobs[1][i]->cpu_data()[j]);
+      EXPECT_EQ(blobs[0][i]->cpu_diff()[j], blobs[1][i]->cpu_diff()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
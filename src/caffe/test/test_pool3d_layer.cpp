@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/layout3d_layer.hpp"
+#include "caffe/layers/pool3d_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class Pooling3DLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  Pooling3DLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_mask_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 5;
+    shape[3] = 6;
+    shape[4] = 5;
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~Pooling3DLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_mask_;
+  }
+
+  void SetMaxPooling3DParam(Pooling3DParameter* param) {
+    param->set_pool(Pooling3DParameter_PoolMethod_MAX);
+    param->set_kernel_size(3);
+    param->set_kernel_depth(2);
+    param->set_stride(2);
+    param->set_temporal_stride(2);
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_mask_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Pooling3DLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(Pooling3DLayerTest, TestSetUpMaxTopMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetMaxPooling3DParam(layer_param.mutable_pooling3d_param());
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 3);
+  EXPECT_EQ(this->blob_top_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_->shape(3), 3);
+  EXPECT_EQ(this->blob_top_->shape(4), 2);
+  EXPECT_EQ(this->blob_top_mask_->shape(), this->blob_top_->shape());
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestForwardMaxTopMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetMaxPooling3DParam(layer_param.mutable_pooling3d_param());
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int length = 5, height = 6, width = 5;
+  const int pooled_length = 3, pooled_height = 3, pooled_width = 2;
+  for (int nc = 0; nc < 2 * 3; ++nc) {
+    const Dtype* bottom_data =
+        this->blob_bottom_->cpu_data() + nc * length * height * width;
+    const int top_offset = nc * pooled_length * pooled_height * pooled_width;
+    for (int pl = 0; pl < pooled_length; ++pl) {
+      for (int ph = 0; ph < pooled_height; ++ph) {
+        for (int pw = 0; pw < pooled_width; ++pw) {
+          Dtype maxval = -FLT_MAX;
+          int maxidx = -1;
+          for (int l = pl * 2; l < std::min(pl * 2 + 2, length); ++l) {
+            for (int h = ph * 2; h < std::min(ph * 2 + 3, height); ++h) {
+              for (int w = pw * 2; w < std::min(pw * 2 + 3, width); ++w) {
+                const int index = (l * height + h) * width + w;
+                if (bottom_data[index] > maxval) {
+                  maxval = bottom_data[index];
+                  maxidx = index;
+                }
+              }
+            }
+          }
+          const int top_index = top_offset
+              + (pl * pooled_height + ph) * pooled_width + pw;
+          EXPECT_EQ(this->blob_top_->cpu_data()[top_index], maxval);
+          EXPECT_EQ(this->blob_top_mask_->cpu_data()[top_index], maxidx);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestBackwardMaxTies) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetMaxPooling3DParam(layer_param.mutable_pooling3d_param());
+  // Every window is a tie, so only the first element of each may receive
+  // gradient.
+  caffe_set(this->blob_bottom_->count(), Dtype(1),
+      this->blob_bottom_->mutable_cpu_data());
+  Pooling3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_set(this->blob_top_->count(), Dtype(1),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Dtype sum = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    sum += this->blob_bottom_->cpu_diff()[i];
+  }
+  EXPECT_EQ(sum, this->blob_top_->count());
+  // The first window of the first volume starts at the first element.
+  EXPECT_EQ(this->blob_bottom_->cpu_diff()[0], 1);
+  EXPECT_EQ(this->blob_bottom_->cpu_diff()[1], 0);
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientMax) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetMaxPooling3DParam(layer_param.mutable_pooling3d_param());
+  Pooling3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientMaxTopMask) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  this->SetMaxPooling3DParam(layer_param.mutable_pooling3d_param());
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  this->blob_top_vec_.pop_back();
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientAve) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+  param->set_pool(Pooling3DParameter_PoolMethod_AVE);
+  param->set_kernel_size(3);
+  param->set_kernel_depth(2);
+  param->set_stride(2);
+  param->set_pad(1);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestForwardAveTemporalPad) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+  param->set_pool(Pooling3DParameter_PoolMethod_AVE);
+  param->set_kernel_size(3);
+  param->set_kernel_depth(3);
+  param->set_stride(2);
+  param->set_temporal_stride(2);
+  param->set_pad(1);
+  param->set_temporal_pad(1);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int length = 5, height = 6, width = 5;
+  const int pooled_length = 3, pooled_height = 4, pooled_width = 3;
+  EXPECT_EQ(this->blob_top_->shape(2), pooled_length);
+  EXPECT_EQ(this->blob_top_->shape(3), pooled_height);
+  EXPECT_EQ(this->blob_top_->shape(4), pooled_width);
+  for (int nc = 0; nc < 2 * 3; ++nc) {
+    const Dtype* bottom_data =
+        this->blob_bottom_->cpu_data() + nc * length * height * width;
+    const int top_offset = nc * pooled_length * pooled_height * pooled_width;
+    for (int pl = 0; pl < pooled_length; ++pl) {
+      for (int ph = 0; ph < pooled_height; ++ph) {
+        for (int pw = 0; pw < pooled_width; ++pw) {
+          // Padding counts towards the window size.
+          Dtype sum = 0;
+          for (int l = pl * 2 - 1; l < pl * 2 + 2; ++l) {
+            for (int h = ph * 2 - 1; h < ph * 2 + 2; ++h) {
+              for (int w = pw * 2 - 1; w < pw * 2 + 2; ++w) {
+                if (l >= 0 && l < length && h >= 0 && h < height && w >= 0
+                    && w < width) {
+                  sum += bottom_data[(l * height + h) * width + w];
+                }
+              }
+            }
+          }
+          const int lsize = std::min(pl * 2 + 2, length + 1) - (pl * 2 - 1);
+          const int hsize = std::min(ph * 2 + 2, height + 1) - (ph * 2 - 1);
+          const int wsize = std::min(pw * 2 + 2, width + 1) - (pw * 2 - 1);
+          EXPECT_NEAR(this->blob_top_->cpu_data()[top_offset
+              + (pl * pooled_height + ph) * pooled_width + pw],
+              sum / (lsize * hsize * wsize), 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientAveTemporalPad) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+  param->set_pool(Pooling3DParameter_PoolMethod_AVE);
+  param->set_kernel_size(2);
+  param->set_kernel_depth(3);
+  param->set_stride(2);
+  param->set_temporal_stride(2);
+  param->set_temporal_pad(1);
+  Pooling3DLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestForwardGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int volume = 5 * 6 * 5;
+  for (int pool = 0; pool < 2; ++pool) {
+    LayerParameter layer_param;
+    Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+    param->set_pool(pool == 0 ? Pooling3DParameter_PoolMethod_MAX
+        : Pooling3DParameter_PoolMethod_AVE);
+    param->set_global_pooling(true);
+    Pooling3DLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(this->blob_top_->shape(0), 2);
+    EXPECT_EQ(this->blob_top_->shape(1), 3);
+    EXPECT_EQ(this->blob_top_->shape(2), 1);
+    EXPECT_EQ(this->blob_top_->shape(3), 1);
+    EXPECT_EQ(this->blob_top_->shape(4), 1);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int nc = 0; nc < 2 * 3; ++nc) {
+      const Dtype* bottom_data = this->blob_bottom_->cpu_data() + nc * volume;
+      Dtype expected = pool == 0 ? -FLT_MAX : 0;
+      for (int i = 0; i < volume; ++i) {
+        expected = pool == 0 ? std::max(expected, bottom_data[i])
+            : expected + bottom_data[i] / volume;
+      }
+      EXPECT_NEAR(this->blob_top_->cpu_data()[nc], expected, 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int pool = 0; pool < 2; ++pool) {
+    LayerParameter layer_param;
+    Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+    param->set_pool(pool == 0 ? Pooling3DParameter_PoolMethod_MAX
+        : Pooling3DParameter_PoolMethod_AVE);
+    param->set_global_pooling(true);
+    Pooling3DLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-4, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestForwardNDHWC) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom_ndhwc;
+  vector<Blob<Dtype>*> bottom_ndhwc_vec(1, &bottom_ndhwc);
+  {
+    LayerParameter layout_param;
+    Layout3DLayer<Dtype> layout_layer(layout_param);
+    layout_layer.SetUp(this->blob_bottom_vec_, bottom_ndhwc_vec);
+    layout_layer.Forward(this->blob_bottom_vec_, bottom_ndhwc_vec);
+  }
+  // max, average with padding, global max, global average
+  for (int i = 0; i < 4; ++i) {
+    LayerParameter layer_param;
+    Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+    if (i % 2 == 0) {
+      param->set_pool(Pooling3DParameter_PoolMethod_MAX);
+    } else {
+      param->set_pool(Pooling3DParameter_PoolMethod_AVE);
+    }
+    if (i < 2) {
+      param->set_kernel_size(3);
+      param->set_kernel_depth(3);
+      param->set_stride(2);
+      param->set_temporal_stride(2);
+    } else {
+      param->set_global_pooling(true);
+    }
+    if (i == 1) {
+      param->set_pad(1);
+      param->set_temporal_pad(1);
+    }
+    this->blob_top_vec_.resize(1);
+    if (i % 2 == 0) {
+      this->blob_top_vec_.push_back(this->blob_top_mask_);
+    }
+    Pooling3DLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    param->set_layout(NDHWC);
+    Blob<Dtype> top_ndhwc, top_mask_ndhwc;
+    vector<Blob<Dtype>*> top_ndhwc_vec(1, &top_ndhwc);
+    if (i % 2 == 0) {
+      top_ndhwc_vec.push_back(&top_mask_ndhwc);
+    }
+    Pooling3DLayer<Dtype> ndhwc_layer(layer_param);
+    ndhwc_layer.SetUp(bottom_ndhwc_vec, top_ndhwc_vec);
+    ndhwc_layer.Forward(bottom_ndhwc_vec, top_ndhwc_vec);
+    ASSERT_EQ(top_ndhwc.shape(4), 3);
+
+    // An NCDHW offset v of channel c is the NDHWC offset v * 3 + c.
+    const int pooled_volume = this->blob_top_->count(2);
+    for (int n = 0; n < 2; ++n) {
+      for (int c = 0; c < 3; ++c) {
+        for (int v = 0; v < pooled_volume; ++v) {
+          const int index = (n * 3 + c) * pooled_volume + v;
+          const int ndhwc_index = (n * pooled_volume + v) * 3 + c;
+          EXPECT_NEAR(this->blob_top_->cpu_data()[index],
+              top_ndhwc.cpu_data()[ndhwc_index], 1e-5);
+          if (i % 2 == 0) {
+            EXPECT_EQ(this->blob_top_mask_->cpu_data()[index] * 3 + c,
+                top_mask_ndhwc.cpu_data()[ndhwc_index]);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientNDHWC) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(this->blob_bottom_->shape());
+  shape.push_back(shape[1]);
+  shape.erase(shape.begin() + 1);
+  this->blob_bottom_->Reshape(shape);
+  for (int pool = 0; pool < 2; ++pool) {
+    LayerParameter layer_param;
+    Pooling3DParameter* param = layer_param.mutable_pooling3d_param();
+    param->set_kernel_size(3);
+    param->set_kernel_depth(2);
+    param->set_stride(2);
+    param->set_layout(NDHWC);
+    if (pool == 0) {
+      param->set_pool(Pooling3DParameter_PoolMethod_MAX);
+    } else {
+      param->set_pool(Pooling3DParameter_PoolMethod_AVE);
+      param->set_pad(1);
+    }
+    Pooling3DLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-4, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,108 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ProfilerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Profiler::Get().Clear();
+  }
+  virtual void TearDown() {
+    Profiler::Get().set_enabled(true);
+    Profiler::Get().set_capacity(1 << 16);
+  }
+
+  string ReadTrace() {
+    string filename;
+    MakeTempFilename(&filename);
+    Profiler::Get().WriteTrace(filename);
+    std::ifstream file(filename.c_str());
+    std::stringstream trace;
+    trace << file.rdbuf();
+    return trace.str();
+  }
+};
+
+TEST_F(ProfilerTest, TestRing) {
+  Profiler& profiler = Profiler::Get();
+  profiler.set_capacity(4);
+  for (int i = 0; i < 6; ++i) {
+    std::ostringstream name;
+    name << "event" << i;
+    profiler.Record(name.str(), "test", i * 10, 5);
+  }
+  // only the latest four are kept, oldest first
+  const string trace = ReadTrace();
+  EXPECT_EQ(trace.find("\"event0\""), string::npos);
+  EXPECT_EQ(trace.find("\"event1\""), string::npos);
+  for (int i = 3; i < 6; ++i) {
+    std::ostringstream name, previous;
+    name << "\"event" << i << "\"";
+    previous << "\"event" << i - 1 << "\"";
+    ASSERT_NE(trace.find(name.str()), string::npos);
+    EXPECT_LT(trace.find(previous.str()), trace.find(name.str()));
+  }
+  EXPECT_NE(trace.find("\"ph\": \"X\""), string::npos);
+  EXPECT_NE(trace.find("\"ts\": 50, \"dur\": 5"), string::npos);
+}
+
+TEST_F(ProfilerTest, TestSummary) {
+  Profiler& profiler = Profiler::Get();
+  profiler.Record("conv", "forward", 0, 1000, 2e9, 1e6);
+  profiler.Record("conv", "forward", 2000, 1000, 2e9, 1e6);
+  profiler.Record("relu", "forward", 1000, 10);
+  profiler.set_enabled(false);
+  profiler.Record("ignored", "forward", 3000, 10);
+  const string summary = profiler.Summary();
+  // 4 GFLOP and 2 MB in 2 ms, before the shorter relu
+  const size_t conv = summary.find("conv");
+  ASSERT_NE(conv, string::npos);
+  EXPECT_NE(summary.find("2000.000", conv), string::npos);
+  EXPECT_NE(summary.find("1.000", conv), string::npos);
+  EXPECT_LT(conv, summary.find("relu"));
+  EXPECT_EQ(summary.find("ignored"), string::npos);
+}
+
+TEST_F(ProfilerTest, TestNet) {
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(
+      "name: 'ProfiledNet' "
+      "force_backward: true "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 4 } } "
+      "layer { name: 'loss' type: 'EuclideanLoss' bottom: 'ip' bottom: 'ip' "
+      "  top: 'loss' } ", &param));
+  Net<float> net(param);
+  EXPECT_EQ(net.layer_by_name("ip")->ForwardFlops(), 2 * 2 * 3 * 4);
+  net.Forward();
+  net.Backward();
+  const string trace = ReadTrace();
+  // forward and backward of the inner product, with its FLOPs and the bytes
+  // of its bottom, top, weights and bias
+  EXPECT_NE(trace.find("{\"name\": \"ip\", \"cat\": \"forward\""),
+      string::npos);
+  EXPECT_NE(trace.find("{\"name\": \"ip\", \"cat\": \"backward\""),
+      string::npos);
+  EXPECT_NE(trace.find("\"args\": {\"flops\": 48, \"bytes\": 120}"),
+      string::npos);
+  EXPECT_NE(trace.find("\"args\": {\"flops\": 96, \"bytes\": 240}"),
+      string::npos);
+}
+
+}  // namespace caffe
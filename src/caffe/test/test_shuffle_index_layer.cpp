@@ -113,4 +113,52 @@ TYPED_TEST(ShuffleIndexLayerTest, TestGradient) {
       this->blob_top_vec_, 0);
   }
 
+TYPED_TEST(ShuffleIndexLayerTest, TestPermutations5D) {
+  typedef typename TypeParam::Dtype Dtype;
+  // extents past one tile, and a unit axis
+  int shape[] = { 2, 3, 37, 1, 40 };
+  this->blob_bottom_->Reshape(vector<int>(shape, shape + 5));
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    this->blob_bottom_->mutable_cpu_data()[i] = i;
+  }
+  // identity, whole rows, channels last, reversed, and scattered axes
+  int permutations[][5] = {
+    { 0, 1, 2, 3, 4 },
+    { 0, 2, 1, 3, 4 },
+    { 0, 2, 3, 4, 1 },
+    { 4, 3, 2, 1, 0 },
+    { 1, 0, 4, 2, 3 },
+  };
+  for (int p = 0; p < 5; ++p) {
+    LayerParameter layer_param;
+    for (int i = 0; i < 5; ++i) {
+      layer_param.mutable_shuffle_index_param()->add_new_index(
+          permutations[p][i]);
+    }
+    ShuffleIndexLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      this->blob_top_->mutable_cpu_diff()[i] = -i;
+    }
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    vector<int> bot_index(5), top_index(5);
+    for (int index = 0; index < this->blob_bottom_->count(); ++index) {
+      for (int k = 4, rest = index; k >= 0; --k) {
+        bot_index[k] = rest % shape[k];
+        rest /= shape[k];
+      }
+      for (int k = 0; k < 5; ++k) {
+        top_index[k] = bot_index[permutations[p][k]];
+      }
+      const int top_offset = this->blob_top_->offset(top_index);
+      ASSERT_EQ(this->blob_bottom_->cpu_data()[index],
+          this->blob_top_->cpu_data()[top_offset]) << "permutation " << p;
+      ASSERT_EQ(this->blob_bottom_->cpu_diff()[index],
+          this->blob_top_->cpu_diff()[top_offset]) << "permutation " << p;
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,205 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class VideoDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  VideoDataLayerTest()
+      : seed_(1701),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()),
+        blob_top_cont_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    blob_top_vec_.push_back(blob_top_cont_);
+    Caffe::set_random_seed(seed_);
+  }
+
+  virtual ~VideoDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+    delete blob_top_cont_;
+  }
+
+  // The value of every pixel of a frame (1-based) of the video of a label.
+  static int FrameValue(int label, int frame) {
+    return 40 * label + 8 * frame;
+  }
+
+  // Write a list of videos of the given lengths, labelled 0, 1, ..., each a
+  // directory of uniform 4 x 4 frames im_0001.jpg, im_0002.jpg, ...
+  void MakeList(const vector<int>& lengths) {
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    for (int label = 0; label < lengths.size(); ++label) {
+      string dirname;
+      MakeTempDir(&dirname);
+      for (int frame = 1; frame <= lengths[label]; ++frame) {
+        char name[16];
+        snprintf(name, sizeof(name), "im_%04d.jpg", frame);
+        cv::Mat image(4, 4, CV_8UC3, cv::Scalar::all(FrameValue(label, frame)));
+        CHECK(cv::imwrite(dirname + "/" + name, image));
+      }
+      outfile << dirname << " " << lengths[label] << " " << label << std::endl;
+    }
+    outfile.close();
+  }
+
+  void SetParam(LayerParameter* param, int batch_size) {
+    param->set_phase(TEST);
+    VideoDataParameter* video_data_param = param->mutable_video_data_param();
+    video_data_param->set_source(filename_.c_str());
+    video_data_param->set_batch_size(batch_size);
+    video_data_param->set_modality(VideoDataParameter_Modality_RGB);
+    video_data_param->set_new_length(1);
+    video_data_param->set_shuffle(false);
+    video_data_param->set_variable_length(true);
+  }
+
+  // Check a T x N batch against videos of the given steps and labels, whose
+  // step t is the frame first_frame + t * frame_stride.
+  void CheckBatch(int num_steps, const vector<int>& steps,
+      const vector<int>& labels, int first_frame, int frame_stride) {
+    const int num = steps.size();
+    ASSERT_EQ(blob_top_label_->num_axes(), 2);
+    EXPECT_EQ(blob_top_label_->shape(0), num_steps);
+    EXPECT_EQ(blob_top_label_->shape(1), num);
+    EXPECT_TRUE(blob_top_cont_->shape() == blob_top_label_->shape());
+    EXPECT_EQ(blob_top_data_->num(), num_steps * num);
+    EXPECT_EQ(blob_top_data_->channels(), 3);
+    EXPECT_EQ(blob_top_data_->height(), 4);
+    EXPECT_EQ(blob_top_data_->width(), 4);
+    const Dtype* data = blob_top_data_->cpu_data();
+    const Dtype* label = blob_top_label_->cpu_data();
+    const Dtype* cont = blob_top_cont_->cpu_data();
+    const int step_count = blob_top_data_->count(1);
+    for (int t = 0; t < num_steps; ++t) {
+      for (int n = 0; n < num; ++n) {
+        const int index = t * num + n;
+        const bool padded = t >= steps[n];
+        EXPECT_EQ(label[index], padded ? -1 : labels[n]);
+        EXPECT_EQ(cont[index], (t > 0 && !padded) ? 1 : 0);
+        const Dtype value = padded ? 0 :
+            FrameValue(labels[n], first_frame + t * frame_stride);
+        for (int j = 0; j < step_count; ++j) {
+          EXPECT_NEAR(data[index * step_count + j], value, 2);
+        }
+      }
+    }
+  }
+
+  int seed_;
+  string filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  Blob<Dtype>* const blob_top_cont_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(VideoDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(VideoDataLayerTest, TestVariableLength) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kLengths[] = {4, 2, 6};
+  this->MakeList(vector<int>(kLengths, kLengths + 3));
+  LayerParameter param;
+  this->SetParam(&param, 3);
+  param.mutable_video_data_param()->set_bucket_pool(1);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_label_->shape(0), 1);
+  EXPECT_EQ(this->blob_top_label_->shape(1), 3);
+  // one step per frame, sorted by length and padded to the longest video
+  const int kSteps[] = {2, 4, 6};
+  const int kLabels[] = {1, 0, 2};
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckBatch(6, vector<int>(kSteps, kSteps + 3),
+        vector<int>(kLabels, kLabels + 3), 1, 1);
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestMaxSteps) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kLengths[] = {4, 2, 6};
+  this->MakeList(vector<int>(kLengths, kLengths + 3));
+  LayerParameter param;
+  this->SetParam(&param, 3);
+  param.mutable_video_data_param()->set_bucket_pool(1);
+  param.mutable_video_data_param()->set_max_steps(3);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // the 4 and 6 frame videos are clipped to 3 steps, the 2 frame one padded
+  const int num = 3;
+  ASSERT_EQ(this->blob_top_label_->shape(0), 3);
+  ASSERT_EQ(this->blob_top_label_->shape(1), num);
+  const Dtype* label = this->blob_top_label_->cpu_data();
+  const Dtype* cont = this->blob_top_cont_->cpu_data();
+  const int kLabels[] = {1, 0, 2};
+  const int kSteps[] = {2, 3, 3};
+  for (int t = 0; t < 3; ++t) {
+    for (int n = 0; n < num; ++n) {
+      const bool padded = t >= kSteps[n];
+      EXPECT_EQ(label[t * num + n], padded ? -1 : kLabels[n]);
+      EXPECT_EQ(cont[t * num + n], (t > 0 && !padded) ? 1 : 0);
+    }
+  }
+  // the steps of the 6 frame video are spread over it, at frames 2, 4 and 6
+  const Dtype* data = this->blob_top_data_->cpu_data();
+  const int step_count = this->blob_top_data_->count(1);
+  for (int t = 0; t < 3; ++t) {
+    EXPECT_NEAR(data[(t * num + 2) * step_count],
+        this->FrameValue(2, 2 + 2 * t), 2);
+  }
+}
+
+TYPED_TEST(VideoDataLayerTest, TestBucketPool) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kLengths[] = {6, 2, 5, 1};
+  this->MakeList(vector<int>(kLengths, kLengths + 4));
+  LayerParameter param;
+  this->SetParam(&param, 2);
+  param.mutable_video_data_param()->set_bucket_pool(2);
+  VideoDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // the two short videos make one batch and the two long ones the other
+  const int kShortSteps[] = {1, 2};
+  const int kShortLabels[] = {3, 1};
+  const int kLongSteps[] = {5, 6};
+  const int kLongLabels[] = {2, 0};
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckBatch(2, vector<int>(kShortSteps, kShortSteps + 2),
+        vector<int>(kShortLabels, kShortLabels + 2), 1, 1);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    this->CheckBatch(6, vector<int>(kLongSteps, kLongSteps + 2),
+        vector<int>(kLongLabels, kLongLabels + 2), 1, 1);
+  }
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,172 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/vol2col.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Kernel geometries: ksize, kdepth, pad, temporal_pad, stride,
+// temporal_stride.
+static const int kGeometries[][6] = {
+  {3, 3, 1, 1, 1, 1},
+  {3, 3, 0, 0, 2, 2},
+  {2, 3, 1, 2, 1, 2},
+  {5, 1, 2, 0, 3, 1},
+  {1, 1, 0, 0, 1, 1},
+};
+
+template <typename Dtype>
+class Vol2colTest : public ::testing::Test {
+ protected:
+  Vol2colTest() : channels_(3), length_(5), height_(7), width_(6) {}
+
+  int length_col(const int* g) const {
+    return (length_ + 2 * g[3] - g[1]) / g[5] + 1;
+  }
+  int height_col(const int* g) const {
+    return (height_ + 2 * g[2] - g[0]) / g[4] + 1;
+  }
+  int width_col(const int* g) const {
+    return (width_ + 2 * g[2] - g[0]) / g[4] + 1;
+  }
+
+  // Value of column (c, l, h, w) read through per-element bounds checks.
+  Dtype ReferenceColumn(const Dtype* im, const int* g, const int c,
+      const int l, const int h, const int w) const {
+    const int w_offset = c % g[0];
+    const int h_offset = (c / g[0]) % g[0];
+    const int l_offset = (c / g[0] / g[0]) % g[1];
+    const int c_im = c / g[0] / g[0] / g[1];
+    const int l_pad = l * g[5] - g[3] + l_offset;
+    const int h_pad = h * g[4] - g[2] + h_offset;
+    const int w_pad = w * g[4] - g[2] + w_offset;
+    if (l_pad < 0 || l_pad >= length_ || h_pad < 0 || h_pad >= height_
+        || w_pad < 0 || w_pad >= width_) {
+      return 0;
+    }
+    return im[((c_im * length_ + l_pad) * height_ + h_pad) * width_ + w_pad];
+  }
+
+  const int channels_;
+  const int length_;
+  const int height_;
+  const int width_;
+};
+
+TYPED_TEST_CASE(Vol2colTest, TestDtypes);
+
+TYPED_TEST(Vol2colTest, TestVol2col) {
+  Blob<TypeParam> im(2, this->channels_, this->length_,
+      this->height_ * this->width_);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&im);
+  for (int i = 0; i < sizeof(kGeometries) / sizeof(kGeometries[0]); ++i) {
+    const int* g = kGeometries[i];
+    const int spatial = this->length_col(g) * this->height_col(g)
+        * this->width_col(g);
+    const int rows = this->channels_ * g[1] * g[0] * g[0];
+    // one volume, then both volumes side by side
+    vector<TypeParam> col(rows * spatial);
+    vol2col_cpu(im.cpu_data(), this->channels_, this->length_,
+        this->height_, this->width_, g[0], g[1], g[2], g[3], g[4], g[5],
+        &col[0]);
+    vector<TypeParam> batch_col(2 * rows * spatial);
+    vol2col_batch_cpu(im.cpu_data(), 2, this->channels_, this->length_,
+        this->height_, this->width_, g[0], g[1], g[2], g[3], g[4], g[5],
+        &batch_col[0]);
+    for (int n = 0; n < 2; ++n) {
+      const TypeParam* im_n = im.cpu_data() + n * im.count(1);
+      for (int c = 0; c < rows; ++c) {
+        for (int l = 0; l < this->length_col(g); ++l) {
+          for (int h = 0; h < this->height_col(g); ++h) {
+            for (int w = 0; w < this->width_col(g); ++w) {
+              const int index = (l * this->height_col(g) + h)
+                  * this->width_col(g) + w;
+              const TypeParam expected =
+                  this->ReferenceColumn(im_n, g, c, l, h, w);
+              if (n == 0) {
+                EXPECT_EQ(col[c * spatial + index], expected);
+              }
+              EXPECT_EQ(batch_col[(c * 2 + n) * spatial + index], expected);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Vol2colTest, TestCol2vol) {
+  for (int i = 0; i < sizeof(kGeometries) / sizeof(kGeometries[0]); ++i) {
+    const int* g = kGeometries[i];
+    const int spatial = this->length_col(g) * this->height_col(g)
+        * this->width_col(g);
+    const int rows = this->channels_ * g[1] * g[0] * g[0];
+    Blob<TypeParam> col(1, 2, rows, spatial);
+    FillerParameter filler_param;
+    GaussianFiller<TypeParam> filler(filler_param);
+    filler.Fill(&col);
+    const int volume = this->channels_ * this->length_ * this->height_
+        * this->width_;
+    vector<TypeParam> im(volume);
+    col2vol_cpu(col.cpu_data(), this->channels_, this->length_,
+        this->height_, this->width_, g[0], g[1], g[2], g[3], g[4], g[5],
+        &im[0]);
+    // the batch layout interleaves the rows of both volumes
+    vector<TypeParam> batch_col(2 * rows * spatial);
+    for (int n = 0; n < 2; ++n) {
+      for (int c = 0; c < rows; ++c) {
+        for (int j = 0; j < spatial; ++j) {
+          batch_col[(c * 2 + n) * spatial + j] =
+              col.cpu_data()[(n * rows + c) * spatial + j];
+        }
+      }
+    }
+    vector<TypeParam> batch_im(2 * volume);
+    col2vol_batch_cpu(&batch_col[0], 2, this->channels_, this->length_,
+        this->height_, this->width_, g[0], g[1], g[2], g[3], g[4], g[5],
+        &batch_im[0]);
+    // Every input element is the sum of the columns that read it.
+    for (int n = 0; n < 2; ++n) {
+      vector<TypeParam> expected(volume, 0);
+      for (int c = 0; c < rows; ++c) {
+        const int w_offset = c % g[0];
+        const int h_offset = (c / g[0]) % g[0];
+        const int l_offset = (c / g[0] / g[0]) % g[1];
+        const int c_im = c / g[0] / g[0] / g[1];
+        for (int l = 0; l < this->length_col(g); ++l) {
+          for (int h = 0; h < this->height_col(g); ++h) {
+            for (int w = 0; w < this->width_col(g); ++w) {
+              const int l_pad = l * g[5] - g[3] + l_offset;
+              const int h_pad = h * g[4] - g[2] + h_offset;
+              const int w_pad = w * g[4] - g[2] + w_offset;
+              if (l_pad >= 0 && l_pad < this->length_ && h_pad >= 0
+                  && h_pad < this->height_ && w_pad >= 0
+                  && w_pad < this->width_) {
+                expected[((c_im * this->length_ + l_pad) * this->height_
+                    + h_pad) * this->width_ + w_pad] +=
+                    col.cpu_data()[(n * rows + c) * spatial
+                    + (l * this->height_col(g) + h) * this->width_col(g) + w];
+              }
+            }
+          }
+        }
+      }
+      for (int j = 0; j < volume; ++j) {
+        if (n == 0) {
+          EXPECT_NEAR(im[j], expected[j], 1e-4);
+        }
+        EXPECT_NEAR(batch_im[n * volume + j], expected[j], 1e-4);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -11,6 +11,7 @@
 #include "caffe/twostream_snippet_data_reader.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -51,6 +52,7 @@ template<typename T>
 T BlockingQueue<T>::pop(const string& log_on_wait) {
   boost::mutex::scoped_lock lock(sync_->mutex_);
 
+  const int64_t start = queue_.empty() ? Profiler::Now() : -1;
   while (queue_.empty()) {
     if (!log_on_wait.empty()) {
         DLOG(INFO) << log_on_wait;
@@ -58,6 +60,10 @@ T BlockingQueue<T>::pop(const string& log_on_wait) {
     }
     sync_->condition_.wait(lock);
   }
+  if (start >= 0) {
+    Profiler::Get().Record(log_on_wait.empty() ? "pop" : log_on_wait, "wait",
+        start, Profiler::Now() - start);
+  }
 
   T t = queue_.front();
   queue_.pop();
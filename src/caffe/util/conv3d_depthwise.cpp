@@ -0,0 +1,149 @@
+#include <algorithm>
+
+#include "caffe/util/conv3d_depthwise.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Taps [begin, end) of a kernel of the given size that fall inside
+// [0, size) for the output at position out.
+static inline void valid_taps(const int out, const int stride, const int pad,
+    const int kernel, const int size, int* begin, int* end) {
+  const int start = out * stride - pad;
+  *begin = std::max(0, -start);
+  *end = std::min(kernel, size - start);
+}
+
+template <typename Dtype>
+void conv3d_depthwise_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width, const Dtype* weight,
+    const int multiplier, const int ksize, const int kdepth, const int pad,
+    const int temporal_pad, const int stride, const int temporal_stride,
+    const Dtype* bias, Dtype* data_out) {
+  const int length_out =
+      (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_out = (height + 2 * pad - ksize) / stride + 1;
+  const int width_out = (width + 2 * pad - ksize) / stride + 1;
+  const int kernel_dim = kdepth * ksize * ksize;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* in = data_im + c * length * height * width;
+    for (int m = 0; m < multiplier; ++m) {
+      const int o = c * multiplier + m;
+      const Dtype* w = weight + o * kernel_dim;
+      const Dtype bias_value = bias ? bias[o] : Dtype(0);
+      Dtype* out = data_out + o * length_out * height_out * width_out;
+      for (int l = 0; l < length_out; ++l) {
+        int r0, r1;
+        valid_taps(l, temporal_stride, temporal_pad, kdepth, length, &r0, &r1);
+        const int in_l = l * temporal_stride - temporal_pad;
+        for (int h = 0; h < height_out; ++h) {
+          int p0, p1;
+          valid_taps(h, stride, pad, ksize, height, &p0, &p1);
+          const int in_h = h * stride - pad;
+          for (int x = 0; x < width_out; ++x) {
+            int q0, q1;
+            valid_taps(x, stride, pad, ksize, width, &q0, &q1);
+            const int in_w = x * stride - pad;
+            Dtype sum = bias_value;
+            for (int r = r0; r < r1; ++r) {
+              for (int p = p0; p < p1; ++p) {
+                const Dtype* in_row =
+                    in + ((in_l + r) * height + in_h + p) * width + in_w;
+                const Dtype* w_row = w + (r * ksize + p) * ksize;
+                for (int q = q0; q < q1; ++q) {
+                  sum += w_row[q] * in_row[q];
+                }
+              }
+            }
+            *out++ = sum;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv3d_depthwise_backward_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width, const Dtype* top_diff,
+    const Dtype* weight, const int multiplier, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, Dtype* weight_diff, Dtype* bottom_diff) {
+  const int length_out =
+      (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_out = (height + 2 * pad - ksize) / stride + 1;
+  const int width_out = (width + 2 * pad - ksize) / stride + 1;
+  const int kernel_dim = kdepth * ksize * ksize;
+  if (bottom_diff) {
+    caffe_set(channels * length * height * width, Dtype(0), bottom_diff);
+  }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* in = data_im + c * length * height * width;
+    Dtype* in_diff = bottom_diff ?
+        bottom_diff + c * length * height * width : NULL;
+    for (int m = 0; m < multiplier; ++m) {
+      const int o = c * multiplier + m;
+      const Dtype* w = weight + o * kernel_dim;
+      Dtype* w_diff = weight_diff + o * kernel_dim;
+      const Dtype* out_diff =
+          top_diff + o * length_out * height_out * width_out;
+      for (int l = 0; l < length_out; ++l) {
+        int r0, r1;
+        valid_taps(l, temporal_stride, temporal_pad, kdepth, length, &r0, &r1);
+        const int in_l = l * temporal_stride - temporal_pad;
+        for (int h = 0; h < height_out; ++h) {
+          int p0, p1;
+          valid_taps(h, stride, pad, ksize, height, &p0, &p1);
+          const int in_h = h * stride - pad;
+          for (int x = 0; x < width_out; ++x) {
+            int q0, q1;
+            valid_taps(x, stride, pad, ksize, width, &q0, &q1);
+            const int in_w = x * stride - pad;
+            const Dtype diff = *out_diff++;
+            for (int r = r0; r < r1; ++r) {
+              for (int p = p0; p < p1; ++p) {
+                const int in_offset =
+                    ((in_l + r) * height + in_h + p) * width + in_w;
+                const int w_offset = (r * ksize + p) * ksize;
+                for (int q = q0; q < q1; ++q) {
+                  w_diff[w_offset + q] += diff * in[in_offset + q];
+                }
+                if (in_diff) {
+                  for (int q = q0; q < q1; ++q) {
+                    in_diff[in_offset + q] += diff * w[w_offset + q];
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void conv3d_depthwise_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const float* weight, const int multiplier, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const float* bias, float* data_out);
+template void conv3d_depthwise_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const double* weight, const int multiplier, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const double* bias, double* data_out);
+template void conv3d_depthwise_backward_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const float* top_diff, const float* weight, const int multiplier,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, float* weight_diff,
+    float* bottom_diff);
+template void conv3d_depthwise_backward_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const double* top_diff, const double* weight, const int multiplier,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, double* weight_diff,
+    double* bottom_diff);
+
+}  // namespace caffe
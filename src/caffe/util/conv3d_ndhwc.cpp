@@ -0,0 +1,184 @@
+#include <algorithm>
+
+#include "caffe/util/conv3d_ndhwc.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Outputs [begin, end) along an axis of the given size whose kernel tap at
+// offset k reads inside [0, size).
+static inline void valid_outputs(const int k, const int stride,
+    const int pad, const int size, const int size_out, int* begin,
+    int* end) {
+  const int first = pad - k;  // output * stride >= first
+  const int last = size - 1 + pad - k;  // output * stride <= last
+  *begin = first > 0 ? (first + stride - 1) / stride : 0;
+  *end = last < 0 ? 0 : std::min(size_out, last / stride + 1);
+}
+
+template <typename Dtype>
+void conv3d_ndhwc_gather_weight_cpu(const Dtype* weight, const int num_output,
+    const int channels, const int ksize, const int kdepth,
+    Dtype* tap_weight) {
+  const int taps = kdepth * ksize * ksize;
+  for (int o = 0; o < num_output; ++o) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* w = weight + (o * channels + c) * taps;
+      for (int t = 0; t < taps; ++t) {
+        tap_weight[(t * channels + c) * num_output + o] = w[t];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv3d_ndhwc_scatter_weight_cpu(const Dtype* tap_weight_diff,
+    const int num_output, const int channels, const int ksize,
+    const int kdepth, Dtype* weight_diff) {
+  const int taps = kdepth * ksize * ksize;
+  for (int o = 0; o < num_output; ++o) {
+    for (int c = 0; c < channels; ++c) {
+      Dtype* w = weight_diff + (o * channels + c) * taps;
+      for (int t = 0; t < taps; ++t) {
+        w[t] += tap_weight_diff[(t * channels + c) * num_output + o];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv3d_ndhwc_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* tap_weight, const int num_output, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const Dtype* bias, Dtype* data_out) {
+  const int length_out =
+      (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_out = (height + 2 * pad - ksize) / stride + 1;
+  const int width_out = (width + 2 * pad - ksize) / stride + 1;
+  const int tap_size = channels * num_output;
+  for (int lo = 0; lo < length_out; ++lo) {
+    for (int ho = 0; ho < height_out; ++ho) {
+      Dtype* out_row = data_out + (lo * height_out + ho) * width_out
+          * num_output;
+      for (int wo = 0; wo < width_out; ++wo) {
+        if (bias) {
+          caffe_copy(num_output, bias, out_row + wo * num_output);
+        } else {
+          caffe_set(num_output, Dtype(0), out_row + wo * num_output);
+        }
+      }
+      for (int kl = 0; kl < kdepth; ++kl) {
+        const int l = lo * temporal_stride - temporal_pad + kl;
+        if (l < 0 || l >= length) { continue; }
+        for (int kh = 0; kh < ksize; ++kh) {
+          const int h = ho * stride - pad + kh;
+          if (h < 0 || h >= height) { continue; }
+          for (int kw = 0; kw < ksize; ++kw) {
+            int begin, end;
+            valid_outputs(kw, stride, pad, width, width_out, &begin, &end);
+            if (begin >= end) { continue; }
+            const Dtype* in_rows = data_im + ((l * height + h) * width
+                + begin * stride - pad + kw) * channels;
+            caffe_cpu_strided_gemm<Dtype>(CblasNoTrans, CblasNoTrans,
+                end - begin, num_output, channels, Dtype(1), in_rows,
+                stride * channels,
+                tap_weight + ((kl * ksize + kh) * ksize + kw) * tap_size,
+                num_output, Dtype(1), out_row + begin * num_output,
+                num_output);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv3d_ndhwc_backward_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* top_diff, const Dtype* tap_weight, const int num_output,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, Dtype* tap_weight_diff,
+    Dtype* bottom_diff) {
+  const int length_out =
+      (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_out = (height + 2 * pad - ksize) / stride + 1;
+  const int width_out = (width + 2 * pad - ksize) / stride + 1;
+  const int tap_size = channels * num_output;
+  if (bottom_diff) {
+    caffe_set(length * height * width * channels, Dtype(0), bottom_diff);
+  }
+  for (int lo = 0; lo < length_out; ++lo) {
+    for (int ho = 0; ho < height_out; ++ho) {
+      const Dtype* top_row = top_diff + (lo * height_out + ho) * width_out
+          * num_output;
+      for (int kl = 0; kl < kdepth; ++kl) {
+        const int l = lo * temporal_stride - temporal_pad + kl;
+        if (l < 0 || l >= length) { continue; }
+        for (int kh = 0; kh < ksize; ++kh) {
+          const int h = ho * stride - pad + kh;
+          if (h < 0 || h >= height) { continue; }
+          for (int kw = 0; kw < ksize; ++kw) {
+            int begin, end;
+            valid_outputs(kw, stride, pad, width, width_out, &begin, &end);
+            if (begin >= end) { continue; }
+            const int in_offset = ((l * height + h) * width
+                + begin * stride - pad + kw) * channels;
+            const int tap = (kl * ksize + kh) * ksize + kw;
+            // gradient w.r.t. the tap: its input rows times the top rows
+            caffe_cpu_strided_gemm<Dtype>(CblasTrans, CblasNoTrans, channels,
+                num_output, end - begin, Dtype(1), data_im + in_offset,
+                stride * channels, top_row + begin * num_output, num_output,
+                Dtype(1), tap_weight_diff + tap * tap_size, num_output);
+            // gradient w.r.t. the input rows the tap read
+            if (bottom_diff) {
+              caffe_cpu_strided_gemm<Dtype>(CblasNoTrans, CblasTrans,
+                  end - begin, channels, num_output, Dtype(1),
+                  top_row + begin * num_output, num_output,
+                  tap_weight + tap * tap_size, num_output, Dtype(1),
+                  bottom_diff + in_offset, stride * channels);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void conv3d_ndhwc_gather_weight_cpu<float>(const float* weight,
+    const int num_output, const int channels, const int ksize,
+    const int kdepth, float* tap_weight);
+template void conv3d_ndhwc_gather_weight_cpu<double>(const double* weight,
+    const int num_output, const int channels, const int ksize,
+    const int kdepth, double* tap_weight);
+template void conv3d_ndhwc_scatter_weight_cpu<float>(
+    const float* tap_weight_diff, const int num_output, const int channels,
+    const int ksize, const int kdepth, float* weight_diff);
+template void conv3d_ndhwc_scatter_weight_cpu<double>(
+    const double* tap_weight_diff, const int num_output, const int channels,
+    const int ksize, const int kdepth, double* weight_diff);
+template void conv3d_ndhwc_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const float* tap_weight, const int num_output, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const float* bias, float* data_out);
+template void conv3d_ndhwc_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const double* tap_weight, const int num_output, const int ksize,
+    const int kdepth, const int pad, const int temporal_pad, const int stride,
+    const int temporal_stride, const double* bias, double* data_out);
+template void conv3d_ndhwc_backward_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const float* top_diff, const float* tap_weight, const int num_output,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, float* tap_weight_diff,
+    float* bottom_diff);
+template void conv3d_ndhwc_backward_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const double* top_diff, const double* tap_weight, const int num_output,
+    const int ksize, const int kdepth, const int pad, const int temporal_pad,
+    const int stride, const int temporal_stride, double* tap_weight_diff,
+    double* bottom_diff);
+
+}  // namespace caffe
@@ -0,0 +1,244 @@
+#include "caffe/util/conv3d_winograd.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// F(2, 3): 2 outputs of a 3-tap filter from a 4-element input tile.
+static const int kTile = 4;
+static const int kTileVolume = kTile * kTile * kTile;
+
+static inline int tiles_of(const int n) {
+  return (n + 1) / 2;
+}
+
+// 1D transforms along one axis of a 4x4x4 tile, applied in place to the
+// elements x[0], x[step], x[2 * step], x[3 * step].
+
+// B^T d
+template <typename Dtype>
+static inline void input_transform_1d(Dtype* x, const int step) {
+  const Dtype d0 = x[0], d1 = x[step], d2 = x[2 * step], d3 = x[3 * step];
+  x[0] = d0 - d2;
+  x[step] = d1 + d2;
+  x[2 * step] = d2 - d1;
+  x[3 * step] = d1 - d3;
+}
+
+// G g, from 3 taps to 4
+template <typename Dtype>
+static inline void filter_transform_1d(const Dtype* g, const int g_step,
+    Dtype* u, const int u_step) {
+  const Dtype g0 = g[0], g1 = g[g_step], g2 = g[2 * g_step];
+  u[0] = g0;
+  u[u_step] = (g0 + g1 + g2) / 2;
+  u[2 * u_step] = (g0 - g1 + g2) / 2;
+  u[3 * u_step] = g2;
+}
+
+// A^T m, from 4 elements to 2
+template <typename Dtype>
+static inline void output_transform_1d(const Dtype* m, const int m_step,
+    Dtype* y, const int y_step) {
+  const Dtype m1 = m[m_step], m2 = m[2 * m_step];
+  y[0] = m[0] + m1 + m2;
+  y[y_step] = m1 - m2 - m[3 * m_step];
+}
+
+int conv3d_winograd_filter_size(const int num_output, const int channels) {
+  return kTileVolume * num_output * channels;
+}
+
+static inline void padded_shape(const int length, const int height,
+    const int width, const int pad, const int temporal_pad, int* length_pad,
+    int* height_pad, int* width_pad) {
+  // room for whole tiles: 2 * tiles + 2 >= size + 2 * pad
+  *length_pad = 2 * tiles_of(length + 2 * temporal_pad - 2) + 2;
+  *height_pad = 2 * tiles_of(height + 2 * pad - 2) + 2;
+  *width_pad = 2 * tiles_of(width + 2 * pad - 2) + 2;
+}
+
+int conv3d_winograd_workspace_size(const int channels, const int length,
+    const int height, const int width, const int num_output, const int pad,
+    const int temporal_pad) {
+  int length_pad, height_pad, width_pad;
+  padded_shape(length, height, width, pad, temporal_pad, &length_pad,
+      &height_pad, &width_pad);
+  const int num_tiles = (length_pad / 2 - 1) * (height_pad / 2 - 1)
+      * (width_pad / 2 - 1);
+  return channels * length_pad * height_pad * width_pad
+      + kTileVolume * (channels + num_output) * num_tiles;
+}
+
+template <typename Dtype>
+void conv3d_winograd_transform_filter_cpu(const Dtype* weight,
+    const int num_output, const int channels, Dtype* filter_transformed) {
+  for (int o = 0; o < num_output; ++o) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* g = weight + (o * channels + c) * 27;
+      // along w: 3x3x3 -> 3x3x4, along h: -> 3x4x4, along l: -> 4x4x4
+      Dtype gw[3][3][kTile], gh[3][kTile][kTile], u[kTile][kTile][kTile];
+      for (int l = 0; l < 3; ++l) {
+        for (int h = 0; h < 3; ++h) {
+          filter_transform_1d(g + (l * 3 + h) * 3, 1, gw[l][h], 1);
+        }
+      }
+      for (int l = 0; l < 3; ++l) {
+        for (int w = 0; w < kTile; ++w) {
+          filter_transform_1d(&gw[l][0][w], kTile, &gh[l][0][w], kTile);
+        }
+      }
+      for (int h = 0; h < kTile; ++h) {
+        for (int w = 0; w < kTile; ++w) {
+          filter_transform_1d(&gh[0][h][w], kTile * kTile, &u[0][h][w],
+              kTile * kTile);
+        }
+      }
+      const Dtype* u_data = &u[0][0][0];
+      for (int xi = 0; xi < kTileVolume; ++xi) {
+        filter_transformed[(xi * num_output + o) * channels + c] = u_data[xi];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv3d_winograd_cpu(const Dtype* data_im, const int channels,
+    const int length, const int height, const int width,
+    const Dtype* filter_transformed, const int num_output, const int pad,
+    const int temporal_pad, const Dtype* bias, Dtype* data_out,
+    Dtype* workspace) {
+  int length_pad, height_pad, width_pad;
+  padded_shape(length, height, width, pad, temporal_pad, &length_pad,
+      &height_pad, &width_pad);
+  const int length_out = length + 2 * temporal_pad - 2;
+  const int height_out = height + 2 * pad - 2;
+  const int width_out = width + 2 * pad - 2;
+  const int tiles_l = length_pad / 2 - 1;
+  const int tiles_h = height_pad / 2 - 1;
+  const int tiles_w = width_pad / 2 - 1;
+  const int num_tiles = tiles_l * tiles_h * tiles_w;
+  const int padded_size = channels * length_pad * height_pad * width_pad;
+
+  // Zero-padded input, with extra zeros past the last partial tile.
+  Dtype* padded = workspace;
+  caffe_set(padded_size, Dtype(0), padded);
+  for (int c = 0; c < channels; ++c) {
+    for (int l = 0; l < length; ++l) {
+      for (int h = 0; h < height; ++h) {
+        caffe_copy(width, data_im + ((c * length + l) * height + h) * width,
+            padded + ((c * length_pad + l + temporal_pad) * height_pad
+            + h + pad) * width_pad + pad);
+      }
+    }
+  }
+
+  // Input transform: 64 matrices of channels x num_tiles.
+  Dtype* input_transformed = padded + padded_size;
+  for (int c = 0; c < channels; ++c) {
+    for (int tl = 0; tl < tiles_l; ++tl) {
+      for (int th = 0; th < tiles_h; ++th) {
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          Dtype d[kTile][kTile][kTile];
+          for (int l = 0; l < kTile; ++l) {
+            for (int h = 0; h < kTile; ++h) {
+              const Dtype* in_row = padded + ((c * length_pad + 2 * tl + l)
+                  * height_pad + 2 * th + h) * width_pad + 2 * tw;
+              for (int w = 0; w < kTile; ++w) {
+                d[l][h][w] = in_row[w];
+              }
+            }
+          }
+          for (int i = 0; i < kTile * kTile; ++i) {
+            input_transform_1d(&d[0][0][0] + i * kTile, 1);
+          }
+          for (int l = 0; l < kTile; ++l) {
+            for (int w = 0; w < kTile; ++w) {
+              input_transform_1d(&d[l][0][w], kTile);
+            }
+          }
+          for (int i = 0; i < kTile * kTile; ++i) {
+            input_transform_1d(&d[0][0][0] + i, kTile * kTile);
+          }
+          const int t = (tl * tiles_h + th) * tiles_w + tw;
+          const Dtype* d_data = &d[0][0][0];
+          for (int xi = 0; xi < kTileVolume; ++xi) {
+            input_transformed[(xi * channels + c) * num_tiles + t] =
+                d_data[xi];
+          }
+        }
+      }
+    }
+  }
+
+  // Element-wise products of all tiles, summed over channels.
+  Dtype* output_transformed = input_transformed
+      + kTileVolume * channels * num_tiles;
+  for (int xi = 0; xi < kTileVolume; ++xi) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, num_tiles,
+        channels, (Dtype)1., filter_transformed + xi * num_output * channels,
+        input_transformed + xi * channels * num_tiles, (Dtype)0.,
+        output_transformed + xi * num_output * num_tiles);
+  }
+
+  // Output transform: 4x4x4 -> 2x2x2, clipped to the output volume.
+  for (int o = 0; o < num_output; ++o) {
+    const Dtype bias_value = bias ? bias[o] : Dtype(0);
+    for (int tl = 0; tl < tiles_l; ++tl) {
+      for (int th = 0; th < tiles_h; ++th) {
+        for (int tw = 0; tw < tiles_w; ++tw) {
+          const int t = (tl * tiles_h + th) * tiles_w + tw;
+          Dtype m[kTile][kTile][kTile];
+          Dtype* m_data = &m[0][0][0];
+          for (int xi = 0; xi < kTileVolume; ++xi) {
+            m_data[xi] = output_transformed[(xi * num_output + o) * num_tiles
+                + t];
+          }
+          // along l: 4x4x4 -> 2x4x4, along h: -> 2x2x4, along w: -> 2x2x2
+          Dtype ml[2][kTile][kTile], mh[2][2][kTile], y[2][2][2];
+          for (int i = 0; i < kTile * kTile; ++i) {
+            output_transform_1d(m_data + i, kTile * kTile, &ml[0][0][0] + i,
+                kTile * kTile);
+          }
+          for (int l = 0; l < 2; ++l) {
+            for (int w = 0; w < kTile; ++w) {
+              output_transform_1d(&ml[l][0][w], kTile, &mh[l][0][w], kTile);
+            }
+          }
+          for (int l = 0; l < 2; ++l) {
+            for (int h = 0; h < 2; ++h) {
+              output_transform_1d(mh[l][h], 1, y[l][h], 1);
+            }
+          }
+          for (int l = 0; l < 2 && 2 * tl + l < length_out; ++l) {
+            for (int h = 0; h < 2 && 2 * th + h < height_out; ++h) {
+              Dtype* out_row = data_out + ((o * length_out + 2 * tl + l)
+                  * height_out + 2 * th + h) * width_out + 2 * tw;
+              for (int w = 0; w < 2 && 2 * tw + w < width_out; ++w) {
+                out_row[w] = y[l][h][w] + bias_value;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void conv3d_winograd_transform_filter_cpu<float>(const float* weight,
+    const int num_output, const int channels, float* filter_transformed);
+template void conv3d_winograd_transform_filter_cpu<double>(
+    const double* weight, const int num_output, const int channels,
+    double* filter_transformed);
+template void conv3d_winograd_cpu<float>(const float* data_im,
+    const int channels, const int length, const int height, const int width,
+    const float* filter_transformed, const int num_output, const int pad,
+    const int temporal_pad, const float* bias, float* data_out,
+    float* workspace);
+template void conv3d_winograd_cpu<double>(const double* data_im,
+    const int channels, const int length, const int height, const int width,
+    const double* filter_transformed, const int num_output, const int pad,
+    const int temporal_pad, const double* bias, double* data_out,
+    double* workspace);
+
+}  // namespace caffe
@@ -0,0 +1,215 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Layers whose weights and bias are indexed by output channel along axis 1
+// of their top.
+static bool IsFoldTarget(const LayerParameter& layer_param) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1
+      || layer_param.blobs_size() == 0) {
+    return false;
+  }
+  // shared weights would change for the other layers as well
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (layer_param.param(i).has_name()) {
+      return false;
+    }
+  }
+  const string& type = layer_param.type();
+  return (type == "Convolution" && layer_param.convolution_param().axis() == 1)
+      || type == "Convolution3D"
+      || (type == "InnerProduct"
+          && layer_param.inner_product_param().axis() == 1);
+}
+
+// The per-channel y = scale * x + shift the layer computes in the given
+// phase, or false if its output is not such an affine of its input.
+static bool GetChannelAffine(const LayerParameter& layer_param,
+    const Phase phase, vector<float>* scale, vector<float>* shift) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  vector<shared_ptr<Blob<float> > > blobs(layer_param.blobs_size());
+  for (int i = 0; i < blobs.size(); ++i) {
+    blobs[i].reset(new Blob<float>());
+    blobs[i]->FromProto(layer_param.blobs(i));
+  }
+  const string& type = layer_param.type();
+  if (type == "BN") {
+    const BNParameter& bn_param = layer_param.bn_param();
+    if ((!bn_param.frozen() && phase != TEST) || blobs.size() != 4) {
+      return false;
+    }
+    const int channels = blobs[0]->count();
+    scale->resize(channels);
+    shift->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = blobs[0]->cpu_data()[c]
+          / std::sqrt(blobs[3]->cpu_data()[c] + bn_param.eps());
+      (*shift)[c] = blobs[1]->cpu_data()[c]
+          - blobs[2]->cpu_data()[c] * (*scale)[c];
+    }
+    return true;
+  }
+  if (type == "BatchNorm") {
+    const BatchNormParameter& bn_param = layer_param.batch_norm_param();
+    const bool use_global_stats = bn_param.has_use_global_stats() ?
+        bn_param.use_global_stats() : phase == TEST;
+    if (!use_global_stats || blobs.size() != 3) {
+      return false;
+    }
+    const float factor = blobs[2]->cpu_data()[0] == 0 ?
+        0 : 1 / blobs[2]->cpu_data()[0];
+    const int channels = blobs[0]->count();
+    scale->resize(channels);
+    shift->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = 1 / std::sqrt(factor * blobs[1]->cpu_data()[c]
+          + bn_param.eps());
+      (*shift)[c] = -factor * blobs[0]->cpu_data()[c] * (*scale)[c];
+    }
+    return true;
+  }
+  if (type == "Scale") {
+    const ScaleParameter& scale_param = layer_param.scale_param();
+    if (scale_param.axis() != 1 || scale_param.num_axes() != 1
+        || blobs.size() != (scale_param.bias_term() ? 2 : 1)) {
+      return false;
+    }
+    const int channels = blobs[0]->count();
+    scale->assign(blobs[0]->cpu_data(), blobs[0]->cpu_data() + channels);
+    if (scale_param.bias_term()) {
+      shift->assign(blobs[1]->cpu_data(), blobs[1]->cpu_data() + channels);
+    } else {
+      shift->assign(channels, 0);
+    }
+    return true;
+  }
+  if (type == "Bias") {
+    const BiasParameter& bias_param = layer_param.bias_param();
+    if (bias_param.axis() != 1 || bias_param.num_axes() != 1
+        || blobs.size() != 1) {
+      return false;
+    }
+    const int channels = blobs[0]->count();
+    scale->assign(channels, 1);
+    shift->assign(blobs[0]->cpu_data(), blobs[0]->cpu_data() + channels);
+    return true;
+  }
+  return false;
+}
+
+// Replace the weights W and bias b of the layer by scale * W and
+// scale * b + shift, adding a bias where the layer has none.
+static void FoldChannelAffine(const vector<float>& scale,
+    const vector<float>& shift, LayerParameter* layer_param) {
+  Blob<float> weight;
+  weight.FromProto(layer_param->blobs(0));
+  const bool transpose = layer_param->type() == "InnerProduct"
+      && layer_param->inner_product_param().transpose();
+  const int num_output = weight.shape(transpose ? 1 : 0);
+  CHECK_EQ(scale.size(), num_output) << "Layer " << layer_param->name()
+      << " has " << num_output << " outputs, but is followed by an affine of "
+      << scale.size() << " channels.";
+  float* weight_data = weight.mutable_cpu_data();
+  if (transpose) {
+    // the weights are K x N
+    for (int i = 0; i < weight.count(); ++i) {
+      weight_data[i] *= scale[i % num_output];
+    }
+  } else {
+    const int inner = weight.count(1);
+    for (int i = 0; i < weight.count(); ++i) {
+      weight_data[i] *= scale[i / inner];
+    }
+  }
+  weight.ToProto(layer_param->mutable_blobs(0));
+
+  Blob<float> bias(vector<int>(1, num_output));
+  if (layer_param->blobs_size() > 1) {
+    bias.FromProto(layer_param->blobs(1));
+  } else {
+    caffe_set(num_output, 0.f, bias.mutable_cpu_data());
+    layer_param->add_blobs();
+    if (layer_param->type() == "Convolution") {
+      layer_param->mutable_convolution_param()->set_bias_term(true);
+    } else if (layer_param->type() == "Convolution3D") {
+      layer_param->mutable_convolution3d_param()->set_bias_term(true);
+    } else {
+      layer_param->mutable_inner_product_param()->set_bias_term(true);
+    }
+  }
+  CHECK_EQ(bias.count(), num_output);
+  float* bias_data = bias.mutable_cpu_data();
+  for (int c = 0; c < num_output; ++c) {
+    bias_data[c] = bias_data[c] * scale[c] + shift[c];
+  }
+  bias.ToProto(layer_param->mutable_blobs(1));
+}
+
+static bool HasBottom(const LayerParameter& layer_param,
+    const string& blob_name) {
+  for (int i = 0; i < layer_param.bottom_size(); ++i) {
+    if (layer_param.bottom(i) == blob_name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FoldBatchNorm(const NetParameter& param, NetParameter* param_folded) {
+  const Phase phase = param.state().phase();
+  vector<LayerParameter> layers(param.layer().begin(), param.layer().end());
+  vector<bool> folded(layers.size(), false);
+  for (int i = 0; i < layers.size(); ++i) {
+    if (folded[i] || !IsFoldTarget(layers[i])) {
+      continue;
+    }
+    // Fold the chain of affine layers reading the top, one at a time.
+    while (true) {
+      const string blob_name = layers[i].top(0);
+      int j = i + 1;
+      while (j < layers.size() && (folded[j]
+          || !HasBottom(layers[j], blob_name))) {
+        ++j;
+      }
+      vector<float> scale, shift;
+      if (j == layers.size()
+          || !GetChannelAffine(layers[j], phase, &scale, &shift)) {
+        break;
+      }
+      // Unless it runs in place, nothing else may read the top before the
+      // affine is applied.
+      bool shared = false;
+      if (layers[j].top(0) != blob_name) {
+        for (int k = j + 1; k < layers.size(); ++k) {
+          shared |= !folded[k] && HasBottom(layers[k], blob_name);
+        }
+      }
+      if (shared) {
+        break;
+      }
+      LOG(INFO) << "Folding " << layers[j].type() << " layer "
+                << layers[j].name() << " into " << layers[i].name();
+      FoldChannelAffine(scale, shift, &layers[i]);
+      layers[i].set_top(0, layers[j].top(0));
+      folded[j] = true;
+    }
+  }
+  param_folded->CopyFrom(param);
+  param_folded->clear_layer();
+  for (int i = 0; i < layers.size(); ++i) {
+    if (!folded[i]) {
+      param_folded->add_layer()->CopyFrom(layers[i]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,118 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/graph_scheduler.hpp"
+
+namespace caffe {
+
+GraphScheduler::GraphScheduler(int num_threads)
+    : mutex_(new boost::mutex()), ready_(new boost::condition_variable()),
+      done_(new boost::condition_variable()), omp_threads_(1), stop_(false),
+      successors_(NULL), task_(NULL), num_remaining_(0) {
+  CHECK_GE(num_threads, 1);
+#ifdef _OPENMP
+  omp_threads_ = std::max(1, omp_get_max_threads() / num_threads);
+#endif
+  for (int i = 1; i < num_threads; ++i) {
+    try {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          boost::bind(&GraphScheduler::WorkerEntry, this, omp_threads_,
+              Caffe::root_solver()))));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+GraphScheduler::~GraphScheduler() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stop_ = true;
+  }
+  ready_->notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void GraphScheduler::WorkerEntry(int omp_threads, bool root_solver) {
+#ifdef _OPENMP
+  omp_set_num_threads(omp_threads);
+#endif
+  Caffe::set_root_solver(root_solver);
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (true) {
+    while (!stop_ && ready_tasks_.empty()) {
+      ready_->wait(lock);
+    }
+    if (stop_) {
+      return;
+    }
+    RunReady(&lock);
+  }
+}
+
+template <typename Lock>
+void GraphScheduler::RunReady(Lock* lock) {
+  const int task = ready_tasks_.front();
+  ready_tasks_.pop_front();
+  lock->unlock();
+  (*task_)(task);
+  lock->lock();
+  const vector<int>& successors = (*successors_)[task];
+  bool released = false;
+  for (int i = 0; i < successors.size(); ++i) {
+    if (--num_waiting_[successors[i]] == 0) {
+      ready_tasks_.push_back(successors[i]);
+      ready_->notify_one();
+      released = true;
+    }
+  }
+  // wake the caller as well, to run the released tasks or to return
+  if (--num_remaining_ == 0 || released) {
+    done_->notify_all();
+  }
+}
+
+void GraphScheduler::Run(const vector<vector<int> >& successors,
+    const boost::function<void(int)>& task) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  successors_ = &successors;
+  task_ = &task;
+  num_remaining_ = successors.size();
+  num_waiting_.assign(successors.size(), 0);
+  for (int i = 0; i < successors.size(); ++i) {
+    for (int j = 0; j < successors[i].size(); ++j) {
+      CHECK_GT(successors[i][j], i) << "Tasks must depend on earlier ones.";
+      ++num_waiting_[successors[i][j]];
+    }
+  }
+  for (int i = 0; i < successors.size(); ++i) {
+    if (num_waiting_[i] == 0) {
+      ready_tasks_.push_back(i);
+    }
+  }
+  ready_->notify_all();
+#ifdef _OPENMP
+  const int caller_omp_threads = omp_get_max_threads();
+  omp_set_num_threads(omp_threads_);
+#endif
+  while (num_remaining_ > 0) {
+    if (!ready_tasks_.empty()) {
+      RunReady(&lock);
+    } else {
+      done_->wait(lock);
+    }
+  }
+#ifdef _OPENMP
+  omp_set_num_threads(caller_omp_threads);
+#endif
+}
+
+}  // namespace caffe
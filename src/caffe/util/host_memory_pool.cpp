@@ -0,0 +1,201 @@
+#include <boost/thread.hpp>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+static const size_t kAlignment = 64;
+static const size_t kHugePageSize = 2 << 20;
+static const size_t kDefaultCacheLimit = size_t(1) << 30;
+
+HostMemoryPool& HostMemoryPool::Get() {
+  // Never destroyed, as blobs may be freed after static destruction began.
+  static HostMemoryPool* pool = new HostMemoryPool();
+  return *pool;
+}
+
+HostMemoryPool::HostMemoryPool()
+    : mutex_(new boost::mutex()), in_use_(0), cached_(0), peak_(0),
+      cache_limit_(kDefaultCacheLimit), huge_pages_(false), clock_(0) {}
+
+size_t HostMemoryPool::ClassSize(size_t size) {
+  if (size <= kAlignment) {
+    return kAlignment;
+  }
+  // a multiple of a quarter of the power of two below size
+  size_t power = kAlignment;
+  while (power * 2 < size) {
+    power *= 2;
+  }
+  const size_t step = power / 4;
+  return (size + step - 1) / step * step;
+}
+
+void* HostMemoryPool::SystemAllocate(size_t size, bool use_cuda,
+    bool huge_pages) {
+  void* ptr = NULL;
+#ifndef CPU_ONLY
+  if (use_cuda) {
+    CUDA_CHECK(cudaMallocHost(&ptr, size));
+    return ptr;
+  }
+#endif
+  const bool huge = huge_pages && size >= kHugePageSize;
+  CHECK_EQ(posix_memalign(&ptr, huge ? kHugePageSize : kAlignment, size), 0)
+      << "host allocation of size " << size << " failed";
+#ifdef MADV_HUGEPAGE
+  if (huge) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+}
+
+void HostMemoryPool::SystemFree(void* ptr, bool use_cuda) {
+#ifndef CPU_ONLY
+  if (use_cuda) {
+    CUDA_CHECK(cudaFreeHost(ptr));
+    return;
+  }
+#endif
+  free(ptr);
+}
+
+void* HostMemoryPool::Allocate(size_t size, bool use_cuda) {
+  const size_t class_size = ClassSize(size);
+  bool huge_pages;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    huge_pages = huge_pages_;
+    in_use_ += class_size;
+    peak_ = std::max(peak_, in_use_);
+    std::map<size_t, FreeClass>::iterator it =
+        free_blocks_[use_cuda].find(class_size);
+    if (it != free_blocks_[use_cuda].end()) {
+      void* ptr = it->second.blocks.back();
+      it->second.blocks.pop_back();
+      if (it->second.blocks.empty()) {
+        free_blocks_[use_cuda].erase(it);
+      } else {
+        it->second.last_used = ++clock_;
+      }
+      cached_ -= class_size;
+      return ptr;
+    }
+  }
+  return SystemAllocate(class_size, use_cuda, huge_pages);
+}
+
+void HostMemoryPool::Free(void* ptr, size_t size, bool use_cuda) {
+  const size_t class_size = ClassSize(size);
+  std::vector<std::pair<void*, bool> > evicted;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    in_use_ -= class_size;
+    if (class_size <= limit()) {
+      FreeClass& free_class = free_blocks_[use_cuda][class_size];
+      free_class.blocks.push_back(ptr);
+      free_class.last_used = ++clock_;
+      cached_ += class_size;
+      Evict(&evicted);
+      ptr = NULL;
+    }
+  }
+  if (ptr) {
+    SystemFree(ptr, use_cuda);
+  }
+  for (int i = 0; i < evicted.size(); ++i) {
+    SystemFree(evicted[i].first, evicted[i].second);
+  }
+}
+
+size_t HostMemoryPool::limit() const {
+  return std::min(cache_limit_, peak_);
+}
+
+void HostMemoryPool::Evict(std::vector<std::pair<void*, bool> >* evicted) {
+  while (cached_ > limit()) {
+    // the class used longest ago, of either kind
+    std::map<size_t, FreeClass>::iterator oldest;
+    int oldest_use_cuda = -1;
+    for (int use_cuda = 0; use_cuda < 2; ++use_cuda) {
+      std::map<size_t, FreeClass>::iterator it;
+      for (it = free_blocks_[use_cuda].begin();
+           it != free_blocks_[use_cuda].end(); ++it) {
+        if (oldest_use_cuda < 0
+            || it->second.last_used < oldest->second.last_used) {
+          oldest = it;
+          oldest_use_cuda = use_cuda;
+        }
+      }
+    }
+    evicted->push_back(std::make_pair(oldest->second.blocks.back(),
+        oldest_use_cuda == 1));
+    oldest->second.blocks.pop_back();
+    cached_ -= oldest->first;
+    if (oldest->second.blocks.empty()) {
+      free_blocks_[oldest_use_cuda].erase(oldest);
+    }
+  }
+}
+
+void HostMemoryPool::Trim() {
+  std::map<size_t, FreeClass> free_blocks[2];
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    for (int use_cuda = 0; use_cuda < 2; ++use_cuda) {
+      free_blocks[use_cuda].swap(free_blocks_[use_cuda]);
+    }
+    cached_ = 0;
+  }
+  for (int use_cuda = 0; use_cuda < 2; ++use_cuda) {
+    std::map<size_t, FreeClass>::iterator it;
+    for (it = free_blocks[use_cuda].begin();
+         it != free_blocks[use_cuda].end(); ++it) {
+      for (int i = 0; i < it->second.blocks.size(); ++i) {
+        SystemFree(it->second.blocks[i], use_cuda);
+      }
+    }
+  }
+}
+
+void HostMemoryPool::set_cache_limit(size_t cache_limit) {
+  std::vector<std::pair<void*, bool> > evicted;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    cache_limit_ = cache_limit;
+    Evict(&evicted);
+  }
+  for (int i = 0; i < evicted.size(); ++i) {
+    SystemFree(evicted[i].first, evicted[i].second);
+  }
+}
+
+void HostMemoryPool::set_huge_pages(bool huge_pages) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  huge_pages_ = huge_pages;
+}
+
+size_t HostMemoryPool::in_use() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return in_use_;
+}
+
+size_t HostMemoryPool::cached() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return cached_;
+}
+
+size_t HostMemoryPool::peak() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return peak_;
+}
+
+}  // namespace caffe
@@ -0,0 +1,253 @@
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_layouts.hpp"
+
+namespace caffe {
+
+// Layers computing every output element from the input element at the same
+// offset, for which the layout makes no difference.
+static bool IsLayoutAgnostic(const string& type) {
+  static const char* kTypes[] = {"AbsVal", "BNLL", "Dropout", "ELU", "Exp",
+      "Log", "Power", "ReLU", "Sigmoid", "Silence", "Split", "TanH",
+      "Threshold", "Eltwise"};
+  for (int i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); ++i) {
+    if (type == kTypes[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The layout the layer computes in, after configuring it for NDHWC where it
+// supports it and its parameters do not name a layout already.
+static Layout3D ConfigureLayout(LayerParameter* layer_param,
+    const Layout3D bottom_layout) {
+  const string& type = layer_param->type();
+  if (type == "Convolution3D") {
+    Convolution3DParameter* conv_param =
+        layer_param->mutable_convolution3d_param();
+    if (!conv_param->has_layout() && conv_param->group() == 1
+        && conv_param->engine() != Convolution3DParameter_Engine_WINOGRAD) {
+      conv_param->set_layout(NDHWC);
+    }
+    return conv_param->layout();
+  }
+  if (type == "Pooling3D") {
+    Pooling3DParameter* pool_param = layer_param->mutable_pooling3d_param();
+    if (!pool_param->has_layout()) {
+      pool_param->set_layout(NDHWC);
+    }
+    return pool_param->layout();
+  }
+  if (type == "BN") {
+    BNParameter* bn_param = layer_param->mutable_bn_param();
+    if (!bn_param->has_layout()) {
+      bn_param->set_layout(bottom_layout);
+    }
+    return bn_param->layout();
+  }
+  // Normalizing whole samples or the whole batch does not tell the
+  // channels apart either.
+  if (IsLayoutAgnostic(type)
+      || (type == "MVN_ND" && layer_param->mvn_param().axis() <= 1)) {
+    return bottom_layout;
+  }
+  return NCDHW;
+}
+
+// The blobs that the net keeps for the caller to read: those no layer
+// consumes after producing them, as Net takes them for its outputs, and the
+// ones named in keep_blob.
+static vector<string> KeptBlobs(const NetParameter& param) {
+  set<string> available(param.input().begin(), param.input().end());
+  vector<string> produced(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      available.erase(layer_param.bottom(j));
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      available.insert(layer_param.top(j));
+      produced.push_back(layer_param.top(j));
+    }
+  }
+  available.insert(param.keep_blob().begin(), param.keep_blob().end());
+  vector<string> kept;
+  for (int i = 0; i < produced.size(); ++i) {
+    if (available.erase(produced[i])) {
+      kept.push_back(produced[i]);
+    }
+  }
+  return kept;
+}
+
+static void RenameBlob(const string& blob_name, const string& new_name,
+    NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    for (int j = 0; j < layer_param->bottom_size(); ++j) {
+      if (layer_param->bottom(j) == blob_name) {
+        layer_param->set_bottom(j, new_name);
+      }
+    }
+    for (int j = 0; j < layer_param->top_size(); ++j) {
+      if (layer_param->top(j) == blob_name) {
+        layer_param->set_top(j, new_name);
+      }
+    }
+  }
+}
+
+void InsertLayoutConversions(const NetParameter& param,
+    NetParameter* param_layout) {
+  param_layout->CopyFrom(param);
+  if (param.layout3d() != NDHWC) {
+    return;
+  }
+  param_layout->clear_layer();
+  // Layouts of the blobs produced so far; the net inputs are NCDHW.
+  map<string, Layout3D> blob_layout;
+  // The converted copies of blobs in either layout, reused until the blob
+  // is produced again.
+  map<string, string> converted[2];
+  // Blobs that in-place layers went on to compute on a converted copy of,
+  // and kept blobs produced channels-last, which are given another name.
+  map<string, string> renamed;
+  map<string, int> conversion_count[2];
+  // The blobs to hand back NCDHW under their own names.
+  const vector<string> kept = KeptBlobs(param);
+  const set<string> kept_set(kept.begin(), kept.end());
+  set<string> produced(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter layer_param(param.layer(i));
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      string blob_name = layer_param.bottom(j);
+      while (renamed.count(blob_name)) {
+        blob_name = renamed[blob_name];
+      }
+      for (int k = 0; k < layer_param.top_size(); ++k) {
+        if (layer_param.top(k) == layer_param.bottom(j)) {
+          layer_param.set_top(k, blob_name);
+        }
+      }
+      layer_param.set_bottom(j, blob_name);
+    }
+    // A Layout3D layer converts its bottoms from the other layout itself.
+    Layout3D bottom_layout, top_layout;
+    if (layer_param.type() == "Layout3D") {
+      top_layout = layer_param.layout3d_param().layout();
+      bottom_layout = top_layout == NDHWC ? NCDHW : NDHWC;
+    } else {
+      bottom_layout = ConfigureLayout(&layer_param,
+          layer_param.bottom_size() > 0 ?
+          blob_layout[layer_param.bottom(0)] : NCDHW);
+      // the bottoms of an Eltwise have to agree
+      for (int j = 1; j < layer_param.bottom_size(); ++j) {
+        if (blob_layout[layer_param.bottom(j)] != bottom_layout) {
+          bottom_layout = NCDHW;
+        }
+      }
+      top_layout = bottom_layout;
+    }
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string blob_name = layer_param.bottom(j);
+      if (blob_layout[blob_name] == bottom_layout) {
+        continue;
+      }
+      if (!converted[bottom_layout].count(blob_name)) {
+        const string layout_name = LayoutBlobName(blob_name, bottom_layout,
+            conversion_count[bottom_layout][blob_name]++);
+        LayerParameter* layout_layer_param = param_layout->add_layer();
+        layout_layer_param->set_name(layout_name);
+        layout_layer_param->set_type("Layout3D");
+        layout_layer_param->add_bottom(blob_name);
+        layout_layer_param->add_top(layout_name);
+        layout_layer_param->mutable_layout3d_param()->set_layout(
+            bottom_layout);
+        blob_layout[layout_name] = bottom_layout;
+        converted[bottom_layout][blob_name] = layout_name;
+      }
+      const string& layout_name = converted[bottom_layout][blob_name];
+      for (int k = 0; k < layer_param.top_size(); ++k) {
+        if (layer_param.top(k) == blob_name) {
+          layer_param.set_top(k, layout_name);
+          renamed[blob_name] = layout_name;
+        }
+      }
+      layer_param.set_bottom(j, layout_name);
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      string blob_name = layer_param.top(j);
+      bool in_place = false;
+      for (int k = 0; k < layer_param.bottom_size(); ++k) {
+        in_place |= layer_param.bottom(k) == blob_name;
+      }
+      if (!in_place) {
+        renamed.erase(blob_name);
+        if (top_layout == NDHWC && kept_set.count(blob_name)
+            && layer_param.type() != "Layout3D") {
+          const string layout_name = LayoutBlobName(blob_name, NDHWC,
+              conversion_count[NDHWC][blob_name]++);
+          renamed[blob_name] = layout_name;
+          layer_param.set_top(j, layout_name);
+          blob_name = layout_name;
+        }
+      }
+      blob_layout[blob_name] = top_layout;
+      converted[NCDHW].erase(blob_name);
+      converted[NDHWC].erase(blob_name);
+      produced.insert(blob_name);
+    }
+    param_layout->add_layer()->CopyFrom(layer_param);
+  }
+  // Hand the kept blobs back NCDHW under their own names: rename the NCDHW
+  // copy of a blob that later layers computed on or read, if any, or else
+  // convert it once more. A name that is taken already, as that of a net
+  // input, is left to the copy.
+  for (int i = 0; i < kept.size(); ++i) {
+    const string& blob_name = kept[i];
+    string layout_name = blob_name;
+    while (renamed.count(layout_name)) {
+      layout_name = renamed[layout_name];
+    }
+    if (layout_name == blob_name) {
+      continue;
+    }
+    if (blob_layout[layout_name] == NDHWC
+        && converted[NCDHW].count(layout_name)) {
+      layout_name = converted[NCDHW][layout_name];
+    }
+    if (blob_layout[layout_name] == NCDHW) {
+      if (!produced.count(blob_name)) {
+        RenameBlob(layout_name, blob_name, param_layout);
+      }
+      continue;
+    }
+    const string conversion_name = LayoutBlobName(blob_name, NCDHW,
+        conversion_count[NCDHW][blob_name]++);
+    LayerParameter* layout_layer_param = param_layout->add_layer();
+    layout_layer_param->set_name(conversion_name);
+    layout_layer_param->set_type("Layout3D");
+    layout_layer_param->add_bottom(layout_name);
+    layout_layer_param->add_top(produced.count(blob_name) ?
+        conversion_name : blob_name);
+    layout_layer_param->mutable_layout3d_param()->set_layout(NCDHW);
+  }
+}
+
+string LayoutBlobName(const string& blob_name, const Layout3D layout,
+    const int conversion_idx) {
+  ostringstream layout_blob_name;
+  layout_blob_name << blob_name << "_" << (layout == NDHWC ? "ndhwc" : "ncdhw");
+  if (conversion_idx > 0) {
+    layout_blob_name << "_" << conversion_idx;
+  }
+  return layout_blob_name.str();
+}
+
+}  // namespace caffe
@@ -1,6 +1,7 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
@@ -31,6 +32,24 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
       ldb, beta, C, N);
 }
 
+template<>
+void caffe_cpu_strided_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+template<>
+void caffe_cpu_strided_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
@@ -104,6 +123,30 @@ template void caffe_copy<unsigned int>(const int N, const unsigned int* X,
 template void caffe_copy<float>(const int N, const float* X, float* Y);
 template void caffe_copy<double>(const int N, const double* X, double* Y);
 
+template <typename Dtype>
+void caffe_cpu_transpose(const int M, const int N, const Dtype* X, Dtype* Y) {
+  // 32 x 32 tiles of both matrices fit in L1 together
+  const int kTile = 32;
+  for (int i0 = 0; i0 < M; i0 += kTile) {
+    const int i1 = std::min(i0 + kTile, M);
+    for (int j0 = 0; j0 < N; j0 += kTile) {
+      const int j1 = std::min(j0 + kTile, N);
+      for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+          Y[j * M + i] = X[i * N + j];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_transpose<int>(const int M, const int N,
+    const int* X, int* Y);
+template void caffe_cpu_transpose<float>(const int M, const int N,
+    const float* X, float* Y);
+template void caffe_cpu_transpose<double>(const int M, const int N,
+    const double* X, double* Y);
+
 template <>
 void caffe_scal<float>(const int N, const float alpha, float *X) {
   cblas_sscal(N, alpha, X, 1);
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/prefetch_monitor.hpp"
+
+namespace caffe {
+
+PrefetchMonitor::PrefetchMonitor(const PrefetchParameter& param,
+    const string& name)
+    : param_(param), name_(name),
+      window_forwards_(0), window_stalls_(0), window_saturated_(0),
+      log_forwards_(0), log_stalls_(0), log_wait_ms_(0) {
+  CHECK_GT(param_.count(), 0) << "prefetch count must be positive";
+  if (param_.adaptive()) {
+    CHECK_GT(param_.min_count(), 0) << "prefetch min_count must be positive";
+    CHECK_LE(param_.min_count(), param_.max_count())
+        << "prefetch min_count must not exceed max_count";
+    CHECK_GT(param_.adapt_interval(), 0);
+  }
+}
+
+int PrefetchMonitor::MaxDepth(size_t batch_bytes) const {
+  int max_depth = param_.max_count();
+  if (param_.memory_budget_mb() > 0 && batch_bytes > 0) {
+    const size_t budget = static_cast<size_t>(param_.memory_budget_mb()) << 20;
+    const int budget_depth = static_cast<int>(std::min<size_t>(
+        budget / batch_bytes, param_.max_count()));
+    max_depth = std::max(budget_depth, static_cast<int>(param_.min_count()));
+  }
+  return max_depth;
+}
+
+int PrefetchMonitor::Update(bool stalled, float wait_ms, bool saturated,
+    int depth, size_t batch_bytes) {
+  ++log_forwards_;
+  log_stalls_ += stalled;
+  log_wait_ms_ += wait_ms;
+  if (param_.log_interval() > 0 && log_forwards_ >= param_.log_interval()) {
+    LOG(INFO) << name_ << " prefetch: " << log_stalls_ << "/" << log_forwards_
+        << " forwards waited for data, " << log_wait_ms_ << " ms in total, "
+        << "queue depth " << depth;
+    log_forwards_ = 0;
+    log_stalls_ = 0;
+    log_wait_ms_ = 0;
+  }
+  if (!param_.adaptive()) {
+    return 0;
+  }
+  ++window_forwards_;
+  window_stalls_ += stalled;
+  window_saturated_ += saturated;
+  const int max_depth = MaxDepth(batch_bytes);
+  int delta = 0;
+  if (depth > max_depth) {
+    // Batches grew past the memory budget: give memory back right away.
+    delta = -1;
+  } else if (window_forwards_ >= param_.adapt_interval()) {
+    if (window_stalls_ > 0 && depth < max_depth) {
+      delta = 1;
+    } else if (window_saturated_ == window_forwards_ &&
+        depth > param_.min_count()) {
+      delta = -1;
+    }
+  } else {
+    return 0;
+  }
+  if (delta != 0) {
+    DLOG(INFO) << name_ << " prefetch depth " << depth << " -> "
+        << depth + delta;
+  }
+  window_forwards_ = 0;
+  window_stalls_ = 0;
+  window_saturated_ = 0;
+  return delta;
+}
+
+}  // namespace caffe
@@ -0,0 +1,207 @@
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+static const size_t kDefaultCapacity = 1 << 16;
+
+// Small numbers for the threads, in the order they first record an event.
+static std::map<boost::thread::id, int>& ThreadNumbers() {
+  static std::map<boost::thread::id, int>* numbers =
+      new std::map<boost::thread::id, int>();
+  return *numbers;
+}
+
+// The sums over the events of one category and name.
+struct Totals {
+  Totals() : count(0), duration(0), flops(0), bytes(0) {}
+  int count;
+  int64_t duration;
+  double flops, bytes;
+};
+
+// Quote a string for JSON.
+static string JsonString(const string& s) {
+  std::ostringstream out;
+  out << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      out << '\\' << s[i];
+    } else if (static_cast<unsigned char>(s[i]) < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(s[i]) << std::dec;
+    } else {
+      out << s[i];
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+Profiler& Profiler::Get() {
+  // Never destroyed, as threads may record after static destruction began.
+  static Profiler* profiler = new Profiler();
+  return *profiler;
+}
+
+Profiler::Profiler()
+    : mutex_(new boost::mutex()), enabled_(true), capacity_(kDefaultCapacity),
+      num_recorded_(0) {
+  Now();
+}
+
+int64_t Profiler::Now() {
+  static const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::universal_time();
+  return (boost::posix_time::microsec_clock::universal_time() - start)
+      .total_microseconds();
+}
+
+void Profiler::Record(const string& name, const char* category,
+    int64_t start_us, int64_t duration_us, double flops, double bytes) {
+  if (!enabled_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  if (events_.size() < capacity_) {
+    events_.push_back(Event());
+  }
+  Event& event = events_[num_recorded_ % capacity_];
+  ++num_recorded_;
+  event.name = name;
+  event.category = category;
+  event.start = start_us;
+  event.duration = duration_us;
+  std::map<boost::thread::id, int>& threads = ThreadNumbers();
+  const boost::thread::id id = boost::this_thread::get_id();
+  if (!threads.count(id)) {
+    const int number = threads.size();
+    threads[id] = number;
+  }
+  event.thread = threads[id];
+  event.flops = flops;
+  event.bytes = bytes;
+}
+
+void Profiler::RecordBatch(const string& name, double batch_us,
+    double read_us, double transform_us) {
+  const int64_t end = Now();
+  const int64_t start = end - static_cast<int64_t>(batch_us);
+  Record(name, "load", start, end - start);
+  if (read_us > 0) {
+    Record(name, "read", start, static_cast<int64_t>(read_us));
+  }
+  if (transform_us > 0) {
+    Record(name, "transform", start + static_cast<int64_t>(read_us),
+        static_cast<int64_t>(transform_us));
+  }
+}
+
+vector<const Profiler::Event*> Profiler::Events() const {
+  vector<const Event*> events;
+  const size_t first = num_recorded_ > events_.size() ?
+      num_recorded_ % events_.size() : 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    events.push_back(&events_[(first + i) % events_.size()]);
+  }
+  return events;
+}
+
+void Profiler::WriteTrace(const string& filename) {
+  std::ofstream file(filename.c_str());
+  CHECK(file.good()) << "Failed to open trace file " << filename;
+  boost::mutex::scoped_lock lock(*mutex_);
+  vector<const Event*> events = Events();
+  file << "{\"traceEvents\": [";
+  for (int i = 0; i < events.size(); ++i) {
+    file << (i ? ",\n" : "\n") << "{\"name\": " << JsonString(events[i]->name)
+        << ", \"cat\": " << JsonString(events[i]->category)
+        << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << events[i]->thread
+        << ", \"ts\": " << events[i]->start
+        << ", \"dur\": " << events[i]->duration;
+    if (events[i]->flops > 0 || events[i]->bytes > 0) {
+      file << ", \"args\": {\"flops\": " << events[i]->flops
+          << ", \"bytes\": " << events[i]->bytes << "}";
+    }
+    file << "}";
+  }
+  file << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  CHECK(file.good()) << "Failed to write trace file " << filename;
+  LOG(INFO) << "Wrote " << events.size() << " profiled events to "
+      << filename;
+}
+
+string Profiler::Summary() {
+  std::map<pair<string, string>, Totals> totals;
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    vector<const Event*> events = Events();
+    for (int i = 0; i < events.size(); ++i) {
+      Totals& total =
+          totals[make_pair(string(events[i]->category), events[i]->name)];
+      ++total.count;
+      total.duration += events[i]->duration;
+      total.flops += events[i]->flops;
+      total.bytes += events[i]->bytes;
+    }
+  }
+  vector<pair<int64_t, pair<string, string> > > order;
+  for (std::map<pair<string, string>, Totals>::iterator it = totals.begin();
+       it != totals.end(); ++it) {
+    order.push_back(make_pair(-it->second.duration, it->first));
+  }
+  std::sort(order.begin(), order.end());
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3)
+      << std::setw(10) << "category" << std::setw(24) << "name"
+      << std::setw(8) << "count" << std::setw(12) << "total ms"
+      << std::setw(10) << "avg ms" << std::setw(10) << "GFLOP"
+      << std::setw(10) << "GFLOP/s" << std::setw(10) << "MB"
+      << std::setw(10) << "GB/s" << "\n";
+  for (int i = 0; i < order.size(); ++i) {
+    const Totals& total = totals[order[i].second];
+    const double seconds = std::max<double>(total.duration, 1) / 1e6;
+    out << std::setw(10) << order[i].second.first
+        << std::setw(24) << order[i].second.second
+        << std::setw(8) << total.count
+        << std::setw(12) << total.duration / 1e3
+        << std::setw(10) << total.duration / 1e3 / total.count
+        << std::setw(10) << total.flops / 1e9
+        << std::setw(10) << total.flops / 1e9 / seconds
+        << std::setw(10) << total.bytes / 1e6
+        << std::setw(10) << total.bytes / 1e9 / seconds << "\n";
+  }
+  return out.str();
+}
+
+void Profiler::Clear() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  events_.clear();
+  num_recorded_ = 0;
+}
+
+void Profiler::set_enabled(bool enabled) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  enabled_ = enabled;
+}
+
+void Profiler::set_capacity(size_t capacity) {
+  CHECK_GT(capacity, 0);
+  boost::mutex::scoped_lock lock(*mutex_);
+  capacity_ = capacity;
+  events_.clear();
+  num_recorded_ = 0;
+}
+
+}  // namespace caffe
@@ -14,6 +14,7 @@
  *
  */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -22,39 +23,103 @@
 
 namespace caffe {
 
+// Output positions [*begin, *end) of one axis whose input index
+// i * stride - pad + offset falls inside [0, size). Positions outside read
+// the zero padding, so the loops below only test bounds once per range.
+static inline void valid_range(const int size, const int size_col, const int pad,
+    const int offset, const int stride, int* begin, int* end) {
+  const int lo = pad - offset;
+  const int hi = size + pad - offset;
+  *begin = lo > 0 ? (lo + stride - 1) / stride : 0;
+  *end = hi > 0 ? std::min(size_col, (hi + stride - 1) / stride) : 0;
+  *begin = std::min(*begin, *end);
+}
+
+// Unfolds one volume; row c of the column matrix starts at data_col + c * ld.
+// Rows are independent, so they are split across OpenMP threads; within a
+// row every (l, h) output line is a zero border, a copied interior (one
+// memcpy for stride 1) and another zero border.
 template <typename Dtype>
-void vol2col_cpu(const Dtype* data_im, const int channels, const int length,
+static void vol2col_ld_cpu(const Dtype* data_im, const int channels, const int length,
 	    const int height, const int width, const int ksize, const int kdepth, const int pad,
-	    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_col) {
-  int length_col = (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
-  int height_col = (height + 2 * pad - ksize) / stride + 1;
-  int width_col = (width + 2 * pad - ksize) / stride + 1;
+	    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_col,
+	    const int ld) {
+  const int length_col = (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_col = (height + 2 * pad - ksize) / stride + 1;
+  const int width_col = (width + 2 * pad - ksize) / stride + 1;
+  const int spatial_col = height_col * width_col;
 
-  int channels_col = channels * kdepth * ksize * ksize;
+  const int channels_col = channels * kdepth * ksize * ksize;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
   for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % ksize;
-    int h_offset = (c / ksize) % ksize;
-    int l_offset = (c / ksize / ksize) % kdepth;
-    int c_im = c / ksize / ksize / kdepth;
-    for (int l=0; l < length_col; ++l) {
+    const int w_offset = c % ksize;
+    const int h_offset = (c / ksize) % ksize;
+    const int l_offset = (c / ksize / ksize) % kdepth;
+    const int c_im = c / ksize / ksize / kdepth;
+    int l_begin, l_end, h_begin, h_end, w_begin, w_end;
+    valid_range(length, length_col, temporal_pad, l_offset, temporal_stride, &l_begin, &l_end);
+    valid_range(height, height_col, pad, h_offset, stride, &h_begin, &h_end);
+    valid_range(width, width_col, pad, w_offset, stride, &w_begin, &w_end);
+    const Dtype* im = data_im + c_im * length * height * width;
+    Dtype* col_row = data_col + c * ld;
+    for (int l = 0; l < length_col; ++l) {
+      Dtype* col_plane = col_row + l * spatial_col;
+      if (l < l_begin || l >= l_end) {
+        memset(col_plane, 0, sizeof(Dtype) * spatial_col);
+        continue;
+      }
+      const int l_pad = l * temporal_stride - temporal_pad + l_offset;
       for (int h = 0; h < height_col; ++h) {
-        for (int w = 0; w < width_col; ++w) {
-          int l_pad = l * temporal_stride - temporal_pad + l_offset;
-          int h_pad = h * stride - pad + h_offset;
-          int w_pad = w * stride - pad + w_offset;
-
-          if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width
-        		  && l_pad >=0 && l_pad < length)
-            data_col[((c * length_col + l) * height_col + h) * width_col + w] =
-              data_im[((c_im * length + l_pad) * height + h_pad) * width + w_pad];
-          else
-            data_col[((c * length_col + l) * height_col + h) * width_col + w] = 0;
+        Dtype* col = col_plane + h * width_col;
+        if (h < h_begin || h >= h_end) {
+          memset(col, 0, sizeof(Dtype) * width_col);
+          continue;
+        }
+        const int h_pad = h * stride - pad + h_offset;
+        // input index of output column w is row_start + w * stride
+        const int row_start = (l_pad * height + h_pad) * width - pad + w_offset;
+        memset(col, 0, sizeof(Dtype) * w_begin);
+        if (stride == 1) {
+          memcpy(col + w_begin, im + row_start + w_begin, sizeof(Dtype) * (w_end - w_begin));
+        } else {
+          for (int w = w_begin; w < w_end; ++w) {
+            col[w] = im[row_start + w * stride];
+          }
         }
+        memset(col + w_end, 0, sizeof(Dtype) * (width_col - w_end));
       }
     }
   }
 }
 
+template <typename Dtype>
+void vol2col_cpu(const Dtype* data_im, const int channels, const int length,
+	    const int height, const int width, const int ksize, const int kdepth, const int pad,
+	    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_col) {
+  int length_col = (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  int height_col = (height + 2 * pad - ksize) / stride + 1;
+  int width_col = (width + 2 * pad - ksize) / stride + 1;
+  vol2col_ld_cpu(data_im, channels, length, height, width, ksize, kdepth, pad,
+      temporal_pad, stride, temporal_stride, data_col, length_col * height_col * width_col);
+}
+
+template <typename Dtype>
+void vol2col_batch_cpu(const Dtype* data_im, const int num, const int channels, const int length,
+	    const int height, const int width, const int ksize, const int kdepth, const int pad,
+	    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_col) {
+  int length_col = (length + 2 * temporal_pad - kdepth) / temporal_stride + 1;
+  int height_col = (height + 2 * pad - ksize) / stride + 1;
+  int width_col = (width + 2 * pad - ksize) / stride + 1;
+  int spatial_col = length_col * height_col * width_col;
+  int volume = channels * length * height * width;
+  for (int n = 0; n < num; ++n) {
+    vol2col_ld_cpu(data_im + n * volume, channels, length, height, width, ksize, kdepth, pad,
+        temporal_pad, stride, temporal_stride, data_col + n * spatial_col, num * spatial_col);
+  }
+}
+
 // Explicit instantiation
 template void vol2col_cpu<float>(const float* data_im, const int channels, const int length,
     const int height, const int width, const int ksize, const int kdepth, const int pad,
@@ -62,34 +127,91 @@ template void vol2col_cpu<float>(const float* data_im, const int channels, const
 template void vol2col_cpu<double>(const double* data_im, const int channels,const int length,
 	    const int height, const int width, const int ksize, const int kdepth, const int pad,
 	    const int temporal_pad, const int stride, const int temporal_stride, double* data_col);
+template void vol2col_batch_cpu<float>(const float* data_im, const int num, const int channels,
+	    const int length, const int height, const int width, const int ksize, const int kdepth,
+	    const int pad, const int temporal_pad, const int stride, const int temporal_stride,
+	    float* data_col);
+template void vol2col_batch_cpu<double>(const double* data_im, const int num, const int channels,
+	    const int length, const int height, const int width, const int ksize, const int kdepth,
+	    const int pad, const int temporal_pad, const int stride, const int temporal_stride,
+	    double* data_col);
+
+// Folds one volume; row c of the column matrix starts at data_col + c * ld.
+// Every input channel only receives the rows of its own kernel taps, so
+// channels are split across OpenMP threads without write conflicts.
+template <typename Dtype>
+static void col2vol_ld_cpu(const Dtype* data_col, const int channels, const int length,
+    const int height, const int width, const int ksize, const int kdepth, const int pad,
+    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_im,
+    const int ld) {
+  const int length_col = (length + 2* temporal_pad - kdepth) / temporal_stride + 1;
+  const int height_col = (height + 2 * pad - ksize) / stride + 1;
+  const int width_col = (width + 2 * pad - ksize) / stride + 1;
+  const int volume = length * height * width;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int c_im = 0; c_im < channels; ++c_im) {
+    Dtype* im = data_im + c_im * volume;
+    memset(im, 0, sizeof(Dtype) * volume);
+    for (int l_offset = 0; l_offset < kdepth; ++l_offset) {
+      for (int h_offset = 0; h_offset < ksize; ++h_offset) {
+        for (int w_offset = 0; w_offset < ksize; ++w_offset) {
+          const int c = ((c_im * kdepth + l_offset) * ksize + h_offset) * ksize + w_offset;
+          const Dtype* col_row = data_col + c * ld;
+          int l_begin, l_end, h_begin, h_end, w_begin, w_end;
+          valid_range(length, length_col, temporal_pad, l_offset, temporal_stride,
+              &l_begin, &l_end);
+          valid_range(height, height_col, pad, h_offset, stride, &h_begin, &h_end);
+          valid_range(width, width_col, pad, w_offset, stride, &w_begin, &w_end);
+          for (int l = l_begin; l < l_end; ++l) {
+            const int l_pad = l * temporal_stride - temporal_pad + l_offset;
+            for (int h = h_begin; h < h_end; ++h) {
+              const int h_pad = h * stride - pad + h_offset;
+              const Dtype* col = col_row + (l * height_col + h) * width_col;
+              const int row_start = (l_pad * height + h_pad) * width - pad + w_offset;
+              if (stride == 1) {
+                Dtype* im_row = im + row_start + w_begin;
+                const Dtype* col_valid = col + w_begin;
+                for (int w = 0; w < w_end - w_begin; ++w) {
+                  im_row[w] += col_valid[w];
+                }
+              } else {
+                for (int w = w_begin; w < w_end; ++w) {
+                  im[row_start + w * stride] += col[w];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
 
 template <typename Dtype>
 void col2vol_cpu(const Dtype* data_col, const int channels, const int length,
     const int height, const int width, const int ksize, const int kdepth, const int pad,
     const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_im) {
-  memset(data_im, 0, sizeof(Dtype) * length * height * width * channels);
   int length_col = (length + 2* temporal_pad - kdepth) / temporal_stride + 1;
   int height_col = (height + 2 * pad - ksize) / stride + 1;
   int width_col = (width + 2 * pad - ksize) / stride + 1;
-  int channels_col = channels * kdepth * ksize * ksize;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % ksize;
-    int h_offset = (c / ksize) % ksize;
-    int l_offset = (c / ksize / ksize) % kdepth;
-    int c_im = c / ksize / ksize / kdepth;
-    for (int l=0; l < length_col; ++l) {
-      for (int h = 0; h < height_col; ++h) {
-        for (int w = 0; w < width_col; ++w) {
-          int l_pad = l * temporal_stride - temporal_pad + l_offset;
-          int h_pad = h * stride - pad + h_offset;
-          int w_pad = w * stride - pad + w_offset;
-          if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width
-        		  && l_pad >= 0 && l_pad < length)
-            data_im[((c_im * length + l_pad) * height + h_pad) * width + w_pad] +=
-                data_col[((c * length_col + l) * height_col + h) * width_col + w];
-        }
-      }
-    }
+  col2vol_ld_cpu(data_col, channels, length, height, width, ksize, kdepth, pad,
+      temporal_pad, stride, temporal_stride, data_im, length_col * height_col * width_col);
+}
+
+template <typename Dtype>
+void col2vol_batch_cpu(const Dtype* data_col, const int num, const int channels, const int length,
+    const int height, const int width, const int ksize, const int kdepth, const int pad,
+    const int temporal_pad, const int stride, const int temporal_stride, Dtype* data_im) {
+  int length_col = (length + 2* temporal_pad - kdepth) / temporal_stride + 1;
+  int height_col = (height + 2 * pad - ksize) / stride + 1;
+  int width_col = (width + 2 * pad - ksize) / stride + 1;
+  int spatial_col = length_col * height_col * width_col;
+  int volume = channels * length * height * width;
+  for (int n = 0; n < num; ++n) {
+    col2vol_ld_cpu(data_col + n * spatial_col, channels, length, height, width, ksize, kdepth,
+        pad, temporal_pad, stride, temporal_stride, data_im + n * volume, num * spatial_col);
   }
 }
 
@@ -100,5 +222,13 @@ template void col2vol_cpu<float>(const float* data_col, const int channels, cons
 template void col2vol_cpu<double>(const double* data_col, const int channels, const int length,
 	    const int height, const int width, const int ksize, const int kdepth, const int pad,
 	    const int temporal_pad, const int stride, const int temporal_stride, double* data_im);
+template void col2vol_batch_cpu<float>(const float* data_col, const int num, const int channels,
+	    const int length, const int height, const int width, const int ksize, const int kdepth,
+	    const int pad, const int temporal_pad, const int stride, const int temporal_stride,
+	    float* data_im);
+template void col2vol_batch_cpu<double>(const double* data_col, const int num, const int channels,
+	    const int length, const int height, const int width, const int ksize, const int kdepth,
+	    const int pad, const int temporal_pad, const int stride, const int temporal_stride,
+	    double* data_im);
 
 }  // namespace caffe
@@ -13,6 +13,7 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +55,9 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(trace, "",
+    "Optional; at the end of train or time, write the latest profiled "
+    "events to this file as a Chrome trace and log their summary.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -146,6 +150,15 @@ int device_query() {
 }
 RegisterBrewFunction(device_query);
 
+// Write the profiled events to the trace file, if any, and log a summary.
+void WriteTrace() {
+  if (FLAGS_trace.size()) {
+    caffe::Profiler::Get().WriteTrace(FLAGS_trace);
+    LOG(INFO) << "Profile of the latest events:\n"
+        << caffe::Profiler::Get().Summary();
+  }
+}
+
 // Load the weights from the specified caffemodel(s) into the train and
 // test nets.
 void CopyLayers(caffe::Solver<float>* solver, const std::string& model_list) {
@@ -252,6 +265,7 @@ int train() {
     solver->Solve();
   }
   LOG(INFO) << "Optimization Done.";
+  WriteTrace();
   return 0;
 }
 RegisterBrewFunction(train);
@@ -362,10 +376,6 @@ int time() {
   caffe_net.Backward();
 
   const vector<shared_ptr<Layer<float> > >& layers = caffe_net.layers();
-  const vector<vector<Blob<float>*> >& bottom_vecs = caffe_net.bottom_vecs();
-  const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
-  const vector<vector<bool> >& bottom_need_backward =
-      caffe_net.bottom_need_backward();
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
@@ -383,15 +393,14 @@ int time() {
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
       timer.Start();
-      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
+      caffe_net.ForwardFromTo(i, i);
       forward_time_per_layer[i] += timer.MicroSeconds();
     }
     forward_time += forward_timer.MicroSeconds();
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
       timer.Start();
-      layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
-                          bottom_vecs[i]);
+      caffe_net.BackwardFromTo(i, i);
       backward_time_per_layer[i] += timer.MicroSeconds();
     }
     backward_time += backward_timer.MicroSeconds();
@@ -416,6 +425,10 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  LOG(INFO) << "Host memory: " << Caffe::host_memory_in_use() / 1048576
+    << " MB in use, " << Caffe::host_memory_cached() / 1048576
+    << " MB cached, " << Caffe::host_memory_peak() / 1048576 << " MB peak.";
+  WriteTrace();
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -26,6 +26,7 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 #include "caffe/layers/video_test_data_layer.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
@@ -60,8 +61,15 @@ int feature_extraction_pipeline(int argc, char** argv) {
         LOG(INFO) << "Using CPU";
     }
 
+    NetParameter net_param;
+    ReadNetParamsFromTextFileOrDie(net_proto, &net_param);
+    net_param.mutable_state()->set_phase(caffe::TEST);
+    // the features must not share memory with other blobs
+    for (int i=7; i<argc; i++){
+        net_param.add_keep_blob(argv[i]);
+    }
     shared_ptr<Net<Dtype> > feature_extraction_net(
-                new Net<Dtype>(net_proto, caffe::TEST));
+                new Net<Dtype>(net_param));
     feature_extraction_net->CopyTrainedLayersFrom(pretrained_model);
 
     for (int i=7; i<argc; i++){
@@ -27,6 +27,7 @@
 //#include "caffe/vision_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 #include "caffe/util/image_io.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
@@ -58,8 +59,15 @@ int feature_extraction_pipeline(int argc, char** argv) {
         LOG(INFO) << "Using CPU";
     }
 
+    NetParameter net_param;
+    ReadNetParamsFromTextFileOrDie(net_proto, &net_param);
+    net_param.mutable_state()->set_phase(caffe::TEST);
+    // the features must not share memory with other blobs
+    for (int i=7; i<argc; i++){
+        net_param.add_keep_blob(argv[i]);
+    }
     shared_ptr<Net<Dtype> > feature_extraction_net(
-                new Net<Dtype>(net_proto, caffe::TEST));
+                new Net<Dtype>(net_param));
     feature_extraction_net->CopyTrainedLayersFrom(pretrained_model);
 
     for (int i=7; i<argc; i++){
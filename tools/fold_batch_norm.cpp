@@ -0,0 +1,136 @@
+// Folds the BN, BatchNorm, Scale and Bias layers of a deploy net into the
+// weights of the Convolution, Convolution3D and InnerProduct layers before
+// them, writes the folded net and weights, and checks that the folded net
+// computes the same outputs as the original one on random inputs.
+//
+// Usage:
+//    fold_batch_norm --model=deploy.prototxt --weights=net.caffemodel
+//        --output_model=folded.prototxt --output_weights=folded.caffemodel
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::Net;
+using caffe::NetParameter;
+using caffe::shared_ptr;
+using std::string;
+using std::vector;
+
+DEFINE_string(model, "", "The deploy net prototxt to fold.");
+DEFINE_string(weights, "", "The trained weights of the net.");
+DEFINE_string(output_model, "", "Where to write the folded net prototxt.");
+DEFINE_string(output_weights, "", "Where to write the folded weights.");
+DEFINE_double(tolerance, 1e-3, "The largest difference between the outputs "
+    "of both nets, relative to the larger of 1 and the original output.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Fold the normalization layers of a deploy net "
+        "into the layers before them\n"
+        "Usage:\n"
+        "    fold_batch_norm [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to fold.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need the weights to fold.";
+  CHECK_GT(FLAGS_output_model.size(), 0) << "Need an output model.";
+  CHECK_GT(FLAGS_output_weights.size(), 0) << "Need output weights.";
+  Caffe::set_mode(Caffe::CPU);
+
+  // The TEST net, with the trained blobs attached to its layers.
+  NetParameter param, test_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  Net<float>::FilterNet(param, &test_param);
+  Net<float> net(test_param);
+  net.CopyTrainedLayersFrom(FLAGS_weights);
+  for (int i = 0; i < test_param.layer_size(); ++i) {
+    LayerParameter* layer_param = test_param.mutable_layer(i);
+    CHECK(layer_param->bottom_size() > 0 || layer_param->type() == "Input")
+        << "Layer " << layer_param->name() << " reads its own data; fold a "
+        << "deploy net with Input layers instead.";
+    const vector<shared_ptr<Blob<float> > >& blobs =
+        net.layer_by_name(layer_param->name())->blobs();
+    layer_param->clear_blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->ToProto(layer_param->add_blobs());
+    }
+  }
+
+  NetParameter folded_param;
+  caffe::FoldBatchNorm(test_param, &folded_param);
+  LOG(INFO) << "Folded " << test_param.layer_size()
+      - folded_param.layer_size() << " layers.";
+  caffe::WriteProtoToBinaryFile(folded_param, FLAGS_output_weights);
+  for (int i = 0; i < folded_param.layer_size(); ++i) {
+    folded_param.mutable_layer(i)->clear_blobs();
+  }
+  caffe::WriteProtoToTextFile(folded_param, FLAGS_output_model);
+
+  // Run both nets on the same random inputs.
+  Net<float> folded_net(FLAGS_output_model, caffe::TEST);
+  folded_net.CopyTrainedLayersFrom(FLAGS_output_weights);
+  caffe::FillerParameter filler_param;
+  caffe::GaussianFiller<float> filler(filler_param);
+  for (int i = 0; i < net.layers().size(); ++i) {
+    if (net.layers()[i]->type() != string("Input")) {
+      continue;
+    }
+    const vector<Blob<float>*>& tops = net.top_vecs()[i];
+    for (int j = 0; j < tops.size(); ++j) {
+      filler.Fill(tops[j]);
+    }
+  }
+  net.Forward();
+  for (int i = 0; i < folded_net.layers().size(); ++i) {
+    if (folded_net.layers()[i]->type() != string("Input")) {
+      continue;
+    }
+    const vector<Blob<float>*>& tops = folded_net.top_vecs()[i];
+    for (int j = 0; j < tops.size(); ++j) {
+      tops[j]->CopyFrom(*net.blob_by_name(
+          folded_net.blob_names()[folded_net.top_ids(i)[j]]));
+    }
+  }
+  folded_net.Forward();
+  for (int i = 0; i < net.output_blobs().size(); ++i) {
+    const string& blob_name = net.blob_names()[net.output_blob_indices()[i]];
+    CHECK(folded_net.has_blob(blob_name)) << "The folded net lost output "
+        << blob_name;
+    const Blob<float>* output = net.output_blobs()[i];
+    const Blob<float>* folded_output = folded_net.blob_by_name(blob_name).get();
+    CHECK_EQ(output->count(), folded_output->count());
+    float difference = 0;
+    for (int j = 0; j < output->count(); ++j) {
+      const float a = output->cpu_data()[j];
+      const float b = folded_output->cpu_data()[j];
+      difference = std::max(difference,
+          std::fabs(a - b) / std::max(1.f, std::fabs(a)));
+    }
+    LOG(INFO) << "Output " << blob_name << ": largest relative difference "
+        << difference;
+    CHECK_LE(difference, FLAGS_tolerance) << "The folded net does not "
+        << "reproduce output " << blob_name;
+  }
+  LOG(INFO) << "Wrote " << FLAGS_output_model << " and "
+      << FLAGS_output_weights;
+  return 0;
+}
@@ -0,0 +1,175 @@
+// Times vol2col_cpu / col2vol_cpu on the 3D convolution shapes of our video
+// models against the straightforward per-element loops they replace, and
+// checks that both give the same result.
+//
+// Usage:
+//    vol2col_benchmark [--iterations=10]
+// With USE_OPENMP, set OMP_NUM_THREADS to choose the number of threads.
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/vol2col.hpp"
+
+using caffe::CPUTimer;
+using std::vector;
+
+DEFINE_int32(iterations, 10, "The number of runs of every kernel and shape.");
+
+struct Shape {
+  const char* name;
+  int channels, length, height, width;
+  int ksize, kdepth, pad, temporal_pad, stride, temporal_stride;
+};
+
+// One sample of C3D (16 x 112 x 112 clips), of a strided stem, and of the
+// spatial factor of a (2+1)D block.
+static const Shape kShapes[] = {
+  {"c3d conv1a", 3, 16, 112, 112, 3, 3, 1, 1, 1, 1},
+  {"c3d conv2a", 64, 16, 56, 56, 3, 3, 1, 1, 1, 1},
+  {"c3d conv3a", 128, 8, 28, 28, 3, 3, 1, 1, 1, 1},
+  {"c3d conv4a", 256, 4, 14, 14, 3, 3, 1, 1, 1, 1},
+  {"c3d conv5a", 512, 2, 7, 7, 3, 3, 1, 1, 1, 1},
+  {"stem 7x7x3/2", 3, 16, 112, 112, 7, 3, 3, 1, 2, 1},
+  {"(2+1)d 1x3x3", 64, 16, 56, 56, 3, 1, 1, 0, 1, 1},
+};
+
+static int out_size(const int size, const int kernel, const int pad,
+    const int stride) {
+  return (size + 2 * pad - kernel) / stride + 1;
+}
+
+// The per-element loops with bounds checks that vol2col_cpu used to run.
+static void reference_vol2col(const float* data_im, const Shape& s,
+    float* data_col) {
+  const int length_col = out_size(s.length, s.kdepth, s.temporal_pad,
+      s.temporal_stride);
+  const int height_col = out_size(s.height, s.ksize, s.pad, s.stride);
+  const int width_col = out_size(s.width, s.ksize, s.pad, s.stride);
+  const int channels_col = s.channels * s.kdepth * s.ksize * s.ksize;
+  for (int c = 0; c < channels_col; ++c) {
+    const int w_offset = c % s.ksize;
+    const int h_offset = (c / s.ksize) % s.ksize;
+    const int l_offset = (c / s.ksize / s.ksize) % s.kdepth;
+    const int c_im = c / s.ksize / s.ksize / s.kdepth;
+    for (int l = 0; l < length_col; ++l) {
+      for (int h = 0; h < height_col; ++h) {
+        for (int w = 0; w < width_col; ++w) {
+          const int l_pad = l * s.temporal_stride - s.temporal_pad + l_offset;
+          const int h_pad = h * s.stride - s.pad + h_offset;
+          const int w_pad = w * s.stride - s.pad + w_offset;
+          const int index = ((c * length_col + l) * height_col + h)
+              * width_col + w;
+          if (l_pad >= 0 && l_pad < s.length && h_pad >= 0
+              && h_pad < s.height && w_pad >= 0 && w_pad < s.width) {
+            data_col[index] = data_im[((c_im * s.length + l_pad) * s.height
+                + h_pad) * s.width + w_pad];
+          } else {
+            data_col[index] = 0;
+          }
+        }
+      }
+    }
+  }
+}
+
+static void reference_col2vol(const float* data_col, const Shape& s,
+    float* data_im) {
+  const int length_col = out_size(s.length, s.kdepth, s.temporal_pad,
+      s.temporal_stride);
+  const int height_col = out_size(s.height, s.ksize, s.pad, s.stride);
+  const int width_col = out_size(s.width, s.ksize, s.pad, s.stride);
+  const int channels_col = s.channels * s.kdepth * s.ksize * s.ksize;
+  std::fill(data_im, data_im + s.channels * s.length * s.height * s.width, 0);
+  for (int c = 0; c < channels_col; ++c) {
+    const int w_offset = c % s.ksize;
+    const int h_offset = (c / s.ksize) % s.ksize;
+    const int l_offset = (c / s.ksize / s.ksize) % s.kdepth;
+    const int c_im = c / s.ksize / s.ksize / s.kdepth;
+    for (int l = 0; l < length_col; ++l) {
+      for (int h = 0; h < height_col; ++h) {
+        for (int w = 0; w < width_col; ++w) {
+          const int l_pad = l * s.temporal_stride - s.temporal_pad + l_offset;
+          const int h_pad = h * s.stride - s.pad + h_offset;
+          const int w_pad = w * s.stride - s.pad + w_offset;
+          if (l_pad >= 0 && l_pad < s.length && h_pad >= 0
+              && h_pad < s.height && w_pad >= 0 && w_pad < s.width) {
+            data_im[((c_im * s.length + l_pad) * s.height + h_pad) * s.width
+                + w_pad] += data_col[((c * length_col + l) * height_col + h)
+                * width_col + w];
+          }
+        }
+      }
+    }
+  }
+}
+
+static float max_difference(const vector<float>& a, const vector<float>& b) {
+  float diff = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    diff = std::max(diff, std::fabs(a[i] - b[i]));
+  }
+  return diff;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Benchmark the vol2col and col2vol CPU kernels\n"
+        "Usage:\n"
+        "    vol2col_benchmark [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_iterations, 0);
+
+  CPUTimer timer;
+  for (size_t i = 0; i < sizeof(kShapes) / sizeof(kShapes[0]); ++i) {
+    const Shape& s = kShapes[i];
+    const int volume = s.channels * s.length * s.height * s.width;
+    const int col_count = s.channels * s.kdepth * s.ksize * s.ksize
+        * out_size(s.length, s.kdepth, s.temporal_pad, s.temporal_stride)
+        * out_size(s.height, s.ksize, s.pad, s.stride)
+        * out_size(s.width, s.ksize, s.pad, s.stride);
+    vector<float> im(volume), col(col_count), col_im(volume),
+        ref_col(col_count), ref_col_im(volume);
+    for (int j = 0; j < volume; ++j) {
+      im[j] = static_cast<float>(j % 255) / 255;
+    }
+
+    double ms[4] = {0, 0, 0, 0};
+    for (int iter = 0; iter < FLAGS_iterations; ++iter) {
+      timer.Start();
+      reference_vol2col(&im[0], s, &ref_col[0]);
+      ms[0] += timer.MilliSeconds();
+      timer.Start();
+      caffe::vol2col_cpu(&im[0], s.channels, s.length, s.height, s.width,
+          s.ksize, s.kdepth, s.pad, s.temporal_pad, s.stride,
+          s.temporal_stride, &col[0]);
+      ms[1] += timer.MilliSeconds();
+      timer.Start();
+      reference_col2vol(&ref_col[0], s, &ref_col_im[0]);
+      ms[2] += timer.MilliSeconds();
+      timer.Start();
+      caffe::col2vol_cpu(&col[0], s.channels, s.length, s.height, s.width,
+          s.ksize, s.kdepth, s.pad, s.temporal_pad, s.stride,
+          s.temporal_stride, &col_im[0]);
+      ms[3] += timer.MilliSeconds();
+    }
+    CHECK_EQ(max_difference(col, ref_col), 0) << s.name << ": vol2col";
+    CHECK_LE(max_difference(col_im, ref_col_im), 1e-4) << s.name
+        << ": col2vol";
+    LOG(INFO) << s.name << " (" << col_count * sizeof(float) / 1048576.
+        << " MB of columns): vol2col " << ms[1] / FLAGS_iterations
+        << " ms (" << ms[0] / ms[1] << "x), col2vol "
+        << ms[3] / FLAGS_iterations << " ms (" << ms[2] / ms[3] << "x)";
+  }
+  return 0;
+}